@@ -0,0 +1,87 @@
+#include "HAL.h"
+#include "Analog.h"
+
+#if (ANALOG_COUNT > 0)
+#include <LUFA/Drivers/Peripheral/ADC.h>
+
+// Our channels, as ADC channel numbers, in the order they go out in reports.
+static const uint8_t AnalogChannels[ANALOG_COUNT] = { ANALOG_INPUTS };
+
+// The conversion the interrupt just got the result of, and the one the ADC has already started on. The ADC runs
+// freely, so a new channel only takes effect a conversion after we ask for it.
+static uint8_t AnalogSampled;
+static uint8_t AnalogStarted;
+
+// Conversions added up so far for each input, and how many.
+static uint16_t AnalogSum[ANALOG_COUNT];
+static uint8_t  AnalogCount[ANALOG_COUNT];
+
+// Each input's smoothed reading, in fixed point with 3 fractional bits. Each new reading moves it a quarter of the way.
+#define ANALOG_FRACTION  3
+#define ANALOG_SMOOTHING 2
+
+static volatile uint16_t AnalogFiltered[ANALOG_COUNT];
+
+// Turns a channel number into what the ADC's multiplexer wants for it: channels 8-13 are MUX5, plus 0-5.
+static uint16_t AnalogMask(uint8_t channel) {
+	return ADC_REFERENCE_AVCC | ADC_RIGHT_ADJUSTED | ((channel < 8) ? channel : ((1 << 8) | (channel - 8)));
+}
+
+// Function for initializing our analog inputs. The ADC runs freely from here on, at 125kHz, going round the channels
+// one conversion at a time. That's about 9600 conversions a second, shared between them.
+void Analog_Init(void) {
+	cli();
+
+	// Anything already under way is dropped, so no result can land on the wrong input.
+	ADC_Disable();
+
+	for (uint8_t i = 0; i < ANALOG_COUNT; i++) {
+		ADC_SetupChannel(AnalogChannels[i]);
+		AnalogSum[i]      = 0;
+		AnalogCount[i]    = 0;
+		AnalogFiltered[i] = 0;
+	}
+
+	ADC_Init(ADC_FREE_RUNNING | ADC_PRESCALE_128);
+	ADCSRA |= (1 << ADIE);
+
+	// The channel can't safely change until the first conversion is under way, so the first two are both on the first
+	// channel, and the interrupt takes it from there.
+	AnalogSampled = 0;
+	AnalogStarted = 0;
+	ADC_StartReading(AnalogMask(AnalogChannels[0]));
+
+	sei();
+}
+
+// Function for retrieving an input, as a 12-bit value.
+uint16_t Analog_GetValue(uint8_t input) {
+	uint16_t value;
+
+	// This is two bytes wide, so the interrupt could change it halfway through reading.
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) value = AnalogFiltered[input];
+
+	return (value + (1 << (ANALOG_FRACTION - 1))) >> ANALOG_FRACTION;
+}
+
+// The interrupt that is executed at the end of every conversion.
+ISR(ADC_vect) {
+	uint8_t input = AnalogSampled;
+
+	AnalogSum[input] += ADC_GetResult();
+
+	if (++AnalogCount[input] == ANALOG_OVERSAMPLE) {
+		// The sum has 4 more bits than a conversion, and the noise averaged out of it is worth 2 of them.
+		int16_t reading = (int16_t)((AnalogSum[input] >> 2) << ANALOG_FRACTION);
+
+		AnalogFiltered[input] += (reading - (int16_t)AnalogFiltered[input]) >> ANALOG_SMOOTHING;
+		AnalogSum[input]   = 0;
+		AnalogCount[input] = 0;
+	}
+
+	// The next result is from the conversion already under way. The one after that is the next channel round.
+	AnalogSampled = AnalogStarted;
+	if (++AnalogStarted == ANALOG_COUNT) AnalogStarted = 0;
+	ADC_StartReading(AnalogMask(AnalogChannels[AnalogStarted]));
+}
+#endif
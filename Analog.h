@@ -0,0 +1,28 @@
+#ifndef _ANALOG_H_
+#define _ANALOG_H_
+
+#include <stdint.h>
+#include "Config/AppConfig.h"
+
+// How many analog inputs we have, counted from ANALOG_INPUTS.
+#define ANALOG_COUNT_OF(...)                        ANALOG_COUNT_N(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define ANALOG_COUNT_N(a, b, c, d, e, f, g, h, n, ...) n
+
+#if defined(ANALOG_INPUTS)
+	#define ANALOG_COUNT ANALOG_COUNT_OF(ANALOG_INPUTS)
+	#if (ANALOG_COUNT > 4)
+		#error ANALOG_INPUTS can list at most 4 channels.
+	#endif
+#else
+	#define ANALOG_COUNT 0
+#endif
+
+// Every reading is 16 conversions added up and shifted down by 2, so 10-bit conversions come out as 12 bits.
+#define ANALOG_OVERSAMPLE 16
+#define ANALOG_BITS       12
+#define ANALOG_MAXIMUM    ((1 << ANALOG_BITS) - 1)
+
+void     Analog_Init(void);
+uint16_t Analog_GetValue(uint8_t input);
+
+#endif
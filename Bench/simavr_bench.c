@@ -0,0 +1,328 @@
+/* USBemani latency benchmark
+ *
+ * Runs the real firmware under simavr, presses buttons on a fixed
+ * schedule, and plays the part of a USB host polling the joystick
+ * endpoint every millisecond. Prints, as JSON:
+ *   - a cycle histogram for every interrupt handler that ran, from its
+ *     vector to its RETI, less any handlers nested in it
+ *   - the longest window with interrupts disabled outside a handler
+ *   - the main loop period, if given the address of HID_Task
+ *   - press-to-report latency percentiles
+ * The schedule is seeded, so two builds can be compared with diff.
+ *
+ * usage: simavr_bench USBemani.elf [milliseconds] [HID_Task address]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <avr_ioport.h>
+#include <avr_usb.h>
+
+// simavr has no ATmega16U4 core, but the 32U4 is the same part with more memory.
+#define MCU			"atmega32u4"
+#define F_CPU			16000000
+#define CYCLES_PER_MS		(F_CPU / 1000)
+#define VECTORS			43
+#define HISTOGRAM_BINS		2048
+#define MAX_LATENCIES		100000
+
+// Buttons 1-8 sit on port D, active low.
+#define BUTTON_PORT		'D'
+#define BUTTON_PIN		0
+
+#define GENERIC_IN_PIPE		1
+#define REPORT_BUTTON_OFFSET	4
+
+struct usbsetup {
+	uint8_t reqtype;
+	uint8_t req;
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+} __attribute__((packed));
+
+struct stats {
+	uint64_t count, total;
+	uint32_t min, max;
+	uint32_t histogram[HISTOGRAM_BINS];
+};
+
+static avr_t *avr;
+static struct stats isr[VECTORS];
+static struct stats loop;
+static uint32_t cli_max;
+static uint32_t cli_max_pc;
+static uint32_t loop_addr;
+
+// Handlers in progress, innermost last. LUFA's USB_COM handler turns
+// interrupts back on before it handles the control request, so the I
+// flag can't say when a handler is over; its own RETI does. Time spent
+// in a nested handler is charged to that one, not the one it interrupted.
+#define MAX_DEPTH		8
+#define OP_RETI			0x9518
+
+struct frame {
+	int vector;
+	uint64_t start, nested;
+};
+
+static struct frame frames[MAX_DEPTH];
+static int depth;
+
+// Interrupt tracking state, updated after every instruction
+static uint64_t cli_start, loop_last;
+static uint32_t cli_start_pc;
+static int irq_seen, cli_open;
+
+static uint32_t latencies[MAX_LATENCIES];
+static int latency_count;
+
+static void record(struct stats *s, uint32_t cycles)
+{
+	if (!s->count || cycles < s->min) s->min = cycles;
+	if (cycles > s->max) s->max = cycles;
+	s->count++;
+	s->total += cycles;
+	s->histogram[cycles < HISTOGRAM_BINS ? cycles : HISTOGRAM_BINS - 1]++;
+}
+
+static void close_cli(void)
+{
+	uint32_t window = avr->cycle - cli_start;
+
+	cli_open = 0;
+	if (window > cli_max) {
+		cli_max = window;
+		cli_max_pc = cli_start_pc;
+	}
+}
+
+// Run a single instruction, and account for any handler it entered or
+// left, and for what it did to the interrupt flag
+static void step(void)
+{
+	uint32_t pc = avr->pc;
+	int reti = avr->state == cpu_Running && (avr->flash[pc] | (avr->flash[pc + 1] << 8)) == OP_RETI;
+	avr_run(avr);
+	uint32_t npc = avr->pc;
+	int iflag = avr->sreg[S_I];
+
+	if (reti && depth > 0) {
+		struct frame *f = &frames[--depth];
+		uint64_t cycles = avr->cycle - f->start;
+		record(&isr[f->vector], cycles - f->nested);
+		if (depth > 0) frames[depth - 1].nested += cycles;
+	}
+	if (!iflag && npc && npc < VECTORS * avr->vector_size
+	  && (npc % avr->vector_size) == 0 && npc != pc && depth < MAX_DEPTH) {
+		// Interrupt taken, which clears the I flag on the way in. If the
+		// instruction before it set the flag, that ended a window.
+		if (cli_open) close_cli();
+		frames[depth].vector = npc / avr->vector_size;
+		frames[depth].start = avr->cycle;
+		frames[depth].nested = 0;
+		depth++;
+	} else if (depth > 0) {
+		// What a handler does with the flag is its own business
+	} else if (irq_seen) {
+		if (!iflag && !cli_open) {
+			cli_open = 1;
+			cli_start = avr->cycle;
+			cli_start_pc = pc;
+		} else if (iflag && cli_open) {
+			close_cli();
+		}
+	} else if (iflag) {
+		// Start-up runs with interrupts off, which doesn't count
+		irq_seen = 1;
+	}
+
+	if (loop_addr && npc == loop_addr && npc != pc) {
+		if (loop_last) record(&loop, avr->cycle - loop_last);
+		loop_last = avr->cycle;
+	}
+}
+
+static void run_cycles(uint64_t cycles)
+{
+	uint64_t end = avr->cycle + cycles;
+	while (avr->cycle < end) step();
+}
+
+// Control transfers, as the host would make them. The device gets a
+// little time to answer between tries.
+static int control(uint8_t reqtype, uint8_t req, uint16_t wValue, uint16_t wIndex, uint8_t *data, uint16_t wLength)
+{
+	struct usbsetup setup = { reqtype, req, wValue, wIndex, wLength };
+	struct avr_io_usb pkt = { 0, sizeof(setup), (uint8_t *)&setup };
+	int ret, tries;
+
+	avr_ioctl(avr, AVR_IOCTL_USB_SETUP, &pkt);
+	pkt.buf = data;
+	pkt.sz = wLength;
+	if (wLength) {
+		for (tries = 0; tries < 1000; tries++) {
+			ret = avr_ioctl(avr, (reqtype & 0x80) ? AVR_IOCTL_USB_READ : AVR_IOCTL_USB_WRITE, &pkt);
+			if (ret != AVR_IOCTL_USB_NAK) break;
+			run_cycles(CYCLES_PER_MS / 10);
+		}
+		if (ret != AVR_IOCTL_USB_OK) return -1;
+	}
+	// Status stage, in the other direction
+	pkt.sz = 0;
+	for (tries = 0; tries < 1000; tries++) {
+		ret = avr_ioctl(avr, (reqtype & 0x80) ? AVR_IOCTL_USB_WRITE : AVR_IOCTL_USB_READ, &pkt);
+		if (ret != AVR_IOCTL_USB_NAK) break;
+		run_cycles(CYCLES_PER_MS / 10);
+	}
+	return ret == AVR_IOCTL_USB_OK ? 0 : -1;
+}
+
+static void set_button(int pressed)
+{
+	avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BUTTON_PORT), BUTTON_PIN), pressed ? 0 : 1);
+}
+
+static int compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(int p)
+{
+	if (!latency_count) return 0;
+	return latencies[(latency_count - 1) * p / 100];
+}
+
+static const char *vector_name(int vector)
+{
+	switch (vector) {
+		case 10: return "USB_GEN";
+		case 11: return "USB_COM";
+		case 21: return "TIMER0_COMPA";
+		case 24: return "SPI_STC";
+	}
+	return NULL;
+}
+
+static void print_stats(const struct stats *s)
+{
+	int i, first = 1;
+
+	printf("{\"count\": %llu, \"min\": %u, \"max\": %u, \"mean\": %.1f, \"histogram\": {",
+		(unsigned long long)s->count, s->min, s->max, s->count ? (double)s->total / s->count : 0.0);
+	for (i = 0; i < HISTOGRAM_BINS; i++) {
+		if (!s->histogram[i]) continue;
+		printf("%s\"%d\": %u", first ? "" : ", ", i, s->histogram[i]);
+		first = 0;
+	}
+	printf("}}");
+}
+
+int main(int argc, char **argv)
+{
+	elf_firmware_t f;
+	uint8_t report[64];
+	uint32_t ms, duration = 5000, seed = 0x5EED;
+	uint64_t pressed_at = 0, next_change;
+	int i, pressed = 0, reported = 0, first;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s USBemani.elf [milliseconds] [HID_Task address]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2) duration = strtoul(argv[2], NULL, 0);
+	if (argc > 3) loop_addr = strtoul(argv[3], NULL, 0);
+
+	memset(&f, 0, sizeof(f));
+	if (elf_read_firmware(argv[1], &f)) {
+		fprintf(stderr, "Unable to read %s\n", argv[1]);
+		return 1;
+	}
+	strcpy(f.mmcu, MCU);
+	f.frequency = F_CPU;
+
+	avr = avr_make_mcu_by_name(f.mmcu);
+	if (!avr) {
+		fprintf(stderr, "simavr has no %s core\n", f.mmcu);
+		return 1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &f);
+
+	// All buttons released, so the pins idle high
+	for (i = 0; i < 8; i++)
+		avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BUTTON_PORT), i), 1);
+
+	// Power up, let the firmware attach, then enumerate
+	avr_ioctl(avr, AVR_IOCTL_USB_VBUS, (void *)1);
+	run_cycles(100 * CYCLES_PER_MS);
+	avr_ioctl(avr, AVR_IOCTL_USB_RESET, NULL);
+	run_cycles(10 * CYCLES_PER_MS);
+	if (control(0x00, 0x05, 1, 0, NULL, 0) || control(0x00, 0x09, 1, 0, NULL, 0)) {
+		fprintf(stderr, "Device did not enumerate\n");
+		return 1;
+	}
+
+	// Start measuring from a clean slate
+	memset(isr, 0, sizeof(isr));
+	memset(&loop, 0, sizeof(loop));
+	loop_last = 0;
+	cli_max = 0;
+
+	next_change = avr->cycle + CYCLES_PER_MS;
+	for (ms = 0; ms < duration; ms++) {
+		uint64_t frame_end = avr->cycle + CYCLES_PER_MS;
+
+		while (avr->cycle < frame_end) {
+			if (avr->cycle >= next_change) {
+				// Hold each state for 2 to 10 ms, landing anywhere in the frame
+				pressed = !pressed;
+				set_button(pressed);
+				pressed_at = avr->cycle;
+				reported = 0;
+				seed = seed * 1103515245 + 12345;
+				next_change = avr->cycle + 2 * CYCLES_PER_MS + (seed >> 8) % (8 * CYCLES_PER_MS);
+			}
+			step();
+		}
+
+		// One poll per frame
+		struct avr_io_usb pkt = { GENERIC_IN_PIPE, sizeof(report), report };
+		if (avr_ioctl(avr, AVR_IOCTL_USB_READ, &pkt) != AVR_IOCTL_USB_OK || pkt.sz <= REPORT_BUTTON_OFFSET)
+			continue;
+		if (pressed && !reported && (report[REPORT_BUTTON_OFFSET] & (1 << BUTTON_PIN))) {
+			reported = 1;
+			if (latency_count < MAX_LATENCIES)
+				latencies[latency_count++] = (avr->cycle - pressed_at) / (F_CPU / 1000000);
+		}
+	}
+
+	qsort(latencies, latency_count, sizeof(latencies[0]), compare);
+
+	printf("{\n\"mcu\": \"%s\",\n\"milliseconds\": %u,\n\"isr_cycles\": {", MCU, duration);
+	for (i = 0, first = 1; i < VECTORS; i++) {
+		if (!isr[i].count) continue;
+		printf("%s\n  \"", first ? "" : ",");
+		if (vector_name(i)) printf("%s", vector_name(i));
+		else printf("vector_%d", i);
+		printf("\": ");
+		print_stats(&isr[i]);
+		first = 0;
+	}
+	printf("\n},\n\"cli_max_cycles\": %u,\n\"cli_max_pc\": \"0x%04x\",\n", cli_max, cli_max_pc);
+	if (loop_addr) {
+		printf("\"main_loop_cycles\": ");
+		print_stats(&loop);
+		printf(",\n");
+	}
+	printf("\"press_to_report_us\": {\"samples\": %d, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}\n}\n",
+		latency_count, percentile(50), percentile(90), percentile(99), percentile(100));
+	return 0;
+}
@@ -0,0 +1,148 @@
+#ifndef _BOARD_H_
+#define _BOARD_H_
+
+#include "Config/AppConfig.h"
+
+// Our board profiles. Each one gives the pins a board has everything on, as constants, so every module that touches
+// a pin is built for exactly one board: the masks and shifts below all fold away, and nothing is looked up at runtime.
+#define PROFILE_HOME     1
+#define PROFILE_ARCADE   2
+#define PROFILE_PROMICRO 3
+
+#if !defined(BOARD_PROFILE)
+	#define BOARD_PROFILE PROFILE_HOME
+#endif
+
+// Pin groups. Each entry is X(port letter, pin mask, shift): the pins in the mask, shifted left that far (or right,
+// if it's negative), give their buttons or lights. Groups are listed in button order, and never overlap.
+#define BOARD_SHIFT(value, shift) (((shift) >= 0) ? ((value) << (shift)) : ((value) >> -(shift)))
+
+#if (BOARD_PROFILE == PROFILE_HOME) || (BOARD_PROFILE == PROFILE_ARCADE)
+	// USBemani v2 boards. The home and arcade boards share a layout; the arcade board inverts its PS2 output.
+	//
+	// * Buttons 1-8 on PD0-PD7, 9-12 on PB4-PB7. Lights share them, through latches with LE on PF7.
+	// * Encoders on PF0-PF1 and PF4-PF5.
+	// * PS2 on the SPI bus (PB0-PB3), with ACK on PF6.
+	// * An onboard LED on PE6.
+	#if (BOARD_PROFILE == PROFILE_ARCADE)
+		#define BOARD_TYPE ARCADE
+	#else
+		#define BOARD_TYPE HOME
+	#endif
+
+	#define BOARD_BUTTON_PINS(X) X(D, 0xFF, 0) X(B, 0xF0, 4)
+
+	// With SHIFT_REGISTER_BUTTONS, the USART and the shift registers' load pin take PD2-PD5, so lights 3-6 go nowhere.
+	#if defined(SHIFT_REGISTER_BUTTONS)
+		#define BOARD_LIGHT_PINS(X) X(D, 0xC3, 0) X(B, 0xF0, 4)
+	#else
+		#define BOARD_LIGHT_PINS(X) X(D, 0xFF, 0) X(B, 0xF0, 4)
+	#endif
+
+	#define BOARD_LATCH_DDR     DDRF
+	#define BOARD_LATCH_PORT    PORTF
+	#define BOARD_LATCH_MASK    (1 << PF7)
+
+	#define BOARD_ENCODER_DDR   DDRF
+	#define BOARD_ENCODER_PORT  PORTF
+	#define BOARD_ENCODER_PIN   PINF
+	#define BOARD_ENCODER0      ChannelA
+	#define BOARD_ENCODER1      ChannelC
+
+	#define BOARD_PS2_ACK_DDR   DDRF
+	#define BOARD_PS2_ACK_PORT  PORTF
+	#define BOARD_PS2_ACK_MASK  (1 << PF6)
+
+	#define BOARD_LED_DDR       DDRE
+	#define BOARD_LED_PORT      PORTE
+	#define BOARD_LED_MASK      (1 << PE6)
+
+	// Board identifier pins, pulled up at startup.
+	#define BOARD_IDENT_DDR     DDRC
+	#define BOARD_IDENT_PORT    PORTC
+	#define BOARD_IDENT_MASK    ((1 << PC7) | (1 << PC6))
+
+	// Pins that nothing else can have: the encoders, PS2 ACK and the latch on port F, and the shift registers' USART
+	// and load pin on port D.
+	#define BOARD_FIXED_F       0xF3
+	#if defined(SHIFT_REGISTER_BUTTONS)
+		#define BOARD_FIXED_D   0x3C
+	#else
+		#define BOARD_FIXED_D   0x00
+	#endif
+	#define BOARD_FIXED_B       0x0F
+#elif (BOARD_PROFILE == PROFILE_PROMICRO)
+	// Pro Micro-class ATmega32u4 boards, by the pins they break out. SS (PB0) and XCK1 (PD5) only drive the RX and
+	// TX LEDs, so there's no PS2 and no shift register buttons.
+	//
+	// * Buttons 1-5 on PD0-PD4 (3, 2, RX, TX, 4), 6 on PC6 (5), 7 on PD7 (6), 8 on PE6 (7), 9-11 on PB4-PB6 (8-10)
+	//   and 12 on PB2 (16). Lights share them, through latches with LE on PB3 (14).
+	// * Encoders on PF4-PF5 (A3, A2) and PF6-PF7 (A1, A0).
+	// * The RX LED on PB0, which lights when driven low.
+	#if defined(SHIFT_REGISTER_BUTTONS)
+		#error SHIFT_REGISTER_BUTTONS needs XCK1 (PD5), which Pro Micro boards do not break out.
+	#endif
+	// The bootloader sits at the top of flash, so a build for the wrong part would jump into the middle of ours.
+	#if defined(__AVR__) && !defined(__AVR_ATmega32U4__)
+		#error Pro Micro boards are ATmega32u4s; build with "make MCU=atmega32u4".
+	#endif
+
+	#define BOARD_TYPE HOME
+
+	#define BOARD_BUTTON_PINS(X) X(D, 0x1F, 0) X(C, 0x40, -1) X(D, 0x80, -1) X(E, 0x40, 1) X(B, 0x70, 4) X(B, 0x04, 9)
+	#define BOARD_LIGHT_PINS(X)  BOARD_BUTTON_PINS(X)
+
+	#define BOARD_LATCH_DDR     DDRB
+	#define BOARD_LATCH_PORT    PORTB
+	#define BOARD_LATCH_MASK    (1 << PB3)
+
+	#define BOARD_ENCODER_DDR   DDRF
+	#define BOARD_ENCODER_PORT  PORTF
+	#define BOARD_ENCODER_PIN   PINF
+	#define BOARD_ENCODER0      ChannelC
+	#define BOARD_ENCODER1      ChannelD
+
+	#define BOARD_LED_DDR       DDRB
+	#define BOARD_LED_PORT      PORTB
+	#define BOARD_LED_MASK      (1 << PB0)
+	#define BOARD_LED_ACTIVE_LOW
+
+	// Pins that nothing else can have: the encoders on port F, and the LED and latch on port B.
+	#define BOARD_FIXED_F       0xF0
+	#define BOARD_FIXED_D       0x00
+	#define BOARD_FIXED_B       0x09
+#else
+	#error Unknown BOARD_PROFILE.
+#endif
+
+// Analog inputs. Each ADC channel takes its pin from the button and light on it, if there are any: the groups above
+// leave out every pin in BOARD_ANALOG_<port>. ADC0-ADC7 are PF0-PF7, ADC8 is PD4, ADC9 and ADC10 are PD6 and PD7, and
+// ADC11-ADC13 are PB4-PB6. Ports C and E have no ADC channels.
+#define BOARD_ADC_F(channel) (((channel) < 8) ? (1 << (channel)) : 0)
+#define BOARD_ADC_D(channel) (((channel) == 8) ? (1 << 4) : ((channel) == 9) ? (1 << 6) : ((channel) == 10) ? (1 << 7) : 0)
+#define BOARD_ADC_B(channel) ((((channel) >= 11) && ((channel) <= 13)) ? (1 << ((channel) - 7)) : 0)
+
+#if defined(ANALOG_INPUTS)
+	// ANALOG_INPUTS is padded out to 4 channels with one that isn't on any port.
+	#define BOARD_ANALOG_EACH(f, ...)             BOARD_ANALOG_EACH_N(f, __VA_ARGS__, 0xFF, 0xFF, 0xFF)
+	#define BOARD_ANALOG_EACH_N(f, a, b, c, d, ...) (f(a) | f(b) | f(c) | f(d))
+
+	#define BOARD_ANALOG_B      BOARD_ANALOG_EACH(BOARD_ADC_B, ANALOG_INPUTS)
+	#define BOARD_ANALOG_D      BOARD_ANALOG_EACH(BOARD_ADC_D, ANALOG_INPUTS)
+	#define BOARD_ANALOG_F      BOARD_ANALOG_EACH(BOARD_ADC_F, ANALOG_INPUTS)
+#else
+	#define BOARD_ANALOG_B      0
+	#define BOARD_ANALOG_D      0
+	#define BOARD_ANALOG_F      0
+#endif
+#define BOARD_ANALOG_C          0
+#define BOARD_ANALOG_E          0
+
+#if (BOARD_ANALOG_B & BOARD_FIXED_B) || (BOARD_ANALOG_D & BOARD_FIXED_D) || (BOARD_ANALOG_F & BOARD_FIXED_F)
+	#error ANALOG_INPUTS uses a pin this board needs for its encoders, latch, LED, PS2 or shift registers.
+#endif
+
+// A group's pins, less any the analog inputs have taken.
+#define BOARD_GROUP_MASK(port, mask) ((mask) & ~BOARD_ANALOG_##port)
+
+#endif
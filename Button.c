@@ -1,18 +1,57 @@
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include "HAL.h"
 #include "Config.h"
 #include "Button.h"
- 
-#define B07_DDR  DDRD
-#define B07_PORT PORTD
-#define B07_PIN  PIND
+#include "Profile.h"
+#include "Board.h"
 
-#define B8F_DDR  DDRB
-#define B8F_PORT PORTB
-#define B8F_PIN  PINB
+#if defined(SHIFT_REGISTER_BUTTONS)
+#include <LUFA/Drivers/Peripheral/SerialSPI.h>
+
+// The shift registers' parallel load (SH/LD) pin. The USART itself takes PD2 (data in), PD3 and PD5 (clock).
+#define SR_LOAD_DDR  DDRD
+#define SR_LOAD_PORT PORTD
+#define SR_LOAD      (1 << PD4)
+
+// How many shift registers are chained, and how fast we clock them out. Every one is read on each timer tick.
+#define SR_COUNT     ((SHIFT_REGISTER_BUTTONS + 7) / 8)
+#define SR_CLOCK     4000000
+#else
+// Each group of button pins, as inputs with pullups, and read in as their buttons. Pressed buttons read low. Pins an
+// analog input has taken are left alone, and their buttons read as released.
+#define BUTTON_GROUP_INPUT(port, mask, shift) \
+  DDR##port &= (uint8_t)~BOARD_GROUP_MASK(port, mask); PORT##port |= BOARD_GROUP_MASK(port, mask);
+#define BUTTON_GROUP_READ(port, mask, shift) \
+  buf |= BOARD_SHIFT((Buttons_t)(uint8_t)(~PIN##port & BOARD_GROUP_MASK(port, mask)), shift);
+#endif
 
 Settings_Lights_t *SettingsLights;
 Settings_Device_t *SettingsDevice;
+Settings_Debounce_t *SettingsDebounce;
+
+// Our debouncing, per button. These are copied out of the settings on setup, one entry for every button we have.
+static uint8_t   DebounceTime[BUTTON_COUNT];
+static Buttons_t DebounceIntegrate;
+// Each button's counter, in timer ticks, and which buttons have one that isn't at rest.
+static uint8_t   DebounceCount[BUTTON_COUNT];
+static Buttons_t DebounceActive;
+
+// Our input buffer. The timer interrupt samples our buttons far more often than the host polls us,
+// and pushes every change in state here, so a press shorter than a polling interval is never lost.
+// This must be a power of two.
+#define BUTTON_BUFFER_SIZE 32
+
+volatile Buttons_t ButtonBuffer[BUTTON_BUFFER_SIZE];
+volatile uint8_t   ButtonHead;
+         uint8_t   ButtonTail;
+// The most recent sample, which is always the current state of our buttons, as we report them.
+volatile Buttons_t ButtonLast;
+// The same, before anything is held back for a profile switch. This is what debouncing works from.
+static   Buttons_t ButtonDebounced;
+// Presses that have come out of the buffer, but haven't been seen by each reader yet.
+         Buttons_t ButtonPressed[BUTTON_READERS];
+
+Buttons_t Button_Read(void);
+static Buttons_t Button_Debounce(Buttons_t raw);
 
 // Function for initializing buttons.
 void Button_Init(void) {
@@ -23,6 +62,7 @@ void Button_Init(void) {
   // However, we can expose configuration objects if we need them.
 	Config_AddressLights(&SettingsLights);
 	Config_AddressDevice(&SettingsDevice);
+	Config_AddressDebounce(&SettingsDebounce);
 
   // The reference implementation for lights supports 12 lights, and uses a multiplexing setup for shared I/O with buttons.
 	//
@@ -40,54 +80,186 @@ void Button_Init(void) {
   //                                                                             CY74:OUT--------FET
 	// * Wire each unused input on the CY74FCT573T to ground.                      CY74:IN---------GND
   //
-  // This specific implementation uses the following pins for I/O:
+  // The pins used for I/O depend on the board; see Board.h. On USBemani boards, these are:
   // * PD0-PD7
   // * PB4-PB7 (PB0-PB3 are the SPI bus used for PS2)
+  #if defined(SHIFT_REGISTER_BUTTONS)
+  // With SHIFT_REGISTER_BUTTONS, the buttons come in through chained 74HC165 shift registers instead, read through the
+  // USART in SPI mode. Lights are still latched out as above, less the pins the USART and load pin take.
+  //
+  // Wire the following:
+  // * Each button between an input (A-H) on a 74HC165 and ground.                BTN-------------GND
+  // * Each input to 5V through a 10k pull-up resistor.                         165:IN----10k---5V
+  // * SH/LD on every 74HC165 to PD4.                                           165:SH/LD-------PD4
+  // * CLK on every 74HC165 to PD5 (XCK1), and CLK INH to ground.               165:CLK---------PD5
+  // * QH on the first 74HC165 to PD2 (RXD1).                                   165:QH----------PD2
+  // * QH on each following 74HC165 to SER on the one before it. SER on the last one to ground.
+  //
+  // Buttons 1-8 are inputs A-H on the first 74HC165, 9-16 on the second, and so on.
+  // The clock idles high and we sample on its falling edge, so the first bit is read before anything shifts.
+  SR_LOAD_PORT |= SR_LOAD;
+  SR_LOAD_DDR  |= SR_LOAD;
+  SerialSPI_Init(USART_SPI_SCK_LEAD_FALLING | USART_SPI_SAMPLE_LEADING | USART_SPI_ORDER_MSB_FIRST, SR_CLOCK);
+  #else
   // Since we're setting up buttons, we'll setup our initial I/O state.
-	B07_DDR  &= ~0xFF;
-	B8F_DDR  &= ~0xF0;
-	B07_PORT |=  0xFF;
-	B8F_PORT |=  0xF0;
+  BOARD_BUTTON_PINS(BUTTON_GROUP_INPUT)
+  #endif
+
+	// Start our buffer off with the current state.
+	ButtonHead = ButtonTail = 0;
+	ButtonDebounced = Button_Read();
+	ButtonLast      = ButtonDebounced & ~Profile_Sample(ButtonDebounced);
+	for (uint8_t i = 0; i < BUTTON_READERS; i++)
+		ButtonPressed[i] = 0;
+
+	// Our debounce settings, with buttons past the 16th taking the 16th's. Integrating buttons start out settled
+	// wherever they are, and eager ones start out ready for their next edge.
+	DebounceIntegrate = SettingsDebounce->DebounceIntegrate;
+	#if (BUTTON_COUNT > 16)
+	if (DebounceIntegrate & 0x8000) DebounceIntegrate |= ~(Buttons_t)0xFFFF;
+	#endif
+	DebounceActive = 0;
+	for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+		DebounceTime[i]  = SettingsDebounce->DebounceTime[(i < 16) ? i : 15];
+		DebounceCount[i] = ((DebounceIntegrate & ButtonDebounced) & ((Buttons_t)1 << i)) ? DebounceTime[i] : 0;
+	}
 
 	// Since setup is done, we can re-enable interrupts.
 	sei();
 }
 
+// Function for debouncing a sample, against the state we last reported. This is called from the timer interrupt.
+// Only buttons whose pin differs from their state, or whose counter is still running, are looked at; everything else is
+// settled, so most ticks this is a single test.
+static Buttons_t Button_Debounce(Buttons_t raw) {
+  Buttons_t state = ButtonDebounced;
+  Buttons_t work  = (raw ^ state) | DebounceActive;
+  Buttons_t bit   = 1;
+
+  if (!work) return state;
+
+  for (uint8_t i = 0; i < BUTTON_COUNT; i++, bit <<= 1) {
+    if (!(work & bit)) continue;
+
+    uint8_t count = DebounceCount[i];
+    if (DebounceIntegrate & bit) {
+      // Integrating: count up while the pin reads pressed, and down while it reads released. The button changes only
+      // when the count reaches either end, so a bounce just costs a little of the way back.
+      if (raw & bit) {
+        if (count < DebounceTime[i]) count++;
+        if (count >= DebounceTime[i]) state |=  bit;
+      } else {
+        if (count) count--;
+        if (!count) state &= ~bit;
+      }
+      // At rest, the count sits at whichever end the button is at.
+      if (count == ((state & bit) ? DebounceTime[i] : 0)) DebounceActive &= ~bit;
+      else                                                DebounceActive |=  bit;
+    } else {
+      // Eager: the first edge goes out at once, and the pin is ignored until the hold-off runs out.
+      if (count) count--;
+      else if ((raw ^ state) & bit) {
+        state ^= bit;
+        count  = DebounceTime[i];
+      }
+      if (count) DebounceActive |=  bit;
+      else       DebounceActive &= ~bit;
+    }
+    DebounceCount[i] = count;
+  }
+
+  return state;
+}
+
+// Function for sampling button data. This is called from the timer interrupt.
+void Button_Sample(void) {
+  Buttons_t state = Button_Debounce(Button_Read());
+  ButtonDebounced = state;
+
+  // Buttons being used to switch profiles are ours, not the host's, so they're held back from every reader.
+  state &= ~Profile_Sample(state);
+
+  // We only buffer changes. If the buffer is full, we drop the change, but ButtonLast still keeps us current.
+  if (state != ButtonLast) {
+    uint8_t head = (ButtonHead + 1) & (BUTTON_BUFFER_SIZE - 1);
+    if (head != ButtonTail) {
+      ButtonBuffer[ButtonHead] = state;
+      ButtonHead = head;
+    }
+    ButtonLast = state;
+  }
+}
+
+// Function for retrieving the most recent sample, with nothing held over. This is safe to call from the timer interrupt.
+Buttons_t Button_GetLast(void) {
+  return ButtonLast;
+}
+
 // Function for retrieving button data.
-uint16_t Button_GetState(void) {
-  // The reference implementation reads from the 12 configured pins.
-  // Each pin should have a 10k resistor between the button and the pin.
+// This is the current state, plus any button that was pressed at some point since this reader last asked.
+Buttons_t Button_GetState(BUTTON_READER reader) {
+  Buttons_t buf;
+  Buttons_t pressed = 0;
+
+  // This keeps whatever interrupt state it found, so it's just as safe from inside an interrupt.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    buf = ButtonLast;
+    while (ButtonTail != ButtonHead) {
+      pressed   |= ButtonBuffer[ButtonTail];
+      ButtonTail = (ButtonTail + 1) & (BUTTON_BUFFER_SIZE - 1);
+    }
+  }
+
+  // Anything we pulled out of the buffer is kept for every reader, until they've seen it.
+  if (pressed) {
+    for (uint8_t i = 0; i < BUTTON_READERS; i++)
+      ButtonPressed[i] |= pressed;
+  }
+
+  buf |= ButtonPressed[reader];
+  ButtonPressed[reader] = 0;
 
-	// We need some temporary variables to calculate our buttons out.
-	uint16_t buf   = 0;
-	uint8_t  buf07 = 0;
-	uint8_t  buf8F = 0;
+  return buf;
+}
+
+#if defined(SHIFT_REGISTER_BUTTONS)
+// Function for reading button data from the shift registers. This is called from the timer interrupt, so every
+// sample is taken on a tick, however long the last one took.
+Buttons_t Button_Read(void) {
+  Buttons_t buf = 0;
 
-  // Capture the existing state of things first, to handle multiplexed lighting.
-  uint8_t port07 = B07_PORT;
-  uint8_t port8F = B8F_PORT;
+  // Latch every input at once. The pulse only needs to be a few tens of nanoseconds.
+  SR_LOAD_PORT &= (uint8_t)~SR_LOAD;
+  asm volatile("nop\nnop\n");
+  SR_LOAD_PORT |=  SR_LOAD;
 
-  // We'll make sure all of our pins are input w/ pullups.
-	B07_DDR  &= ~0xFF;
-	B8F_DDR  &= ~0xF0;
-	B07_PORT |=  0xFF;
-	B8F_PORT |=  0xF0;
+  // The first shift register comes out first, input H first. Pressed buttons read low.
+  for (uint8_t i = 0; i < SR_COUNT; i++)
+    buf |= (Buttons_t)(uint8_t)~SerialSPI_ReceiveByte() << (i * 8);
+
+  #if (BUTTON_COUNT < BUTTON_BITS)
+  return (buf & (((Buttons_t)1 << BUTTON_COUNT) - 1));
+  #else
+  return buf;
+  #endif
+}
+#else
+// Function for reading button data directly from the pins.
+Buttons_t Button_Read(void) {
+  // The reference implementation reads from the 12 configured pins.
+  // Each pin should have a 10k resistor between the button and the pin.
+  Buttons_t buf = 0;
+
+  // Our pins may have been left as outputs by the lighting, so we'll make sure they're all input w/ pullups.
+  BOARD_BUTTON_PINS(BUTTON_GROUP_INPUT)
 
   // Wait for things to settle before reading.
   asm volatile("nop\nnop\nnop\nnop\n");
-	buf07 	  = ~B07_PIN;
-	buf8F     = ~B8F_PIN;
-
-  // Switch back to output for the lighting.
-	// B07_PORT  =  port07;
-	// B8F_PORT  =  port8F;
-	// B07_DDR  |=  0xFF;
-	// B8F_DDR  |=  0xF0;
-
-  // Our read is copied to a return buffer.
-  // Since we skip PB0-PB3, we need to shift this data around.
-	buf |=   buf07;
-	buf |= ((buf8F & 0xF0) << 4);
-  // Finally, we return the buffer.
-	return (buf & 0x0FFF);
+
+  // Each group lands on its own buttons. The board's masks and shifts are constants, so this is a few instructions
+  // a group, with nothing left to mask off.
+  BOARD_BUTTON_PINS(BUTTON_GROUP_READ)
+
+  return buf;
 }
+#endif
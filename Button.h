@@ -1,7 +1,39 @@
 #ifndef _BUTTON_H_
 #define _BUTTON_H_
 
-void     Button_Init(void);
-uint16_t Button_GetState(void);
+#include <stdint.h>
+#include "Config/AppConfig.h"
 
-#endif
\ No newline at end of file
+// How many buttons we read. The pins give us 12; shift registers give us as many as were configured.
+#if defined(SHIFT_REGISTER_BUTTONS)
+	#if (SHIFT_REGISTER_BUTTONS < 1) || (SHIFT_REGISTER_BUTTONS > 32)
+		#error SHIFT_REGISTER_BUTTONS must be between 1 and 32.
+	#endif
+	#define BUTTON_COUNT SHIFT_REGISTER_BUTTONS
+#else
+	#define BUTTON_COUNT 12
+#endif
+
+/** Our button state, one bit per button. This is as wide as it needs to be, and goes out in reports as-is. */
+#if (BUTTON_COUNT > 16)
+	typedef uint32_t Buttons_t;
+	#define BUTTON_BITS 32
+#else
+	typedef uint16_t Buttons_t;
+	#define BUTTON_BITS 16
+#endif
+
+/** Readers of our button state. Each reader sees every press, no matter how often the others read. */
+typedef enum {
+	ReaderJoystick = 0,
+	ReaderKeyboard = 1,
+	ReaderPS2      = 2,
+	BUTTON_READERS
+} BUTTON_READER;
+
+void      Button_Init(void);
+Buttons_t Button_GetState(BUTTON_READER reader);
+void      Button_Sample(void);
+Buttons_t Button_GetLast(void);
+
+#endif
@@ -1,9 +1,9 @@
-#include <avr/eeprom.h>
-#include <avr/interrupt.h>
-#include <avr/io.h>
+#include "HAL.h"
 #include <string.h>
+#include <stddef.h>
 #include "Config.h"
 #include "PS2.h"
+#include "Board.h"
 
 // Our configuration variable. These will be fail-safe defaults.
 Settings_t Settings = {
@@ -35,8 +35,6 @@ Settings_t Settings = {
         0x00, 
         // Name to report back via USB. Default returns the type of board.
         N_Default   , 
-        // 24-character custom name, wide string.
-        "USBemani v2 (Change me!)",
     },
     {
         /** Button settings. **/
@@ -45,6 +43,27 @@ Settings_t Settings = {
         // 12-button custom mapping. In use when B_Custom is used.
         {NC,NC,NC,NC,NC,NC,NC,NC,NC,NC,NC,NC,},
     },
+    {
+        /** Keyboard settings. **/
+        // Key usages for each button. The defaults are the usual simulator layout: Z S X D C F V for the keys, then Enter and Escape.
+        {0x1D,0x16,0x1B,0x07,0x06,0x09,0x19,0x28,0x29,0x00,0x00,0x00,0x00,0x00,0x00,0x00,},
+        // Key usages for each encoder direction. The first encoder is the turntable, on Left Shift and Left Control.
+        {0xE1,0xE0,0x00,0x00,},
+    },
+    {
+        /** Debounce settings. **/
+        // Buttons that integrate. None: eager debouncing adds no latency.
+        0x0000,
+        // Hold-off for each button, in timer ticks. 16 ticks is about 4ms, longer than most microswitches bounce.
+        {16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,},
+    },
+    {
+        /** Bank settings. **/
+        // The profile we're running. Every profile starts out as these settings.
+        0,
+        // Buttons to hold to switch profiles. None: games use most combos themselves, so this is left to the player.
+        0x0000,
+    },
 };
 
 
@@ -53,21 +72,79 @@ Settings_t Settings = {
 // Before we go any further, we need to have a good idea on where stuff will be going in EEPROM.
 // 0x00-07 will be used to verify if the EEPROM has been initialized. That dataspace will store a brief string, containing the word "USB" and a 4-character 'version' code. Remember that the nul-terminator is a character.
 #define    EEPROM_HEADER_ADDR   (uint8_t*)0x00
-const char EEPROM_HEADER[8] = "USBM573";
+const char EEPROM_HEADER[8] = "USBM577";
 // 0x08 and beyond currently store the Settings struct as a byte-for-byte copy.
 #define    EEPROM_SETTINGS_ADDR (uint8_t*)0x08
+// 0x100-0x19F store the profile bank, one Settings_Profile_t after another.
+#define    EEPROM_PROFILE_ADDR  (uint8_t*)0x100
+// 0x1C0-0x1F1 store the custom name as a USB string descriptor: a size byte, a type byte, and up to 24 UTF-16 characters.
+// This is handed to the USB library as-is, so the name never needs a copy in RAM.
+#define    EEPROM_NAME_ADDR     (uint8_t*)0x1C0
+// The string descriptor type, as the USB library knows it.
+#define    EEPROM_NAME_TYPE     0x03
+// The name we start out with.
+const char DEFAULT_NAME[] PROGMEM = "USBemani v2 (Change me!)";
+
+// The USB interrupt reads the name out of EEPROM whenever the host asks for it, and it could come in between us setting
+// an address and using it. Everything we read or write once it's running goes through these, a byte at a time, so it's
+// held off only for the access itself. Waiting out the last write is done with it free to run.
+static uint8_t ReadByteEEPROM(const uint8_t* address) {
+    uint8_t value;
+
+    eeprom_busy_wait();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) value = eeprom_read_byte(address);
+
+    return value;
+}
+
+static void UpdateByteEEPROM(uint8_t* address, uint8_t value) {
+    eeprom_busy_wait();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) eeprom_update_byte(address, value);
+}
+
+static void UpdateBlockEEPROM(const void* source, uint8_t* address, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++)
+        UpdateByteEEPROM(address + i, ((const uint8_t*)source)[i]);
+}
+
+// Copies the parts of our settings that make up a profile, out of and back into the working copy.
+static void GetWorkingProfile(Settings_Profile_t* profile) {
+    profile->Rotary         = Settings.Rotary;
+    profile->LightsInvertTT = Settings.Lights.LightsInvertTT;
+    profile->LightsComm     = Settings.Lights.LightsComm;
+    profile->Button         = Settings.Button;
+    profile->Keyboard       = Settings.Keyboard;
+}
+
+static void SetWorkingProfile(const Settings_Profile_t* profile) {
+    Settings.Rotary                = profile->Rotary;
+    Settings.Lights.LightsInvertTT = profile->LightsInvertTT;
+    Settings.Lights.LightsComm     = profile->LightsComm;
+    Settings.Button                = profile->Button;
+    Settings.Keyboard              = profile->Keyboard;
+
+    // Lighting methods other than direct-drive are only available if the device is in USB-only mode.
+    if (Settings.Device.DeviceComm == C_Default) Settings.Lights.LightsComm = L_Direct;
+}
+
+static void ReadProfileEEPROM(uint8_t index, Settings_Profile_t* profile) {
+    uint8_t* address = EEPROM_PROFILE_ADDR + (index * sizeof(Settings_Profile_t));
+
+    for (uint8_t i = 0; i < sizeof(Settings_Profile_t); i++)
+        ((uint8_t*)profile)[i] = ReadByteEEPROM(address + i);
+}
 
 // This command will load the Settings struct from EEPROM.
 // It will return 0 if everything went according to plan, and a value if any issues occured.
+// This only runs at startup, before our interrupts are on.
 uint8_t LoadInEEPROM() {
-    cli();
     // Before any data is loaded, we run a check against the header stored in EEPROM and the header stored in memory.
     // For debug purposes and to run a thorough scan, we'll use 8 bits, one bit for each character, to flag which bits, if any, are different.
     uint8_t dirty_eeprom = 0;
 
     for (int i = 0; i < 8; i++) {
         // If the byte is different, flag our bit.
-        if ((eeprom_read_byte((uint8_t*)i)) != EEPROM_HEADER[i])
+        if ((eeprom_read_byte(EEPROM_HEADER_ADDR + i)) != EEPROM_HEADER[i])
             dirty_eeprom += (1 << i);
     }
 
@@ -81,45 +158,60 @@ uint8_t LoadInEEPROM() {
             EEPROM_SETTINGS_ADDR,
             sizeof(Settings_t)
         );
+
+        // The bank holds our profile as it was last saved, which may not be the one the settings were saved with.
+        Settings_Profile_t profile;
+        if (Settings.Bank.BankProfile >= CONFIG_PROFILE_COUNT) Settings.Bank.BankProfile = 0;
+        ReadProfileEEPROM(Settings.Bank.BankProfile, &profile);
+        SetWorkingProfile(&profile);
         return 0;
     }
-    sei();
 }
 
 // This command will write all data in the Settings struct to EEPROM.
+// Each byte that changes takes a few milliseconds to write, and our interrupts keep running the whole time.
 void Config_SaveEEPROM() {
-    cli();
     // The update process will consist of two parts: The header, and the struct.
-    // Both are simple commands in the EEPROM library.
     // The first block is the EEPROM block.
-    eeprom_update_block(
+    UpdateBlockEEPROM(
         EEPROM_HEADER,
         EEPROM_HEADER_ADDR,
         sizeof(EEPROM_HEADER)
     );
     // After that, the settings.
-    eeprom_update_block(
+    UpdateBlockEEPROM(
         &Settings,
         EEPROM_SETTINGS_ADDR,
         sizeof(Settings_t)
     );
-    sei();
+    // And last, our profile, into its place in the bank.
+    Config_StoreProfile(Settings.Bank.BankProfile);
 }
 
 
 
 void Config_Init() {
+    #if defined(BOARD_IDENT_MASK)
     // Enable both identifier pins as input with pullups.
-    PORTC |=  0xC0;  
-    DDRC  &= ~0xC0;
+    BOARD_IDENT_PORT |=  BOARD_IDENT_MASK;
+    BOARD_IDENT_DDR  &= (uint8_t)~BOARD_IDENT_MASK;
     // A single no-op to deal with some AVR stupidity.
     asm("nop\n");
+    #endif
 
     // We need to read in our board settings as well from EEPROM.
     // LoadInEEPROM() will return a value and abort if any issues occur with loading. Otherwise, settings will be loaded fine.
     if (LoadInEEPROM()) {
         // If any issues occur, we'll just ignore everything stored in and write new settings.
         Config_SaveEEPROM();
+
+        // The name is stored separately, so we reset it too. This includes the nul-terminator.
+        for (uint8_t i = 0; i <= CONFIG_NAME_LENGTH; i++)
+            Config_UpdateName(i, pgm_read_byte(&DEFAULT_NAME[i]));
+
+        // As is the bank. Every profile starts out the same.
+        for (uint8_t i = 0; i < CONFIG_PROFILE_COUNT; i++)
+            Config_StoreProfile(i);
     }
 
     Config_Identify();
@@ -135,16 +227,104 @@ void Config_AddressButton(Settings_Button_t** ptr) { *ptr = &Settings.Button; }
 void Config_AddressRotary(Settings_Rotary_t** ptr) { *ptr = &Settings.Rotary; }
 void Config_AddressLights(Settings_Lights_t** ptr) { *ptr = &Settings.Lights; }
 void Config_AddressDevice(Settings_Device_t** ptr) { *ptr = &Settings.Device; }
+void Config_AddressKeyboard(Settings_Keyboard_t** ptr) { *ptr = &Settings.Keyboard; }
+void Config_AddressDebounce(Settings_Debounce_t** ptr) { *ptr = &Settings.Debounce; }
+void Config_AddressBank(Settings_Bank_t** ptr) { *ptr = &Settings.Bank; }
+void Config_AddressName  (const uint8_t**    ptr) { *ptr = EEPROM_NAME_ADDR;  }
 
 void Config_Identify() {
-    // For the release of this code, always assume this is a USBemani v2 Home board.
-    Settings.Device.DeviceType = HOME;
+    // Our board is whatever we were built for; see Board.h.
+    Settings.Device.DeviceType = BOARD_TYPE;
+
+    #if !defined(BOARD_PS2_ACK_MASK)
+    // Boards without a PS2 connection are always USB-only, whatever the host asks for.
+    Settings.Device.DeviceComm = C_USBOnly;
+    #endif
 }
 
 void Config_UpdateSettings(uint8_t conf_command, uint8_t conf_data) {
+    // The active profile only changes by switching, so the working copy always matches it.
+    if ((conf_command - 0x40) == offsetof(Settings_t, Bank.BankProfile)) return;
+
     if ((conf_command - 0x40) < (uint8_t)sizeof(Settings_t)) {
         uint8_t *ptr = (uint8_t*)&Settings;
          ptr += (conf_command - 0x40);
         *ptr  =  conf_data;
     }
-}
\ No newline at end of file
+}
+
+// Copies out the whole Settings struct, so the host can read back what the board is running with.
+void Config_GetSettings(Settings_t* settings) {
+    memcpy(settings, &Settings, sizeof(Settings_t));
+}
+
+// Copies out a profile from the bank. The active one comes from the working copy, so it includes any changes the host
+// has applied but not saved yet.
+void Config_GetProfile(uint8_t index, Settings_Profile_t* profile) {
+    if (index == Settings.Bank.BankProfile) GetWorkingProfile(profile);
+    else                                    ReadProfileEEPROM(index, profile);
+}
+
+// Writes the working copy into the bank as the given profile, to save it, or to copy it to another.
+void Config_StoreProfile(uint8_t index) {
+    if (index >= CONFIG_PROFILE_COUNT) return;
+
+    Settings_Profile_t profile;
+    GetWorkingProfile(&profile);
+    UpdateBlockEEPROM(&profile, EEPROM_PROFILE_ADDR + (index * sizeof(Settings_Profile_t)), sizeof(Settings_Profile_t));
+}
+
+// Makes another profile the active one: its settings become the working copy, and it's what we start with next time.
+// Anything applied but not saved is dropped. This only keeps the settings in step; see Profile.c for the switch itself.
+void Config_SelectProfile(uint8_t index) {
+    if ((index >= CONFIG_PROFILE_COUNT) || (index == Settings.Bank.BankProfile)) return;
+
+    Settings_Profile_t profile;
+    ReadProfileEEPROM(index, &profile);
+    SetWorkingProfile(&profile);
+
+    Settings.Bank.BankProfile = index;
+    UpdateByteEEPROM(EEPROM_SETTINGS_ADDR + offsetof(Settings_t, Bank.BankProfile), index);
+}
+
+// The length of the custom name in characters, from its string descriptor's header. Anything that isn't a string
+// descriptor of a size we could have written counts as no name at all.
+uint8_t Config_GetNameLength(void) {
+    uint8_t size = ReadByteEEPROM(EEPROM_NAME_ADDR);
+
+    if ((ReadByteEEPROM(EEPROM_NAME_ADDR + 1) != EEPROM_NAME_TYPE) ||
+        (size < 2) || (size > (2 + (CONFIG_NAME_LENGTH * 2))))
+        return 0;
+
+    return (size - 2) / 2;
+}
+
+// Copies out the custom name as plain characters, padded out with nuls to CONFIG_NAME_LENGTH.
+void Config_GetName(char* name) {
+    uint8_t length = Config_GetNameLength();
+
+    for (uint8_t i = 0; i < CONFIG_NAME_LENGTH; i++)
+        name[i] = (i < length) ? ReadByteEEPROM(EEPROM_NAME_ADDR + 2 + (i * 2)) : 0;
+}
+
+// Writes a single character of the custom name, straight into the string descriptor in EEPROM.
+// Index 0-23 are characters; a nul (or index 24) ends the name there. The descriptor size tracks the longest name written since the last nul.
+void Config_UpdateName(uint8_t index, char c) {
+    if (index > CONFIG_NAME_LENGTH)
+        return;
+
+    uint8_t size = ReadByteEEPROM(EEPROM_NAME_ADDR);
+
+    if ((index < CONFIG_NAME_LENGTH) && c) {
+        // Characters are stored as UTF-16, little-endian.
+        UpdateByteEEPROM(EEPROM_NAME_ADDR + 2 + (index * 2),     c);
+        UpdateByteEEPROM(EEPROM_NAME_ADDR + 2 + (index * 2) + 1, 0);
+
+        if ((size > (2 + (CONFIG_NAME_LENGTH * 2))) || (size < (2 + ((index + 1) * 2))))
+            size = 2 + ((index + 1) * 2);
+    }
+    else size = 2 + (index * 2);
+
+    UpdateByteEEPROM(EEPROM_NAME_ADDR,     size);
+    UpdateByteEEPROM(EEPROM_NAME_ADDR + 1, EEPROM_NAME_TYPE);
+}
@@ -3,6 +3,11 @@
 
 #include <stdlib.h>
 
+/** Maximum length of the custom name, not counting the nul-terminator. */
+#define CONFIG_NAME_LENGTH 24
+/** How many profiles the bank holds. */
+#define CONFIG_PROFILE_COUNT 4
+
 /* Enumerations for device configuration. */
 /** Controller type. Used in PS2 mode to determine how to transform our raw input. Stored in EEPROM and loaded at startup. */
 typedef enum {
@@ -72,26 +77,58 @@ typedef struct {
     LIGHTS_COMM       LightsComm;
     volatile uint16_t LightsAssert;
 } Settings_Lights_t;
-/** Device structure. Holds the board type, the communication method, the PS2 assertioon timer, the name to report back, and a 24-character custom name. */
+/** Device structure. Holds the board type, the communication method, the PS2 assertioon timer, and the name to report back.
+ *  The 24-character custom name is not held here; it lives in EEPROM as a ready-made string descriptor. See Config_UpdateName(). */
 typedef struct {
     DEVICE_TYPE       DeviceType;
     DEVICE_COMM       DeviceComm;
     volatile uint16_t PS2Assert;
     DEVICE_NAME       DeviceName;
-    char              CustomName[25];
 } Settings_Device_t;
 /** Button structure. Holds the current mapping and the custom mapping. */
 typedef struct {
     BUTTON_TRANSFORM  ButtonMap;          
     uint8_t           CustomMap[12];    
 } Settings_Button_t;
+/** Keyboard structure. Holds the key usage to report for each button, and for each direction of each encoder. 0x00 leaves it unmapped. */
+typedef struct {
+    uint8_t           KeyMap[16];
+    uint8_t           RotaryMap[4];
+} Settings_Keyboard_t;
+/** Debounce structure. Holds the hold-off time for each button, in timer ticks, and which buttons integrate instead.
+ *  An eager button reports its first edge at once, then ignores the pin for its time. An integrating button reports a
+ *  change once the pin has held it for its time, net of bounces. A time of 0 reports the pin as-is. Buttons past the
+ *  16th share the 16th's settings. */
+typedef struct {
+    uint16_t          DebounceIntegrate;
+    uint8_t           DebounceTime[16];
+} Settings_Debounce_t;
+/** Bank structure. Holds which profile in the bank we're running, and the buttons to hold to switch profiles. With those
+ *  held, pressing one of the first CONFIG_PROFILE_COUNT other buttons switches to that profile. A combo of 0 leaves
+ *  switching to the host. The active profile is only changed by switching, never written directly. */
+typedef struct {
+    uint8_t           BankProfile;
+    uint16_t          BankCombo;
+} Settings_Bank_t;
 /** Structure structure. Holds all of the structures in a compact, easy-to-write-to-EEPROM formfactor. */
 typedef struct {
-    Settings_Rotary_t Rotary;
-    Settings_Lights_t Lights;
-    Settings_Device_t Device;
-    Settings_Button_t Button;
+    Settings_Rotary_t   Rotary;
+    Settings_Lights_t   Lights;
+    Settings_Device_t   Device;
+    Settings_Button_t   Button;
+    Settings_Keyboard_t Keyboard;
+    Settings_Debounce_t Debounce;
+    Settings_Bank_t     Bank;
 } Settings_t;
+/** Profile structure. Holds everything that changes with the profile: the encoders, the lighting mode, and the mappings.
+ *  The bank keeps one of these for each profile in EEPROM; the settings above hold a working copy of the active one. */
+typedef struct {
+    Settings_Rotary_t   Rotary;
+    LIGHTS_TRANSFORM    LightsInvertTT;
+    LIGHTS_COMM         LightsComm;
+    Settings_Button_t   Button;
+    Settings_Keyboard_t Keyboard;
+} Settings_Profile_t;
 
 // Access functions. Each of these will take in a pointer and point it to the right part of the Settings struct.
 void Config_Init(void);
@@ -101,11 +138,22 @@ void Config_AddressButton(Settings_Button_t** ptr);
 void Config_AddressRotary(Settings_Rotary_t** ptr);
 void Config_AddressLights(Settings_Lights_t** ptr);
 void Config_AddressDevice(Settings_Device_t** ptr);
+void Config_AddressKeyboard(Settings_Keyboard_t** ptr);
+void Config_AddressDebounce(Settings_Debounce_t** ptr);
+void Config_AddressBank(Settings_Bank_t** ptr);
+void Config_AddressName  (const uint8_t**    ptr);
 
 uint8_t LoadInEEPROM(void);
 void    UpdateEEPROM(void);
 
+void Config_GetSettings(Settings_t* settings);
+void Config_GetProfile(uint8_t index, Settings_Profile_t* profile);
+void Config_StoreProfile(uint8_t index);
+void Config_SelectProfile(uint8_t index);
+uint8_t Config_GetNameLength(void);
+void Config_GetName(char* name);
 void Config_UpdateSettings(uint8_t conf_command, uint8_t conf_data);
+void Config_UpdateName(uint8_t index, char c);
 void Config_SaveEEPROM(void);
 
 #endif
\ No newline at end of file
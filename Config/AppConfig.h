@@ -45,4 +45,55 @@
 
 	#define GENERIC_REPORT_SIZE       8
 
+	/** Size of the bootloader section in bytes, as set by the BOOTSZ fuses. The bootloader command jumps
+	 *  straight to its start, so this has to match the fuses the board was programmed with.
+	 */
+	#define BOOTLOADER_SIZE           4096
+
+	/** The board we're built for, which sets every pin we use; see Board.h. PROFILE_HOME and PROFILE_ARCADE are the
+	 *  USBemani v2 boards, and the default is PROFILE_HOME. PROFILE_PROMICRO is for Pro Micro-class 32u4 boards, which
+	 *  have no PS2 connection, and has to be built with "make MCU=atmega32u4".
+	 */
+//	#define BOARD_PROFILE             PROFILE_PROMICRO
+
+	/** Adds a second HID interface to the device, reporting our buttons and encoders as an NKRO keyboard.
+	 *  The key for each input is held in the keyboard settings.
+	 */
+//	#define KEYBOARD_INTERFACE
+
+	/** Adds a HID interface to the device, reporting our encoders as a relative mouse. Every step since the
+	 *  last poll is reported, so no motion is lost however fast the encoder spins.
+	 */
+//	#define MOUSE_INTERFACE
+
+	/** Extends the joystick report to a full 64 bytes. After the joystick itself, each report carries every change
+	 *  in our buttons and encoders since the last one, each stamped with the timer tick it was seen on.
+	 */
+//	#define EXTENDED_REPORT
+
+	/** Times the main loop tasks and the interrupts with timer 1, keeping the count, minimum, maximum and average
+	 *  for each. These are read back with a feature report on the generic interface, and cleared by sending one.
+	 */
+//	#define INSTRUMENTATION
+
+	/** Lets the host measure latency. An output report with command 0xE0 carries a tag, which comes back in the
+	 *  next input report along with the USB frame number and the tick its inputs were sampled on.
+	 */
+//	#define LATENCY_PROBE
+
+	/** Reads this many buttons, up to 32, from chained 74HC165 shift registers on the USART in SPI mode, in place of
+	 *  the 12 button pins. They're read on every timer tick, as the pins would be. More than 16 buttons widens the
+	 *  button field in every report to 32 bits. The USART and load pin take PD2-PD5 from the lights; see Button.c.
+	 */
+//	#define SHIFT_REGISTER_BUTTONS    32
+
+	/** Reads analog inputs, such as faders and pedals, from these ADC channels, up to 4. They go out as the Z, Rx, Ry
+	 *  and Rz axes of the joystick, in 12 bits. The ADC runs freely from its interrupt, oversampling each channel and
+	 *  smoothing the result, so a report never waits on a conversion. Each channel takes its pin from the button and
+	 *  light on it, which are then gone: on USBemani boards, ADC9 and ADC10 (PD6 and PD7) are buttons and lights 7
+	 *  and 8, or lights 7 and 8 alone with SHIFT_REGISTER_BUTTONS. Pins for the encoders, latch, LED, PS2 and shift
+	 *  registers can't be taken, which is every other channel on port F. See Board.h.
+	 */
+//	#define ANALOG_INPUTS             9, 10
+
 #endif
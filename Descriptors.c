@@ -36,21 +36,25 @@
  */
 
 #include "Descriptors.h"
+#include "USBemani.h"
 #include "Config.h"
 #include "Rotary.h"
+#include "Keyboard.h"
+#include "Mouse.h"
 
 /** HID class report descriptor. This is a special descriptor constructed with values from the
  *  USBIF HID class specification to describe the reports and capabilities of the HID device. This
  *  descriptor is parsed by the host and its contents used to determine what data (and in what encoding)
  *  the device will send, and what it may be sent back from the host. Refer to the HID specification for
  *  more details on HID report descriptors.
+ *
+ *  The descriptor is assembled by Descriptors_Build() from the flash fragments below. The parts that depend
+ *  on our settings (the dial/slider range) and the repeated LED collections are generated there, once, and
+ *  the result is cached in GenericReport for every descriptor request that follows.
  */
 
-// We need access some of our device settings. We also need access to the rotary encoder tooth count.
-Settings_Device_t* Device;
-Settings_Rotary_t* Rotary;
-
-USB_Descriptor_HIDReport_Datatype_t GenericReport[] =
+// Everything up to the dial and slider range.
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM GenericReportAxes[] =
 {
 	HID_RI_USAGE_PAGE(8, 0x01), /* Generic Desktop */
 	HID_RI_USAGE(8, 0x04), /* Joystick */
@@ -67,169 +71,183 @@ USB_Descriptor_HIDReport_Datatype_t GenericReport[] =
 	        HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
 	        // Dial and slider axes.
 	        // Per Tau, we need to be able to alter the maximum value for the dial and slider, so Bemanitools can do scaling.
-	        HID_RI_USAGE(8, 0x37), 
+	        HID_RI_USAGE(8, 0x37),
 	        HID_RI_USAGE(8, 0x36),
 	        HID_RI_LOGICAL_MINIMUM(16, 0),
-			// This value is altered in later code.
-	        HID_RI_LOGICAL_MAXIMUM(16, 255), // [32] should be the editable value. [33] is the 8 bits over 256.
+	        // The logical maximum is generated from the tooth count, and goes here.
+};
+
+// Everything after the dial and slider range, up to the first LED.
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM GenericReportButtons[] =
+{
 	        HID_RI_REPORT_COUNT(8, 0x02),
 	        HID_RI_REPORT_SIZE(8, 0x08),
-	        HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_WRAP | HID_IOF_NO_PREFERRED_STATE),	    
+	        HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_WRAP | HID_IOF_NO_PREFERRED_STATE),
 	    HID_RI_END_COLLECTION(0),
-	    // Buttons.
+	    // Buttons, as many as we read, padded out to the width of the field.
 	    HID_RI_USAGE_PAGE(8, 0x09),
 	    HID_RI_USAGE_MINIMUM(8, 1),
-	    HID_RI_USAGE_MAXIMUM(8, 11),
+	    HID_RI_USAGE_MAXIMUM(8, BUTTON_COUNT),
 	    HID_RI_LOGICAL_MINIMUM(8, 0x00),
 	    HID_RI_LOGICAL_MAXIMUM(8, 0x01),
 	    HID_RI_REPORT_SIZE(8, 1),
-	    HID_RI_REPORT_COUNT(8, 11),
+	    HID_RI_REPORT_COUNT(8, BUTTON_COUNT),
 	    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
-	   	HID_RI_REPORT_SIZE(8, 0x05),
+	    #if (BUTTON_COUNT < BUTTON_BITS)
+	    HID_RI_REPORT_SIZE(8, BUTTON_BITS - BUTTON_COUNT),
 	    HID_RI_REPORT_COUNT(8, 0x01),
 	    HID_RI_INPUT(8, HID_IOF_CONSTANT),
-		// LED Output reports.
-		// LEDs are broken up a number of ways. We have an ordinal...
-	    HID_RI_USAGE_PAGE(8, 0x0A), 
-	    // ...an instance (this is Instance 1)...
-	    HID_RI_USAGE(8, 1),
+	    #endif
+	    #if (ANALOG_COUNT > 0)
+	    // Analog inputs, as Z, Rx, Ry and Rz, for as many as we have.
+	    HID_RI_USAGE_PAGE(8, 0x01),
+	    HID_RI_USAGE_MINIMUM(8, 0x32),
+	    HID_RI_USAGE_MAXIMUM(8, 0x32 + ANALOG_COUNT - 1),
+	    HID_RI_LOGICAL_MAXIMUM(16, ANALOG_MAXIMUM),
+	    HID_RI_REPORT_SIZE(8, 16),
+	    HID_RI_REPORT_COUNT(8, ANALOG_COUNT),
+	    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+	    // The LEDs below are single bits again.
+	    HID_RI_LOGICAL_MAXIMUM(8, 0x01),
+	    #endif
+	    // LED Output reports.
+	    // Every LED is one bit. Report size and count are global items, so we only need to set them once for all of them.
+	    HID_RI_REPORT_SIZE(8, 1),
+	    HID_RI_REPORT_COUNT(8, 1),
+	    // LEDs are broken up a number of ways. We have an ordinal...
+	    HID_RI_USAGE_PAGE(8, 0x0A),
+};
+
+// A single LED. Each one is preceded by a generated usage for its instance number.
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM GenericReportLED[] =
+{
 	    // ...a logical collection...
 	    HID_RI_COLLECTION(8, 0x02),
 	    	// And an LED, a Generic Indicator.
 	    	HID_RI_USAGE_PAGE(8, 0x08),
 	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    // We have a total of 16 LEDs, so 16 instances. This will be a while...
-	    // There is most likely a much better way to handle this programatically. However, I have not, and most likely will not, have an opportunity to revisit this.
-	    HID_RI_USAGE(8, 2),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    HID_RI_USAGE(8, 3),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    HID_RI_USAGE(8, 4),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    HID_RI_USAGE(8, 5),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    HID_RI_USAGE(8, 6),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    HID_RI_USAGE(8, 7),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    HID_RI_USAGE(8, 8),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-	    HID_RI_USAGE(8, 9),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-		HID_RI_USAGE(8, 10),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-		HID_RI_USAGE(8, 11),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-		HID_RI_USAGE(8, 12),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-		HID_RI_USAGE(8, 13),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-		HID_RI_USAGE(8, 14),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-		HID_RI_USAGE(8, 15),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
-	    HID_RI_END_COLLECTION(0),
-		HID_RI_USAGE(8, 16),
-	    HID_RI_COLLECTION(8, 0x02),
-	    	HID_RI_USAGE_PAGE(8, 0x08),
-	    	HID_RI_USAGE(8, 0x4B),
-	    	HID_RI_REPORT_SIZE(8, 1),
-	    	HID_RI_REPORT_COUNT(8, 1),
-	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),	
+	    	HID_RI_OUTPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE),
 	    HID_RI_END_COLLECTION(0),
+};
+
+// Everything after the last LED.
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM GenericReportCommand[] =
+{
 	    // An empty 16 bits. We hold our configuration report here.
 	    HID_RI_REPORT_SIZE(8, 8),
-		HID_RI_REPORT_COUNT(8, 2),
-		HID_RI_OUTPUT(8, HID_IOF_CONSTANT),
+	    HID_RI_REPORT_COUNT(8, 2),
+	    HID_RI_OUTPUT(8, HID_IOF_CONSTANT),
+	HID_RI_END_COLLECTION(0),
+};
+
+#if defined(EXTENDED_REPORT) || defined(LATENCY_PROBE)
+// Whatever follows the joystick in the input report (the event batch and/or the latency probe), after the last LED.
+// This is vendor-defined, so anything reading the joystick alone will skip right over it.
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM GenericReportEvents[] =
+{
+	    HID_RI_USAGE_PAGE(16, 0xFF00), /* Vendor Page 0 */
+	    HID_RI_USAGE(8, 0x01),
+	    HID_RI_LOGICAL_MINIMUM(8, 0x00),
+	    HID_RI_LOGICAL_MAXIMUM(16, 0xFF),
+	    HID_RI_REPORT_SIZE(8, 8),
+	    HID_RI_REPORT_COUNT(8, sizeof(Input_t) - sizeof(Joystick_t)),
+	    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+};
+#endif
+
+// The feature report, after the last LED: our settings and name for the host to read back, and the diagnostics with
+// INSTRUMENTATION. Nothing but our own tools ever touches this.
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM GenericReportFeature[] =
+{
+	    HID_RI_USAGE_PAGE(16, 0xFF00), /* Vendor Page 0 */
+	    HID_RI_USAGE(8, 0x02),
+	    HID_RI_LOGICAL_MINIMUM(8, 0x00),
+	    HID_RI_LOGICAL_MAXIMUM(16, 0xFF),
+	    HID_RI_REPORT_SIZE(8, 8),
+	    HID_RI_REPORT_COUNT(8, sizeof(Feature_t)),
+	    HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+};
+
+#if defined(EXTENDED_REPORT) || defined(LATENCY_PROBE)
+	#define GENERIC_REPORT_EVENTS sizeof(GenericReportEvents)
+#else
+	#define GENERIC_REPORT_EVENTS 0
+#endif
+
+/** Size of the assembled report descriptor. The dial/slider range is a 16-bit item (3 bytes), and each LED is an
+ *  8-bit usage (2 bytes) in front of the LED fragment.
+ */
+#define GENERIC_REPORT_LENGTH (sizeof(GenericReportAxes) + 3 + sizeof(GenericReportButtons) + \
+                               (GENERIC_LED_COUNT * (2 + sizeof(GenericReportLED))) + GENERIC_REPORT_EVENTS + \
+                               sizeof(GenericReportFeature) + sizeof(GenericReportCommand))
+
+// The assembled report descriptor. This is filled in by Descriptors_Build().
+USB_Descriptor_HIDReport_Datatype_t GenericReport[GENERIC_REPORT_LENGTH];
+
+#if defined(KEYBOARD_INTERFACE)
+/** Keyboard report descriptor. Unlike the generic report, nothing in here depends on our settings, so this is
+ *  served straight from flash. The keys are a bitmap rather than an array, so any number of them can be held
+ *  at once (NKRO); this means the keyboard has no boot protocol support.
+ */
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM KeyboardReport[] =
+{
+	HID_RI_USAGE_PAGE(8, 0x01), /* Generic Desktop */
+	HID_RI_USAGE(8, 0x06), /* Keyboard */
+	HID_RI_COLLECTION(8, 0x01), /* Application */
+	    // Modifiers, one bit each.
+	    HID_RI_USAGE_PAGE(8, 0x07), /* Key Codes */
+	    HID_RI_USAGE_MINIMUM(8, 0xE0),
+	    HID_RI_USAGE_MAXIMUM(8, 0xE7),
+	    HID_RI_LOGICAL_MINIMUM(8, 0x00),
+	    HID_RI_LOGICAL_MAXIMUM(8, 0x01),
+	    HID_RI_REPORT_SIZE(8, 0x01),
+	    HID_RI_REPORT_COUNT(8, 0x08),
+	    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+	    // Keys, one bit each.
+	    HID_RI_USAGE_MINIMUM(8, 0x00),
+	    HID_RI_USAGE_MAXIMUM(8, KEYBOARD_KEY_COUNT - 1),
+	    HID_RI_REPORT_COUNT(8, KEYBOARD_KEY_COUNT),
+	    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+	HID_RI_END_COLLECTION(0),
+};
+#endif
+
+#if defined(MOUSE_INTERFACE)
+/** Mouse report descriptor. This is also fixed, and served straight from flash. The axes are 16 bits wide, so
+ *  however many steps an encoder takes between polls, they all fit in a single report.
+ */
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM MouseReport[] =
+{
+	HID_RI_USAGE_PAGE(8, 0x01), /* Generic Desktop */
+	HID_RI_USAGE(8, 0x02), /* Mouse */
+	HID_RI_COLLECTION(8, 0x01), /* Application */
+	    HID_RI_USAGE(8, 0x01), /* Pointer */
+	    HID_RI_COLLECTION(8, 0x00), /* Physical */
+	        // Buttons. These are never pressed.
+	        HID_RI_USAGE_PAGE(8, 0x09),
+	        HID_RI_USAGE_MINIMUM(8, 1),
+	        HID_RI_USAGE_MAXIMUM(8, 3),
+	        HID_RI_LOGICAL_MINIMUM(8, 0x00),
+	        HID_RI_LOGICAL_MAXIMUM(8, 0x01),
+	        HID_RI_REPORT_SIZE(8, 0x01),
+	        HID_RI_REPORT_COUNT(8, 0x03),
+	        HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+	        HID_RI_REPORT_SIZE(8, 0x05),
+	        HID_RI_REPORT_COUNT(8, 0x01),
+	        HID_RI_INPUT(8, HID_IOF_CONSTANT),
+	        // X and Y axes, relative.
+	        HID_RI_USAGE_PAGE(8, 0x01),
+	        HID_RI_USAGE(8, 0x30),
+	        HID_RI_USAGE(8, 0x31),
+	        HID_RI_LOGICAL_MINIMUM(16, -32767),
+	        HID_RI_LOGICAL_MAXIMUM(16, 32767),
+	        HID_RI_REPORT_SIZE(8, 0x10),
+	        HID_RI_REPORT_COUNT(8, 0x02),
+	        HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_RELATIVE),
+	    HID_RI_END_COLLECTION(0),
 	HID_RI_END_COLLECTION(0),
 };
+#endif
 
 /** Device descriptor structure. This descriptor, located in FLASH memory, describes the overall
  *  device characteristics, including the supported USB version, control endpoint size and the
@@ -270,7 +288,7 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.Header                 = {.Size = sizeof(USB_Descriptor_Configuration_Header_t), .Type = DTYPE_Configuration},
 
 			.TotalConfigurationSize = sizeof(USB_Descriptor_Configuration_t),
-			.TotalInterfaces        = 1,
+			.TotalInterfaces        = INTERFACE_ID_Total,
 
 			.ConfigurationNumber    = 1,
 			.ConfigurationStrIndex  = NO_DESCRIPTOR,
@@ -304,7 +322,7 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.CountryCode            = 0x00,
 			.TotalReportDescriptors = 1,
 			.HIDReportType          = HID_DTYPE_Report,
-			.HIDReportLength        = sizeof(GenericReport)
+			.HIDReportLength        = GENERIC_REPORT_LENGTH
 		},
 
 	.HID_ReportINEndpoint =
@@ -313,7 +331,7 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 
 			.EndpointAddress        = GENERIC_IN_EPADDR,
 			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
-			.EndpointSize           = GENERIC_EPSIZE,
+			.EndpointSize           = GENERIC_IN_EPSIZE,
 			.PollingIntervalMS      = 0x01
 		},
 
@@ -325,7 +343,85 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
 			.EndpointSize           = GENERIC_EPSIZE,
 			.PollingIntervalMS      = 0x01
-		}
+		},
+
+	#if defined(KEYBOARD_INTERFACE)
+	.Keyboard_Interface =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+
+			.InterfaceNumber        = INTERFACE_ID_Keyboard,
+			.AlternateSetting       = 0x00,
+
+			.TotalEndpoints         = 1,
+
+			.Class                  = HID_CSCP_HIDClass,
+			.SubClass               = HID_CSCP_NonBootSubclass,
+			.Protocol               = HID_CSCP_NonBootProtocol,
+
+			.InterfaceStrIndex      = NO_DESCRIPTOR
+		},
+
+	.Keyboard_HID =
+		{
+			.Header                 = {.Size = sizeof(USB_HID_Descriptor_HID_t), .Type = HID_DTYPE_HID},
+
+			.HIDSpec                = VERSION_BCD(1,1,1),
+			.CountryCode            = 0x00,
+			.TotalReportDescriptors = 1,
+			.HIDReportType          = HID_DTYPE_Report,
+			.HIDReportLength        = sizeof(KeyboardReport)
+		},
+
+	.Keyboard_ReportINEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = KEYBOARD_IN_EPADDR,
+			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = KEYBOARD_EPSIZE,
+			.PollingIntervalMS      = 0x01
+		},
+	#endif
+
+	#if defined(MOUSE_INTERFACE)
+	.Mouse_Interface =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+
+			.InterfaceNumber        = INTERFACE_ID_Mouse,
+			.AlternateSetting       = 0x00,
+
+			.TotalEndpoints         = 1,
+
+			.Class                  = HID_CSCP_HIDClass,
+			.SubClass               = HID_CSCP_NonBootSubclass,
+			.Protocol               = HID_CSCP_NonBootProtocol,
+
+			.InterfaceStrIndex      = NO_DESCRIPTOR
+		},
+
+	.Mouse_HID =
+		{
+			.Header                 = {.Size = sizeof(USB_HID_Descriptor_HID_t), .Type = HID_DTYPE_HID},
+
+			.HIDSpec                = VERSION_BCD(1,1,1),
+			.CountryCode            = 0x00,
+			.TotalReportDescriptors = 1,
+			.HIDReportType          = HID_DTYPE_Report,
+			.HIDReportLength        = sizeof(MouseReport)
+		},
+
+	.Mouse_ReportINEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = MOUSE_IN_EPADDR,
+			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = MOUSE_EPSIZE,
+			.PollingIntervalMS      = 0x01
+		},
+	#endif
 };
 
 /** Language descriptor structure. This descriptor, located in FLASH memory, is returned when the host requests
@@ -347,7 +443,107 @@ const USB_Descriptor_String_t PROGMEM ManufacturerString = USB_STRING_DESCRIPTOR
 const USB_Descriptor_String_t PROGMEM ProductString  	   = USB_STRING_DESCRIPTOR(L"USBemani v2 (Home)");
 const USB_Descriptor_String_t PROGMEM ProductString1P      = USB_STRING_DESCRIPTOR(L"USBemani v2 (1P)");
 const USB_Descriptor_String_t PROGMEM ProductString2P      = USB_STRING_DESCRIPTOR(L"USBemani v2 (2P)");
-      USB_Descriptor_String_t         ProductStringCustom  = USB_STRING_DESCRIPTOR(L"Custom String Goes Here!");
+
+// The product string to report back, picked out by Descriptors_Build().
+const USB_Descriptor_String_t* ProductStringAddress;
+uint8_t                        ProductStringSize;
+#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
+uint8_t                        ProductStringMemorySpace;
+#endif
+
+/** Builds the parts of our descriptors that depend on our settings. This is called whenever our configuration is
+ *  applied, so descriptor requests only have to hand back what has already been built.
+ */
+void Descriptors_Build(void)
+{
+	Settings_Device_t* Device;
+
+	Config_AddressDevice(&Device);
+
+	USB_Descriptor_HIDReport_Datatype_t* Report = GenericReport;
+
+	memcpy_P(Report, GenericReportAxes, sizeof(GenericReportAxes));
+	Report += sizeof(GenericReportAxes);
+
+	// Injection point for altering the tooth count. The dial and slider are single bytes, so we top out at 255.
+	// We won't alter this if the rotary tooth count is 0. This is to prevent people from trying to fake the code out, or possible corruption.
+	// Profiles can be switched without enumerating again, so this has to cover the largest tooth count in the bank.
+	uint16_t DialMaximum = 0;
+	for (uint8_t i = 0; i < CONFIG_PROFILE_COUNT; i++) {
+		Settings_Profile_t Profile;
+		Config_GetProfile(i, &Profile);
+
+		uint16_t PPR = Profile.Rotary.RotaryPPR;
+		uint16_t Maximum = ((PPR && (PPR <= 256)) ? (PPR - 1) : 255);
+		if (Maximum > DialMaximum) DialMaximum = Maximum;
+	}
+	const USB_Descriptor_HIDReport_Datatype_t DialRange[] = { HID_RI_LOGICAL_MAXIMUM(16, DialMaximum) };
+	memcpy(Report, DialRange, sizeof(DialRange));
+	Report += sizeof(DialRange);
+
+	memcpy_P(Report, GenericReportButtons, sizeof(GenericReportButtons));
+	Report += sizeof(GenericReportButtons);
+
+	// We have a total of 16 LEDs, so 16 instances, each with its own usage.
+	for (uint8_t i = 1; i <= GENERIC_LED_COUNT; i++) {
+		const USB_Descriptor_HIDReport_Datatype_t Instance[] = { HID_RI_USAGE(8, i) };
+		memcpy(Report, Instance, sizeof(Instance));
+		Report += sizeof(Instance);
+
+		memcpy_P(Report, GenericReportLED, sizeof(GenericReportLED));
+		Report += sizeof(GenericReportLED);
+	}
+
+	#if defined(EXTENDED_REPORT) || defined(LATENCY_PROBE)
+	memcpy_P(Report, GenericReportEvents, sizeof(GenericReportEvents));
+	Report += sizeof(GenericReportEvents);
+	#endif
+
+	memcpy_P(Report, GenericReportFeature, sizeof(GenericReportFeature));
+	Report += sizeof(GenericReportFeature);
+
+	memcpy_P(Report, GenericReportCommand, sizeof(GenericReportCommand));
+
+	// Pick out our product string.
+	#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
+	ProductStringMemorySpace = MEMSPACE_FLASH;
+	#endif
+
+	switch (Device->DeviceName) {
+		case N_P1:
+			ProductStringAddress = &ProductString1P;
+			ProductStringSize    = pgm_read_byte(&ProductString1P.Header.Size);
+			break;
+		case N_P2:
+			ProductStringAddress = &ProductString2P;
+			ProductStringSize    = pgm_read_byte(&ProductString2P.Header.Size);
+			break;
+		case N_Custom:
+		{
+			// Custom names are kept in EEPROM as a complete string descriptor, so we can serve it from there directly.
+			// We only need to check that what's stored looks like one. Config reads its header for us, with the USB
+			// interrupt held off, since that reads the same EEPROM.
+			#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
+			const uint8_t* CustomName;
+			Config_AddressName(&CustomName);
+
+			uint8_t Length = Config_GetNameLength();
+			if (Length) {
+				ProductStringMemorySpace = MEMSPACE_EEPROM;
+				ProductStringAddress     = (const USB_Descriptor_String_t*)CustomName;
+				ProductStringSize        = sizeof(USB_Descriptor_Header_t) + (Length * sizeof(uint16_t));
+				break;
+			}
+			#endif
+
+			// Otherwise, we fall back on the default name.
+		}
+		default:
+			ProductStringAddress = &ProductString;
+			ProductStringSize    = pgm_read_byte(&ProductString.Header.Size);
+			break;
+	}
+}
 
 /** This function is called by the library when in device mode, and must be overridden (see library "USB Descriptors"
  *  documentation) by the application code so that the address and size of a requested descriptor can be given
@@ -369,13 +565,6 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 	const void* Address = NULL;
 	uint16_t    Size    = NO_DESCRIPTOR;
 
-	Config_AddressDevice(&Device);
-	Config_AddressRotary(&Rotary);
-
-	// Injection point for altering the tooth count.
-	// We won't alter this if the rotary tooth count is 0. This is to prevent people from trying to fake the code out, or possible corruption.
-	GenericReport[32] = (Rotary->RotaryPPR ? (int8_t)(Rotary->RotaryPPR - 1) : GenericReport[32]);
-
 	// All descriptors should be stored in progmem unless otherwise stated.
 	#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
 	*DescriptorMemorySpace = MEMSPACE_FLASH;
@@ -404,46 +593,61 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 					Size    = pgm_read_byte(&ManufacturerString.Header.Size);
 					break;
 				case STRING_ID_Product:
-					switch(Device->DeviceName) {
-						case N_P1:
-							Address = &ProductString1P;
-							Size    = pgm_read_byte(&ProductString1P.Header.Size);
-							break;
-						case N_P2:
-							Address = &ProductString2P;
-							Size    = pgm_read_byte(&ProductString2P.Header.Size);
-							break;
-						case N_Custom:
-							#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
-							*DescriptorMemorySpace = MEMSPACE_RAM;
-							#endif
-							// For custom names, we're iterating through 25 characters (24 plus nul-terminator).
-							for (int i = 0; i < 25; i++) {
-								ProductStringCustom.UnicodeString[i] = Device->CustomName[i];
-							}
-
-							Address = &ProductStringCustom;
-							Size    =  ProductStringCustom.Header.Size;
-							break;
-						default:
-							Address = &ProductString;
-							Size    = pgm_read_byte(&ProductString.Header.Size);
-							break;
-					}
+					#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
+					*DescriptorMemorySpace = ProductStringMemorySpace;
+					#endif
+
+					Address = ProductStringAddress;
+					Size    = ProductStringSize;
 					break;
 			}
 			break;
 		case HID_DTYPE_HID:
-			Address = &ConfigurationDescriptor.HID_GenericHID;
-			Size    = sizeof(USB_HID_Descriptor_HID_t);
+			// HID descriptors are requested per interface, so we need to know which one is being asked for.
+			switch (wIndex)
+			{
+				case INTERFACE_ID_GenericHID:
+					Address = &ConfigurationDescriptor.HID_GenericHID;
+					Size    = sizeof(USB_HID_Descriptor_HID_t);
+					break;
+				#if defined(KEYBOARD_INTERFACE)
+				case INTERFACE_ID_Keyboard:
+					Address = &ConfigurationDescriptor.Keyboard_HID;
+					Size    = sizeof(USB_HID_Descriptor_HID_t);
+					break;
+				#endif
+				#if defined(MOUSE_INTERFACE)
+				case INTERFACE_ID_Mouse:
+					Address = &ConfigurationDescriptor.Mouse_HID;
+					Size    = sizeof(USB_HID_Descriptor_HID_t);
+					break;
+				#endif
+			}
 			break;
 		case HID_DTYPE_Report:
-			#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
-			*DescriptorMemorySpace = MEMSPACE_RAM;
-			#endif
+			switch (wIndex)
+			{
+				case INTERFACE_ID_GenericHID:
+					#if defined(HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES)
+					*DescriptorMemorySpace = MEMSPACE_RAM;
+					#endif
 
-			Address = &GenericReport;
-			Size    = sizeof(GenericReport);
+					Address = &GenericReport;
+					Size    = GENERIC_REPORT_LENGTH;
+					break;
+				#if defined(KEYBOARD_INTERFACE)
+				case INTERFACE_ID_Keyboard:
+					Address = &KeyboardReport;
+					Size    = sizeof(KeyboardReport);
+					break;
+				#endif
+				#if defined(MOUSE_INTERFACE)
+				case INTERFACE_ID_Mouse:
+					Address = &MouseReport;
+					Size    = sizeof(MouseReport);
+					break;
+				#endif
+			}
 			break;
 	}
 
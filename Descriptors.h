@@ -39,9 +39,10 @@
 	/* Includes: */
 		#include <LUFA/Drivers/USB/USB.h>
 
-		#include <avr/pgmspace.h>
+		#include "HAL.h"
 
 		#include "Config/AppConfig.h"
+		#include "Events.h"
 
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
@@ -57,6 +58,20 @@
 			USB_HID_Descriptor_HID_t              HID_GenericHID;
 			USB_Descriptor_Endpoint_t             HID_ReportINEndpoint;
 			USB_Descriptor_Endpoint_t             HID_ReportOUTEndpoint;
+
+			#if defined(KEYBOARD_INTERFACE)
+			// Keyboard HID Interface
+			USB_Descriptor_Interface_t            Keyboard_Interface;
+			USB_HID_Descriptor_HID_t              Keyboard_HID;
+			USB_Descriptor_Endpoint_t             Keyboard_ReportINEndpoint;
+			#endif
+
+			#if defined(MOUSE_INTERFACE)
+			// Mouse HID Interface
+			USB_Descriptor_Interface_t            Mouse_Interface;
+			USB_HID_Descriptor_HID_t              Mouse_HID;
+			USB_Descriptor_Endpoint_t             Mouse_ReportINEndpoint;
+			#endif
 		} USB_Descriptor_Configuration_t;
 
 		/** Enum for the device interface descriptor IDs within the device. Each interface descriptor
@@ -66,6 +81,13 @@
 		enum InterfaceDescriptors_t
 		{
 			INTERFACE_ID_GenericHID = 0, /**< GenericHID interface descriptor ID */
+			#if defined(KEYBOARD_INTERFACE)
+			INTERFACE_ID_Keyboard,       /**< Keyboard interface descriptor ID */
+			#endif
+			#if defined(MOUSE_INTERFACE)
+			INTERFACE_ID_Mouse,          /**< Mouse interface descriptor ID */
+			#endif
+			INTERFACE_ID_Total           /**< Total number of interfaces, not an interface itself */
 		};
 
 		/** Enum for the device string descriptor IDs within the device. Each string descriptor should
@@ -89,12 +111,51 @@
 		/** Size in bytes of the Generic HID reporting endpoint. */
 		#define GENERIC_EPSIZE            8
 
+		/** Size in bytes of the report on the Generic HID IN endpoint, Input_t. The joystick grows with wide buttons and
+		 *  analog inputs, and the probe adds 5 bytes after it. The extended report fills a whole packet.
+		 */
+		#if defined(EXTENDED_REPORT)
+			#define GENERIC_IN_REPORTSIZE 64
+		#elif defined(LATENCY_PROBE)
+			#define GENERIC_IN_REPORTSIZE (EVENTS_JOYSTICK_SIZE + 5)
+		#else
+			#define GENERIC_IN_REPORTSIZE EVENTS_JOYSTICK_SIZE
+		#endif
+
+		/** Size in bytes of the Generic HID reporting IN endpoint: the smallest one the report fits in whole. */
+		#if (GENERIC_IN_REPORTSIZE <= 8)
+			#define GENERIC_IN_EPSIZE     8
+		#elif (GENERIC_IN_REPORTSIZE <= 16)
+			#define GENERIC_IN_EPSIZE     16
+		#elif (GENERIC_IN_REPORTSIZE <= 32)
+			#define GENERIC_IN_EPSIZE     32
+		#elif (GENERIC_IN_REPORTSIZE <= 64)
+			#define GENERIC_IN_EPSIZE     64
+		#else
+			#error The generic input report is bigger than the largest interrupt endpoint.
+		#endif
+
+		/** Endpoint address of the Keyboard HID reporting IN endpoint. */
+		#define KEYBOARD_IN_EPADDR        (ENDPOINT_DIR_IN  | 3)
+
+		/** Size in bytes of the Keyboard HID reporting endpoint. This holds the modifier byte and the key bitmap. */
+		#define KEYBOARD_EPSIZE           16
+
+		/** Endpoint address of the Mouse HID reporting IN endpoint. */
+		#define MOUSE_IN_EPADDR           (ENDPOINT_DIR_IN  | 4)
+
+		/** Size in bytes of the Mouse HID reporting endpoint. */
+		#define MOUSE_EPSIZE              8
+
+		/** Number of LED instances exposed in the Generic HID output report. */
+		#define GENERIC_LED_COUNT         16
+
 	    #if (defined(ARCH_HAS_MULTI_ADDRESS_SPACE) && \
 	         !(defined(USE_FLASH_DESCRIPTORS) || defined(USE_EEPROM_DESCRIPTORS) || defined(USE_RAM_DESCRIPTORS)))
 	      #define HAS_MULTIPLE_DESCRIPTOR_ADDRESS_SPACES
 	    #endif
 	/* Function Prototypes: */
-
+		void Descriptors_Build(void);
 
 #endif
 
@@ -0,0 +1,77 @@
+#include "HAL.h"
+#include "Button.h"
+#include "Rotary.h"
+#include "Events.h"
+
+// Our event buffer. Every time the timer interrupt sees a change in our inputs, it records it here, along with the tick it happened on.
+// Reports take events out of here, up to EVENTS_PER_REPORT at a time. This must be a power of two.
+#define EVENTS_BUFFER_SIZE 16
+
+volatile Event_t  EventBuffer[EVENTS_BUFFER_SIZE];
+volatile uint8_t  EventHead;
+         uint8_t  EventTail;
+// Number of events we had no room for since the last report.
+volatile uint8_t  EventDropped;
+// The tick of the last sample.
+volatile uint16_t EventTime;
+// The last state we recorded, so we only record changes.
+         Event_t  EventLast;
+
+// Function for initializing the event buffer.
+void Events_Init(void) {
+  cli();
+
+  EventHead    = EventTail = 0;
+  EventDropped = 0;
+
+  EventLast.Button = Button_GetLast();
+  EventLast.Dial   = Rotary_GetPosition(0);
+  EventLast.Slider = Rotary_GetPosition(1);
+
+  sei();
+}
+
+// Function for sampling events. This is called from the timer interrupt, after the buttons and encoders have been sampled.
+void Events_Sample(uint16_t time) {
+  EventTime = time;
+
+  Buttons_t button = Button_GetLast();
+  uint8_t  dial   = Rotary_GetPosition(0);
+  uint8_t  slider = Rotary_GetPosition(1);
+
+  if ((button != EventLast.Button) || (dial != EventLast.Dial) || (slider != EventLast.Slider)) {
+    EventLast.Time   = EventTime;
+    EventLast.Button = button;
+    EventLast.Dial   = dial;
+    EventLast.Slider = slider;
+
+    uint8_t head = (EventHead + 1) & (EVENTS_BUFFER_SIZE - 1);
+    if (head != EventTail) {
+      EventBuffer[EventHead] = EventLast;
+      EventHead = head;
+    }
+    else if (EventDropped != 0xFF) EventDropped++;
+  }
+}
+
+// Function for collecting events for a report. This fills in up to EVENTS_PER_REPORT events, oldest first, and returns how many there were.
+// The current tick is passed back too, so the host can tell how long ago each event happened.
+uint8_t Events_Collect(Event_t* const events, uint16_t* const time, uint8_t* const dropped) {
+  uint8_t count = 0;
+  uint8_t head;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    head         = EventHead;
+    *time        = EventTime;
+    *dropped     = EventDropped;
+    EventDropped = 0;
+  }
+
+  // The interrupt only ever writes past the head, so the events we're reading stay put.
+  while ((EventTail != head) && (count < EVENTS_PER_REPORT)) {
+    events[count++] = EventBuffer[EventTail];
+    EventTail = (EventTail + 1) & (EVENTS_BUFFER_SIZE - 1);
+  }
+
+  return count;
+}
@@ -0,0 +1,31 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#include <stdint.h>
+#include "Button.h"
+#include "Analog.h"
+
+/** Number of events that fit in a single extended report, and the bytes left over. The 64-byte report is the joystick,
+ *  4 bytes of header, the events, then 6 bytes of probe and layout. Wider buttons and analog inputs leave room for fewer.
+ */
+#define EVENTS_JOYSTICK_SIZE (4 + (BUTTON_BITS / 8) + (2 * ANALOG_COUNT))
+#define EVENTS_EVENT_SIZE    (4 + (BUTTON_BITS / 8))
+#define EVENTS_PER_REPORT    ((64 - 10 - EVENTS_JOYSTICK_SIZE) / EVENTS_EVENT_SIZE)
+#define EVENTS_RESERVED      ((64 - 10 - EVENTS_JOYSTICK_SIZE) % EVENTS_EVENT_SIZE)
+
+/** The Event struct. Each one is a snapshot of our inputs, taken the moment any of them changed. */
+typedef struct {
+	// Timer tick the change was seen on, from Rotary_GetTicks().
+	uint16_t  Time;
+	// Our buttons, as in the joystick report.
+	Buttons_t Button;
+	// Our dial and slider, as in the joystick report.
+	uint8_t   Dial;
+	uint8_t   Slider;
+} Event_t;
+
+void    Events_Init(void);
+void    Events_Sample(uint16_t time);
+uint8_t Events_Collect(Event_t* const events, uint16_t* const time, uint8_t* const dropped);
+
+#endif
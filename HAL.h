@@ -0,0 +1,23 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+
+// Our hardware abstraction. Everything that touches the chip (registers, interrupts, EEPROM, flash) comes in through here.
+// On the AVR, this is just avr-libc. Everywhere else, the same names come from Host/, which simulates them,
+// so the firmware can be built and run natively with "make host".
+#if defined(__AVR__)
+	#include <avr/io.h>
+	#include <avr/interrupt.h>
+	#include <avr/eeprom.h>
+	#include <avr/pgmspace.h>
+	#include <avr/power.h>
+	#include <avr/sleep.h>
+	#include <avr/wdt.h>
+	#include <util/atomic.h>
+
+	// Straight into the bootloader section, without a reset. Function pointers are word addresses.
+	#define Bootloader_Jump() ((void (*)(void))((FLASHEND + 1UL - BOOTLOADER_SIZE) / 2))()
+#else
+	#include "Host/Host.h"
+#endif
+
+#endif
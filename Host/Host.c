@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include "Host.h"
+#include "Analog.h"
+
+// Ports. Pull-ups are the norm on our inputs, so the pins start out high.
+volatile uint8_t PINB = 0xFF, PINC = 0xFF, PIND = 0xFF, PINE = 0xFF, PINF = 0xFF;
+volatile uint8_t DDRB, DDRC, DDRD, DDRE, DDRF;
+volatile uint8_t PORTB, PORTC, PORTD, PORTE, PORTF;
+
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0;
+volatile uint8_t  TCCR1A, TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint8_t SPCR, SPSR, SPDR;
+volatile uint8_t MCUSR;
+
+volatile uint8_t  ADCSRA;
+volatile uint16_t ADC;
+
+// Shift registers. As with the pins, nothing is pressed until the simulation says so.
+uint8_t Host_ShiftRegisters[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+uint8_t Host_ShiftPosition;
+
+// Analog inputs. These start out at mid-scale.
+uint16_t Host_ADCInputs[14] = { [0 ... 13] = 0x200 };
+uint8_t  Host_ADCChannel;
+uint8_t  Host_ADCConverting;
+
+volatile uint8_t Host_InterruptsEnabled;
+
+uint8_t Host_EEPROM[E2END + 1] = { [0 ... E2END] = 0xFF };
+
+void (*Host_ResetHandler)(void);
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+	return Host_EEPROM[(uintptr_t)address & E2END];
+}
+
+void eeprom_write_byte(uint8_t* address, uint8_t value) {
+	Host_EEPROM[(uintptr_t)address & E2END] = value;
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value) {
+	eeprom_write_byte(address, value);
+}
+
+void eeprom_read_block(void* destination, const void* source, size_t length) {
+	for (size_t i = 0; i < length; i++)
+		((uint8_t*)destination)[i] = eeprom_read_byte((const uint8_t*)source + i);
+}
+
+void eeprom_update_block(const void* source, void* destination, size_t length) {
+	for (size_t i = 0; i < length; i++)
+		eeprom_update_byte((uint8_t*)destination + i, ((const uint8_t*)source)[i]);
+}
+
+void wdt_enable(uint8_t timeout) {
+	(void)timeout;
+
+	if (Host_ResetHandler) Host_ResetHandler();
+	exit(0);
+}
+
+void Bootloader_Jump(void) {
+	if (Host_ResetHandler) Host_ResetHandler();
+	exit(0);
+}
+
+void Host_Interrupt(void (*vector)(void)) {
+	if (!Host_InterruptsEnabled) return;
+
+	Host_InterruptsEnabled = 0;
+	vector();
+	Host_InterruptsEnabled = 1;
+}
+
+void Host_Tick(void) {
+	// The timer only runs with a clock source selected.
+	if ((TIMSK0 & (1 << OCIE0A)) && (TCCR0B & ((1 << CS02) | (1 << CS01) | (1 << CS00))))
+		Host_Interrupt(TIMER0_COMPA_vect);
+}
+
+void Host_ADCConvert(void) {
+	if (!(ADCSRA & (1 << ADEN)) || !(ADCSRA & (1 << ADSC))) return;
+
+	ADC = Host_ADCInputs[Host_ADCConverting];
+
+	// The next conversion starts right away, on whatever channel is selected now.
+	Host_ADCConverting = Host_ADCChannel;
+	if (!(ADCSRA & (1 << ADATE))) ADCSRA &= ~(1 << ADSC);
+
+	// The firmware only has the interrupt when it was built with analog inputs.
+	#if (ANALOG_COUNT > 0)
+	if (ADCSRA & (1 << ADIE)) Host_Interrupt(ADC_vect);
+	#endif
+}
@@ -0,0 +1,167 @@
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Simulated hardware for the host build. Registers are plain variables: the firmware reads and writes them as usual,
+// and whatever drives the simulation sets the input pins and fires interrupts with the functions at the bottom.
+
+// Ports.
+extern volatile uint8_t PINB, PINC, PIND, PINE, PINF;
+extern volatile uint8_t DDRB, DDRC, DDRD, DDRE, DDRF;
+extern volatile uint8_t PORTB, PORTC, PORTD, PORTE, PORTF;
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC6 6
+#define PC7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define PE2 2
+#define PE6 6
+#define PF0 0
+#define PF1 1
+#define PF4 4
+#define PF5 5
+#define PF6 6
+#define PF7 7
+
+// Timer 0.
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0;
+
+#define WGM00  0
+#define WGM01  1
+#define CS00   0
+#define CS01   1
+#define CS02   2
+#define TOIE0  0
+#define OCIE0A 1
+
+// Timer 1. Nothing drives this on the host, so it reads as whatever was last written.
+extern volatile uint8_t  TCCR1A, TCCR1B;
+extern volatile uint16_t TCNT1;
+
+#define CS10   0
+#define CS11   1
+#define CS12   2
+
+// SPI.
+extern volatile uint8_t SPCR, SPSR, SPDR;
+
+#define SPR0 0
+#define SPR1 1
+#define CPHA 2
+#define CPOL 3
+#define MSTR 4
+#define DORD 5
+#define SPE  6
+#define SPIE 7
+#define SPIF 7
+
+// ADC.
+extern volatile uint8_t  ADCSRA;
+extern volatile uint16_t ADC;
+
+#define ADIE  3
+#define ADATE 5
+#define ADSC  6
+#define ADEN  7
+
+// The voltage on each ADC channel, as a 10-bit conversion would read it, the channel the multiplexer is set to, and
+// the channel the conversion under way was started on.
+extern uint16_t Host_ADCInputs[14];
+extern uint8_t  Host_ADCChannel;
+extern uint8_t  Host_ADCConverting;
+
+// Shift registers on the USART, in SPI mode. These are the inputs of each 74HC165 in the chain, first to last, so a
+// pressed button reads low. See LUFA/Drivers/Peripheral/SerialSPI.h in here.
+extern uint8_t Host_ShiftRegisters[4];
+extern uint8_t Host_ShiftPosition;
+
+// Reset and watchdog.
+extern volatile uint8_t MCUSR;
+
+#define WDRF       3
+#define WDTO_15MS  0
+#define WDTO_250MS 4
+#define WDTO_1S    6
+
+void wdt_enable(uint8_t timeout);
+#define wdt_disable()
+#define wdt_reset()
+
+// There's no bootloader on the host, so jumping to it is the same as a reset.
+void Bootloader_Jump(void);
+
+// Sleep. Nothing here waits for an interrupt, so sleeping returns at once.
+#define SLEEP_MODE_IDLE        0
+#define set_sleep_mode(mode)   ((void)(mode))
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()
+
+// Clock.
+#define clock_div_1            0
+#define clock_prescale_set(x)  ((void)(x))
+
+// Interrupts. These only ever fire when the simulation asks, so all we track is whether they're enabled.
+extern volatile uint8_t Host_InterruptsEnabled;
+
+#define cli()       (Host_InterruptsEnabled = 0)
+#define sei()       (Host_InterruptsEnabled = 1)
+#define ISR(vector) void vector(void)
+
+// The same as avr-libc's, but without the cleanup on return: nothing may leave one of these other than at the end.
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type)  for (uint8_t Host_AtomicSaved = Host_InterruptsEnabled, Host_AtomicOnce = (cli(), 1); \
+                                 Host_AtomicOnce; Host_InterruptsEnabled = Host_AtomicSaved, Host_AtomicOnce = 0)
+
+void TIMER0_COMPA_vect(void);
+void SPI_STC_vect(void);
+void ADC_vect(void);
+
+// Flash. The host has one address space, so program memory is just memory.
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define memcpy_P               memcpy
+
+// EEPROM. Addresses are offsets into Host_EEPROM, which starts out erased.
+#define E2END 0x1FF
+
+extern uint8_t Host_EEPROM[E2END + 1];
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+void    eeprom_write_byte(uint8_t* address, uint8_t value);
+void    eeprom_update_byte(uint8_t* address, uint8_t value);
+void    eeprom_read_block(void* destination, const void* source, size_t length);
+void    eeprom_update_block(const void* source, void* destination, size_t length);
+// Writes finish at once, so there's never one to wait for.
+#define eeprom_busy_wait()
+
+// Simulation.
+// Fire an interrupt, if interrupts are enabled. Interrupts are held off while the handler runs, as on the chip.
+void Host_Interrupt(void (*vector)(void));
+// Fire the timer 0 compare interrupt, if the firmware has enabled it.
+void Host_Tick(void);
+// Finish the ADC conversion under way and, if the ADC is running freely, start the next. This fires the ADC interrupt
+// if the firmware has enabled it.
+void Host_ADCConvert(void);
+// Called when the firmware asks for a watchdog reset. By default, this exits.
+extern void (*Host_ResetHandler)(void);
+
+#endif
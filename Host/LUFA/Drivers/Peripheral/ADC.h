@@ -0,0 +1,48 @@
+#ifndef _HOST_ADC_H_
+#define _HOST_ADC_H_
+
+// Stands in for LUFA's ADC driver in the host build. Conversions happen when the simulation calls Host_ADCConvert(),
+// which reads from Host_ADCInputs. As on the chip, a new channel only applies from the next conversion to start.
+
+#include <stdint.h>
+
+#include "HAL.h"
+
+#define ADC_REFERENCE_AREF    0
+#define ADC_REFERENCE_AVCC    (1 << 6)
+#define ADC_LEFT_ADJUSTED     (1 << 5)
+#define ADC_RIGHT_ADJUSTED    (0 << 5)
+#define ADC_FREE_RUNNING      (1 << ADATE)
+#define ADC_SINGLE_CONVERSION (0 << ADATE)
+#define ADC_PRESCALE_128      0x07
+
+static inline void ADC_SetupChannel(const uint8_t ChannelIndex)
+{
+	(void)ChannelIndex;
+}
+
+static inline void ADC_StartReading(const uint16_t MUXMask)
+{
+	Host_ADCChannel = (MUXMask & 0x07) | ((MUXMask & (1 << 8)) ? 8 : 0);
+
+	// With nothing under way, this starts a conversion on the new channel straight away.
+	if (!(ADCSRA & (1 << ADSC))) Host_ADCConverting = Host_ADCChannel;
+	ADCSRA |= (1 << ADSC);
+}
+
+static inline uint16_t ADC_GetResult(void)
+{
+	return ADC;
+}
+
+static inline void ADC_Init(const uint8_t Mode)
+{
+	ADCSRA = ((1 << ADEN) | Mode);
+}
+
+static inline void ADC_Disable(void)
+{
+	ADCSRA = 0;
+}
+
+#endif
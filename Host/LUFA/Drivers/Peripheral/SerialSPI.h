@@ -0,0 +1,46 @@
+#ifndef _HOST_SERIALSPI_H_
+#define _HOST_SERIALSPI_H_
+
+// Stands in for LUFA's USART-in-SPI-mode driver in the host build. Whatever is clocked in comes from a simulated chain
+// of 74HC165 shift registers, whose inputs are Host_ShiftRegisters. The firmware always reads the whole chain after
+// latching it, so the chain simply wraps around after its last register.
+
+#include <stdint.h>
+
+#include "HAL.h"
+#include "Config/AppConfig.h"
+
+#define USART_SPI_SCK_LEAD_RISING  (0 << 0)
+#define USART_SPI_SCK_LEAD_FALLING (1 << 0)
+#define USART_SPI_SAMPLE_LEADING   (0 << 1)
+#define USART_SPI_SAMPLE_TRAILING  (1 << 1)
+#define USART_SPI_ORDER_MSB_FIRST  (0 << 2)
+#define USART_SPI_ORDER_LSB_FIRST  (1 << 2)
+
+#if defined(SHIFT_REGISTER_BUTTONS)
+	#define HOST_SHIFT_REGISTERS ((SHIFT_REGISTER_BUTTONS + 7) / 8)
+#else
+	#define HOST_SHIFT_REGISTERS 1
+#endif
+
+static inline void SerialSPI_Init(const uint8_t SPIOptions, const uint32_t BaudRate)
+{
+	(void)SPIOptions;
+	(void)BaudRate;
+
+	Host_ShiftPosition = 0;
+}
+
+static inline void SerialSPI_Disable(void)
+{
+}
+
+static inline uint8_t SerialSPI_ReceiveByte(void)
+{
+	uint8_t Data = Host_ShiftRegisters[Host_ShiftPosition];
+
+	Host_ShiftPosition = (Host_ShiftPosition + 1) % HOST_SHIFT_REGISTERS;
+	return Data;
+}
+
+#endif
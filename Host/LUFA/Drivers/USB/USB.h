@@ -0,0 +1,276 @@
+#ifndef _HOST_USB_H_
+#define _HOST_USB_H_
+
+// The part of LUFA's USB driver the firmware uses, for the host build. This stands in for the real
+// LUFA/Drivers/USB/USB.h, which only builds for the chip. The descriptor types match LUFA's layout;
+// the endpoints are software FIFOs, driven from the simulation side with the Host_USB_* functions.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "HAL.h"
+
+#if defined(USE_LUFA_CONFIG_HEADER)
+	#include "LUFAConfig.h"
+#endif
+
+// LUFA's common macros, as far as the HID report items need them.
+#define ATTR_PACKED              __attribute__ ((packed))
+#define CONCAT(x, y)             x ## y
+#define CONCAT_EXPANDED(x, y)    CONCAT(x, y)
+#define CPU_TO_LE16(x)           (x)
+#define MIN(x, y)                (((x) < (y)) ? (x) : (y))
+#define MAX(x, y)                (((x) > (y)) ? (x) : (y))
+
+#include <LUFA/Drivers/USB/Class/Common/HIDReportData.h>
+
+// We keep descriptors in more than one place (flash, EEPROM, RAM), so mirror the AVR here.
+#define ARCH_HAS_MULTI_ADDRESS_SPACE
+
+static inline void GlobalInterruptEnable(void)  { sei(); }
+static inline void GlobalInterruptDisable(void) { cli(); }
+static inline void Delay_MS(uint16_t Milliseconds) { (void)Milliseconds; }
+
+// Descriptors.
+#define NO_DESCRIPTOR                     0
+#define USB_CONFIG_POWER_MA(mA)           ((mA) >> 1)
+#define USB_STRING_LEN(UnicodeChars)      (sizeof(USB_Descriptor_Header_t) + ((UnicodeChars) << 1))
+#define USB_STRING_DESCRIPTOR(String)     { .Header = {.Size = sizeof(USB_Descriptor_Header_t) + (sizeof(String) - 2), .Type = DTYPE_String}, .UnicodeString = String }
+#define USB_STRING_DESCRIPTOR_ARRAY(...)  { .Header = {.Size = sizeof(USB_Descriptor_Header_t) + sizeof((uint16_t){__VA_ARGS__}), .Type = DTYPE_String}, .UnicodeString = {__VA_ARGS__} }
+#define VERSION_BCD(Major, Minor, Revision) \
+                                          CPU_TO_LE16( ((Major & 0xFF) << 8) | ((Minor & 0x0F) << 4) | (Revision & 0x0F) )
+#define LANGUAGE_ID_ENG                   0x0409
+
+#define USB_CONFIG_ATTR_RESERVED          0x80
+#define USB_CONFIG_ATTR_SELFPOWERED       0x40
+#define USB_CONFIG_ATTR_REMOTEWAKEUP      0x20
+
+#define ENDPOINT_ATTR_NO_SYNC             (0 << 2)
+#define ENDPOINT_USAGE_DATA               (0 << 4)
+
+#define USB_CSCP_NoDeviceClass            0x00
+#define USB_CSCP_NoDeviceSubclass         0x00
+#define USB_CSCP_NoDeviceProtocol         0x00
+
+#define HID_CSCP_HIDClass                 0x03
+#define HID_CSCP_NonBootSubclass          0x00
+#define HID_CSCP_BootSubclass             0x01
+#define HID_CSCP_NonBootProtocol          0x00
+#define HID_CSCP_KeyboardBootProtocol     0x01
+#define HID_CSCP_MouseBootProtocol        0x02
+
+enum USB_DescriptorTypes_t
+{
+	DTYPE_Device        = 0x01,
+	DTYPE_Configuration = 0x02,
+	DTYPE_String        = 0x03,
+	DTYPE_Interface     = 0x04,
+	DTYPE_Endpoint      = 0x05,
+};
+
+enum HID_DescriptorTypes_t
+{
+	HID_DTYPE_HID       = 0x21,
+	HID_DTYPE_Report    = 0x22,
+};
+
+enum USB_DescriptorMemorySpaces_t
+{
+	MEMSPACE_FLASH      = 0,
+	MEMSPACE_EEPROM     = 1,
+	MEMSPACE_RAM        = 2,
+};
+
+typedef struct
+{
+	uint8_t Size;
+	uint8_t Type;
+} ATTR_PACKED USB_Descriptor_Header_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+
+	uint16_t USBSpecification;
+	uint8_t  Class;
+	uint8_t  SubClass;
+	uint8_t  Protocol;
+	uint8_t  Endpoint0Size;
+	uint16_t VendorID;
+	uint16_t ProductID;
+	uint16_t ReleaseNumber;
+	uint8_t  ManufacturerStrIndex;
+	uint8_t  ProductStrIndex;
+	uint8_t  SerialNumStrIndex;
+	uint8_t  NumberOfConfigurations;
+} ATTR_PACKED USB_Descriptor_Device_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+
+	uint16_t TotalConfigurationSize;
+	uint8_t  TotalInterfaces;
+	uint8_t  ConfigurationNumber;
+	uint8_t  ConfigurationStrIndex;
+	uint8_t  ConfigAttributes;
+	uint8_t  MaxPowerConsumption;
+} ATTR_PACKED USB_Descriptor_Configuration_Header_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+
+	uint8_t InterfaceNumber;
+	uint8_t AlternateSetting;
+	uint8_t TotalEndpoints;
+	uint8_t Class;
+	uint8_t SubClass;
+	uint8_t Protocol;
+	uint8_t InterfaceStrIndex;
+} ATTR_PACKED USB_Descriptor_Interface_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+
+	uint8_t  EndpointAddress;
+	uint8_t  Attributes;
+	uint16_t EndpointSize;
+	uint8_t  PollingIntervalMS;
+} ATTR_PACKED USB_Descriptor_Endpoint_t;
+
+// The host build uses -fshort-wchar, so wide strings are UTF-16 as on the chip.
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+
+	wchar_t UnicodeString[];
+} ATTR_PACKED USB_Descriptor_String_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+
+	uint16_t HIDSpec;
+	uint8_t  CountryCode;
+	uint8_t  TotalReportDescriptors;
+	uint8_t  HIDReportType;
+	uint16_t HIDReportLength;
+} ATTR_PACKED USB_HID_Descriptor_HID_t;
+
+typedef uint8_t USB_Descriptor_HIDReport_Datatype_t;
+
+// Control requests.
+typedef struct
+{
+	uint8_t  bmRequestType;
+	uint8_t  bRequest;
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+} ATTR_PACKED USB_Request_Header_t;
+
+#define REQDIR_HOSTTODEVICE               (0 << 7)
+#define REQDIR_DEVICETOHOST               (1 << 7)
+#define REQTYPE_STANDARD                  (0 << 5)
+#define REQTYPE_CLASS                     (1 << 5)
+#define REQTYPE_VENDOR                    (2 << 5)
+#define REQREC_DEVICE                     (0 << 0)
+#define REQREC_INTERFACE                  (1 << 0)
+#define REQREC_ENDPOINT                   (2 << 0)
+
+enum HID_ClassRequests_t
+{
+	HID_REQ_GetReport   = 0x01,
+	HID_REQ_GetIdle     = 0x02,
+	HID_REQ_GetProtocol = 0x03,
+	HID_REQ_SetReport   = 0x09,
+	HID_REQ_SetIdle     = 0x0A,
+	HID_REQ_SetProtocol = 0x0B,
+};
+
+extern USB_Request_Header_t USB_ControlRequest;
+
+// Device state.
+enum USB_Device_States_t
+{
+	DEVICE_STATE_Unattached = 0,
+	DEVICE_STATE_Powered    = 1,
+	DEVICE_STATE_Default    = 2,
+	DEVICE_STATE_Addressed  = 3,
+	DEVICE_STATE_Configured = 4,
+	DEVICE_STATE_Suspended  = 5,
+};
+
+extern volatile uint8_t USB_DeviceState;
+
+void USB_Init(void);
+void USB_Disable(void);
+void USB_USBTask(void);
+
+uint16_t USB_Device_GetFrameNumber(void);
+// Start-of-frame events always reach the firmware here, when the simulation starts a frame.
+static inline void USB_Device_EnableSOFEvents(void) { }
+
+// Endpoints.
+#define ENDPOINT_DIR_OUT                  0x00
+#define ENDPOINT_DIR_IN                   0x80
+#define ENDPOINT_EPNUM_MASK               0x0F
+#define ENDPOINT_CONTROLEP                0
+
+#define EP_TYPE_CONTROL                   0x00
+#define EP_TYPE_ISOCHRONOUS               0x01
+#define EP_TYPE_BULK                      0x02
+#define EP_TYPE_INTERRUPT                 0x03
+
+enum Endpoint_Stream_RW_ErrorCodes_t
+{
+	ENDPOINT_RWSTREAM_NoError = 0,
+};
+
+enum Endpoint_ControlStream_RW_ErrorCodes_t
+{
+	ENDPOINT_RWCSTREAM_NoError = 0,
+};
+
+bool    Endpoint_ConfigureEndpoint(const uint8_t Address, const uint8_t Type, const uint16_t Size, const uint8_t Banks);
+void    Endpoint_SelectEndpoint(const uint8_t Address);
+bool    Endpoint_IsINReady(void);
+bool    Endpoint_IsOUTReceived(void);
+bool    Endpoint_IsReadWriteAllowed(void);
+void    Endpoint_ClearIN(void);
+void    Endpoint_ClearOUT(void);
+void    Endpoint_ClearSETUP(void);
+uint8_t Endpoint_Write_Stream_LE(const void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed);
+uint8_t Endpoint_Read_Stream_LE(void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed);
+uint8_t Endpoint_Write_Control_Stream_LE(const void* const Buffer, uint16_t Length);
+uint8_t Endpoint_Read_Control_Stream_LE(void* const Buffer, uint16_t Length);
+
+// Callbacks and events, as implemented by the firmware.
+uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue, const uint8_t wIndex, const void** const DescriptorAddress,
+                                    uint8_t* const DescriptorMemorySpace);
+
+void EVENT_USB_Device_Connect(void);
+void EVENT_USB_Device_Disconnect(void);
+void EVENT_USB_Device_ConfigurationChanged(void);
+void EVENT_USB_Device_ControlRequest(void);
+void EVENT_USB_Device_StartOfFrame(void);
+
+// Simulation side. These are what a host-side test bench uses to play the part of the USB host.
+// Enumerate: the device is configured and its endpoints are set up.
+void     Host_USB_Configure(void);
+// Fetch a descriptor into Buffer, from whichever memory space it lives in. Returns its full size.
+uint16_t Host_USB_GetDescriptor(const uint16_t wValue, const uint8_t wIndex, void* const Buffer, const uint16_t Length);
+// Run a control request. Data goes in or comes back through Buffer, depending on the direction. Returns bytes transferred.
+uint16_t Host_USB_ControlRequest(const USB_Request_Header_t* const Request, void* const Buffer);
+// Start a new frame: the frame number moves on, and the firmware sees a start-of-frame event.
+void     Host_USB_StartOfFrame(void);
+// Take the next packet the device has sent on an IN endpoint. Returns its length, or -1 if there isn't one.
+int      Host_USB_ReadIN(const uint8_t Address, void* const Buffer, const uint16_t Length);
+// Queue a packet for the device on an OUT endpoint. Returns false if the endpoint's queue is full.
+bool     Host_USB_WriteOUT(const uint8_t Address, const void* const Buffer, const uint16_t Length);
+
+#endif
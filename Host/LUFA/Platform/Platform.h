@@ -0,0 +1,6 @@
+#ifndef _HOST_PLATFORM_H_
+#define _HOST_PLATFORM_H_
+
+// Stands in for LUFA/Platform/Platform.h in the host build. The firmware uses nothing platform specific from it.
+
+#endif
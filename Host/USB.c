@@ -0,0 +1,232 @@
+#include <LUFA/Drivers/USB/USB.h>
+
+// Our endpoints. Each one is a queue of whole packets. The firmware fills in (or drains) the packet at its end of the
+// queue, and clearing the endpoint hands it over (or drops it), just as with the banks on the chip.
+#define HOST_ENDPOINTS      8
+#define HOST_PACKETS        16
+#define HOST_PACKET_SIZE    64
+
+typedef struct {
+	uint8_t  Data[HOST_PACKET_SIZE];
+	uint16_t Length;
+} Host_Packet_t;
+
+typedef struct {
+	uint16_t      Size;
+	Host_Packet_t Queue[HOST_PACKETS];
+	uint8_t       Head;
+	uint8_t       Tail;
+	// The packet the firmware is working on. IN endpoints write into this; OUT endpoints read the queue's tail.
+	Host_Packet_t Bank;
+	uint16_t      Position;
+} Host_Endpoint_t;
+
+USB_Request_Header_t USB_ControlRequest;
+volatile uint8_t     USB_DeviceState;
+
+static Host_Endpoint_t Endpoints[HOST_ENDPOINTS];
+static uint16_t        Frame;
+static uint8_t         Selected;
+
+// The control transfer in progress.
+static uint8_t*        ControlBuffer;
+static uint16_t        ControlLength;
+
+static bool IsIN(void) {
+	return (Selected & ENDPOINT_DIR_IN) != 0;
+}
+
+static Host_Endpoint_t* Current(void) {
+	return &Endpoints[Selected & ENDPOINT_EPNUM_MASK & (HOST_ENDPOINTS - 1)];
+}
+
+static uint8_t QueueCount(const Host_Endpoint_t* ep) {
+	return (uint8_t)(ep->Head - ep->Tail) % HOST_PACKETS;
+}
+
+void USB_Init(void) {
+	memset(Endpoints, 0, sizeof(Endpoints));
+	USB_DeviceState = DEVICE_STATE_Unattached;
+}
+
+void USB_Disable(void) {
+	USB_DeviceState = DEVICE_STATE_Unattached;
+}
+
+void USB_USBTask(void) {
+}
+
+uint16_t USB_Device_GetFrameNumber(void) {
+	return Frame;
+}
+
+bool Endpoint_ConfigureEndpoint(const uint8_t Address, const uint8_t Type, const uint16_t Size, const uint8_t Banks) {
+	(void)Type;
+	(void)Banks;
+
+	if (((Address & ENDPOINT_EPNUM_MASK) >= HOST_ENDPOINTS) || (Size > HOST_PACKET_SIZE)) return false;
+
+	Host_Endpoint_t* ep = &Endpoints[Address & ENDPOINT_EPNUM_MASK];
+	memset(ep, 0, sizeof(*ep));
+	ep->Size = Size;
+	return true;
+}
+
+void Endpoint_SelectEndpoint(const uint8_t Address) {
+	Selected = Address;
+}
+
+bool Endpoint_IsINReady(void) {
+	// One bank: the firmware can only write once the host has taken the last packet.
+	return Current()->Size && (QueueCount(Current()) == 0);
+}
+
+bool Endpoint_IsOUTReceived(void) {
+	return QueueCount(Current()) != 0;
+}
+
+bool Endpoint_IsReadWriteAllowed(void) {
+	Host_Endpoint_t* ep = Current();
+
+	if (IsIN()) return ep->Position < ep->Size;
+	return (QueueCount(ep) != 0) && (ep->Position < ep->Queue[ep->Tail].Length);
+}
+
+void Endpoint_ClearIN(void) {
+	Host_Endpoint_t* ep = Current();
+	if ((Selected & ENDPOINT_EPNUM_MASK) == ENDPOINT_CONTROLEP) return;
+
+	if (QueueCount(ep) < (HOST_PACKETS - 1)) {
+		ep->Bank.Length = ep->Position;
+		ep->Queue[ep->Head] = ep->Bank;
+		ep->Head = (ep->Head + 1) % HOST_PACKETS;
+	}
+	ep->Position = 0;
+}
+
+void Endpoint_ClearOUT(void) {
+	Host_Endpoint_t* ep = Current();
+	if ((Selected & ENDPOINT_EPNUM_MASK) == ENDPOINT_CONTROLEP) return;
+
+	if (QueueCount(ep)) ep->Tail = (ep->Tail + 1) % HOST_PACKETS;
+	ep->Position = 0;
+}
+
+void Endpoint_ClearSETUP(void) {
+}
+
+// As on the chip, a full bank goes out as it is and the rest starts the next packet, so a report bigger than its
+// endpoint reaches the host in pieces.
+uint8_t Endpoint_Write_Stream_LE(const void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed) {
+	Host_Endpoint_t* ep   = Current();
+	const uint8_t*   Data = Buffer;
+	uint16_t         Done = 0;
+
+	if (!ep->Size) Length = 0;
+	while (Done < Length) {
+		if (ep->Position >= ep->Size) Endpoint_ClearIN();
+
+		uint16_t Copy = ep->Size - ep->Position;
+		if (Copy > (Length - Done)) Copy = Length - Done;
+		memcpy(&ep->Bank.Data[ep->Position], &Data[Done], Copy);
+		ep->Position += Copy;
+		Done         += Copy;
+	}
+
+	if (BytesProcessed) *BytesProcessed = Length;
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t Endpoint_Read_Stream_LE(void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed) {
+	Host_Endpoint_t* ep = Current();
+	Host_Packet_t*   packet = &ep->Queue[ep->Tail];
+
+	// Short packets read back as zeroes past their end.
+	memset(Buffer, 0, Length);
+	for (uint16_t i = 0; (i < Length) && (ep->Position < packet->Length); i++)
+		((uint8_t*)Buffer)[i] = packet->Data[ep->Position++];
+
+	if (BytesProcessed) *BytesProcessed = Length;
+	return ENDPOINT_RWSTREAM_NoError;
+}
+
+uint8_t Endpoint_Write_Control_Stream_LE(const void* const Buffer, uint16_t Length) {
+	if (Length > USB_ControlRequest.wLength) Length = USB_ControlRequest.wLength;
+
+	memcpy(ControlBuffer, Buffer, Length);
+	ControlLength = Length;
+	return ENDPOINT_RWCSTREAM_NoError;
+}
+
+uint8_t Endpoint_Read_Control_Stream_LE(void* const Buffer, uint16_t Length) {
+	memset(Buffer, 0, Length);
+	if (Length > USB_ControlRequest.wLength) Length = USB_ControlRequest.wLength;
+
+	memcpy(Buffer, ControlBuffer, Length);
+	ControlLength = Length;
+	return ENDPOINT_RWCSTREAM_NoError;
+}
+
+void Host_USB_Configure(void) {
+	USB_DeviceState = DEVICE_STATE_Configured;
+	EVENT_USB_Device_Connect();
+	EVENT_USB_Device_ConfigurationChanged();
+}
+
+// As in LUFA, events the firmware doesn't handle do nothing.
+__attribute__ ((weak)) void EVENT_USB_Device_StartOfFrame(void) {
+}
+
+void Host_USB_StartOfFrame(void) {
+	// Frame numbers are 11 bits wide.
+	Frame = (Frame + 1) & 0x07FF;
+	EVENT_USB_Device_StartOfFrame();
+}
+
+uint16_t Host_USB_GetDescriptor(const uint16_t wValue, const uint8_t wIndex, void* const Buffer, const uint16_t Length) {
+	const void* Address      = NULL;
+	uint8_t     MemorySpace  = MEMSPACE_FLASH;
+	uint16_t    Size         = CALLBACK_USB_GetDescriptor(wValue, wIndex, &Address, &MemorySpace);
+	uint16_t    Copy         = (Size < Length) ? Size : Length;
+
+	if (MemorySpace == MEMSPACE_EEPROM) eeprom_read_block(Buffer, Address, Copy);
+	else                                memcpy(Buffer, Address, Copy);
+
+	return Size;
+}
+
+uint16_t Host_USB_ControlRequest(const USB_Request_Header_t* const Request, void* const Buffer) {
+	uint8_t Previous = Selected;
+
+	USB_ControlRequest = *Request;
+	ControlBuffer      = Buffer;
+	ControlLength      = 0;
+
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	EVENT_USB_Device_ControlRequest();
+	Endpoint_SelectEndpoint(Previous);
+
+	return ControlLength;
+}
+
+int Host_USB_ReadIN(const uint8_t Address, void* const Buffer, const uint16_t Length) {
+	Host_Endpoint_t* ep = &Endpoints[Address & ENDPOINT_EPNUM_MASK & (HOST_ENDPOINTS - 1)];
+	if (!QueueCount(ep)) return -1;
+
+	Host_Packet_t* packet = &ep->Queue[ep->Tail];
+	uint16_t       copy   = (packet->Length < Length) ? packet->Length : Length;
+
+	memcpy(Buffer, packet->Data, copy);
+	ep->Tail = (ep->Tail + 1) % HOST_PACKETS;
+	return packet->Length;
+}
+
+bool Host_USB_WriteOUT(const uint8_t Address, const void* const Buffer, const uint16_t Length) {
+	Host_Endpoint_t* ep = &Endpoints[Address & ENDPOINT_EPNUM_MASK & (HOST_ENDPOINTS - 1)];
+	if ((QueueCount(ep) >= (HOST_PACKETS - 1)) || (Length > HOST_PACKET_SIZE)) return false;
+
+	memcpy(ep->Queue[ep->Head].Data, Buffer, Length);
+	ep->Queue[ep->Head].Length = Length;
+	ep->Head = (ep->Head + 1) % HOST_PACKETS;
+	return true;
+}
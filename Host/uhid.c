@@ -0,0 +1,272 @@
+// Virtual USBemani. This runs the host build of the firmware and presents it to Linux through /dev/uhid, so host
+// tools see a hidraw node with our exact report descriptor and talk to the real firmware code behind it. Output
+// reports, GET_REPORT and SET_REPORT all go through the firmware's own handlers, so config commands, the feature
+// report and the bootloader command behave as on the board.
+//
+// Only the generic interface is presented: uhid makes one HID device per instance.
+//
+// usage: usemani_uhid [-e eeprom.bin] [-p milliseconds]
+//   -e  load the EEPROM from this file, and save it back on exit
+//   -p  toggle button 1 with this period, so there's input to report
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <linux/uhid.h>
+
+#include "USBemani.h"
+#include "Config.h"
+#include "PS2.h"
+
+extern Settings_Button_t *Button;
+extern Settings_Lights_t *Lights;
+extern Settings_Device_t *Device;
+
+// The firmware samples at 4kHz, and the host polls us every frame.
+#define TICKS_PER_FRAME 4
+
+static int         UHID = -1;
+static const char* EEPROMFile;
+static volatile sig_atomic_t Stop;
+
+static void SaveEEPROM(void) {
+	if (!EEPROMFile) return;
+
+	FILE* f = fopen(EEPROMFile, "wb");
+	if (!f) {
+		fprintf(stderr, "Unable to save %s: %s\n", EEPROMFile, strerror(errno));
+		return;
+	}
+	fwrite(Host_EEPROM, 1, sizeof(Host_EEPROM), f);
+	fclose(f);
+}
+
+static void LoadEEPROM(void) {
+	if (!EEPROMFile) return;
+
+	// A missing file is a fresh board, which starts out erased.
+	FILE* f = fopen(EEPROMFile, "rb");
+	if (!f) return;
+	if (fread(Host_EEPROM, 1, sizeof(Host_EEPROM), f) != sizeof(Host_EEPROM))
+		fprintf(stderr, "%s is short, the rest reads as erased\n", EEPROMFile);
+	fclose(f);
+}
+
+static int Send(struct uhid_event* Event) {
+	if (write(UHID, Event, sizeof(*Event)) != sizeof(*Event)) {
+		fprintf(stderr, "uhid write failed: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void Destroy(void) {
+	struct uhid_event Event = { .type = UHID_DESTROY };
+
+	if (UHID < 0) return;
+	Send(&Event);
+	close(UHID);
+	UHID = -1;
+}
+
+// The firmware has asked for the bootloader. The board would drop off the bus here, so we do too.
+static void Reset(void) {
+	fprintf(stderr, "Bootloader requested, detaching\n");
+	Destroy();
+	SaveEEPROM();
+}
+
+static int Create(void) {
+	struct uhid_event       Event = { .type = UHID_CREATE2 };
+	USB_Descriptor_Device_t DeviceDescriptor;
+	uint8_t                 Product[128];
+	uint16_t                Length;
+
+	Host_USB_GetDescriptor(DTYPE_Device << 8, 0, &DeviceDescriptor, sizeof(DeviceDescriptor));
+
+	Length = Host_USB_GetDescriptor(HID_DTYPE_Report << 8, INTERFACE_ID_GenericHID, Event.u.create2.rd_data,
+	                                sizeof(Event.u.create2.rd_data));
+	if (Length > sizeof(Event.u.create2.rd_data)) {
+		fprintf(stderr, "Report descriptor is %u bytes, uhid takes %zu\n", Length, sizeof(Event.u.create2.rd_data));
+		return -1;
+	}
+	Event.u.create2.rd_size = Length;
+
+	// The product string is UTF-16, and anything we'd name a board is plain ASCII.
+	Length = Host_USB_GetDescriptor((DTYPE_String << 8) | STRING_ID_Product, 0, Product, sizeof(Product));
+	if (Length > sizeof(Product)) Length = sizeof(Product);
+	for (uint16_t i = 2, j = 0; (i < Length) && (j < sizeof(Event.u.create2.name) - 1); i += 2, j++)
+		Event.u.create2.name[j] = Product[i];
+
+	strcpy((char*)Event.u.create2.phys, "usemani-uhid");
+	Event.u.create2.bus     = BUS_USB;
+	Event.u.create2.vendor  = DeviceDescriptor.VendorID;
+	Event.u.create2.product = DeviceDescriptor.ProductID;
+	Event.u.create2.version = DeviceDescriptor.ReleaseNumber;
+
+	return Send(&Event);
+}
+
+// uhid report types, as HID report types for the wValue of a control request.
+static uint8_t ReportType(uint8_t Type) {
+	switch (Type) {
+		case UHID_INPUT_REPORT:  return 0x01;
+		case UHID_OUTPUT_REPORT: return 0x02;
+		default:                 return 0x03;
+	}
+}
+
+static void GetReport(const struct uhid_get_report_req* Request) {
+	struct uhid_event    Event  = { .type = UHID_GET_REPORT_REPLY };
+	USB_Request_Header_t Header = {
+		.bmRequestType = REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE,
+		.bRequest      = HID_REQ_GetReport,
+		.wValue        = (ReportType(Request->rtype) << 8) | Request->rnum,
+		.wIndex        = INTERFACE_ID_GenericHID,
+		.wLength       = UHID_DATA_MAX,
+	};
+
+	Event.u.get_report_reply.id   = Request->id;
+	Event.u.get_report_reply.size = Host_USB_ControlRequest(&Header, Event.u.get_report_reply.data);
+	Event.u.get_report_reply.err  = Event.u.get_report_reply.size ? 0 : EIO;
+	Send(&Event);
+}
+
+static void SetReport(struct uhid_set_report_req* Request) {
+	struct uhid_event    Event  = { .type = UHID_SET_REPORT_REPLY };
+	USB_Request_Header_t Header = {
+		.bmRequestType = REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE,
+		.bRequest      = HID_REQ_SetReport,
+		.wValue        = (ReportType(Request->rtype) << 8) | Request->rnum,
+		.wIndex        = INTERFACE_ID_GenericHID,
+		.wLength       = Request->size,
+	};
+
+	// The reply goes out first: the request may be the bootloader command, which doesn't come back.
+	Event.u.set_report_reply.id  = Request->id;
+	Event.u.set_report_reply.err = 0;
+	Send(&Event);
+
+	Host_USB_ControlRequest(&Header, Request->data);
+}
+
+static void HandleEvent(void) {
+	struct uhid_event Event;
+	ssize_t           Length = read(UHID, &Event, sizeof(Event));
+
+	if (Length <= 0) return;
+
+	switch (Event.type) {
+		case UHID_OUTPUT:
+			// Written to hidraw: this goes out on our OUT endpoint, and the firmware picks it up in HID_Task.
+			if (!Host_USB_WriteOUT(GENERIC_OUT_EPADDR, Event.u.output.data, MIN(Event.u.output.size, GENERIC_EPSIZE)))
+				fprintf(stderr, "OUT endpoint full, report dropped\n");
+			break;
+		case UHID_GET_REPORT:
+			GetReport(&Event.u.get_report);
+			break;
+		case UHID_SET_REPORT:
+			SetReport(&Event.u.set_report);
+			break;
+		default:
+			break;
+	}
+}
+
+// One USB frame: a frame's worth of timer interrupts, the main loop until it would sleep, then the host polls us.
+static void Frame(uint32_t Number, uint32_t TogglePeriod) {
+	struct uhid_event Event = { .type = UHID_INPUT2 };
+	int               Length;
+
+	if (TogglePeriod && !(Number % TogglePeriod)) PIND ^= (1 << PD0);
+
+	// The ticks and the frame post their events, and the main loop runs whatever they made ready.
+	for (uint8_t i = 0; i < TICKS_PER_FRAME; i++) Host_Tick();
+	Host_USB_StartOfFrame();
+	while (Scheduler_Step());
+
+	Length = Host_USB_ReadIN(GENERIC_IN_EPADDR, Event.u.input2.data, sizeof(Event.u.input2.data));
+	if (Length > 0) {
+		Event.u.input2.size = Length;
+		Send(&Event);
+	}
+}
+
+static void OnSignal(int Signal) {
+	(void)Signal;
+	Stop = 1;
+}
+
+int main(int argc, char** argv) {
+	struct itimerspec Period = { .it_interval = { 0, 1000000 }, .it_value = { 0, 1000000 } };
+	struct pollfd     Poll[2];
+	uint32_t          Number = 0, TogglePeriod = 0;
+	uint64_t          Expired;
+	int               Timer, Option;
+
+	while ((Option = getopt(argc, argv, "e:p:")) != -1) {
+		switch (Option) {
+			case 'e': EEPROMFile   = optarg; break;
+			case 'p': TogglePeriod = strtoul(optarg, NULL, 0); break;
+			default:
+				fprintf(stderr, "usage: %s [-e eeprom.bin] [-p milliseconds]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	LoadEEPROM();
+	Host_ResetHandler = Reset;
+
+	// As the firmware's main() does, short of its loop.
+	Config_Init();
+	Config_AddressButton(&Button);
+	Config_AddressLights(&Lights);
+	Config_AddressDevice(&Device);
+
+	SetupHardware();
+	SetupScheduler();
+	USB_Init();
+	GlobalInterruptEnable();
+	Host_USB_Configure();
+
+	UHID = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+	if (UHID < 0) {
+		fprintf(stderr, "Unable to open /dev/uhid: %s\n", strerror(errno));
+		return 1;
+	}
+	if (Create()) return 1;
+
+	Timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if ((Timer < 0) || timerfd_settime(Timer, 0, &Period, NULL)) {
+		fprintf(stderr, "Unable to start frame timer: %s\n", strerror(errno));
+		return 1;
+	}
+
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+
+	Poll[0] = (struct pollfd){ .fd = UHID,  .events = POLLIN };
+	Poll[1] = (struct pollfd){ .fd = Timer, .events = POLLIN };
+
+	while (!Stop) {
+		if (poll(Poll, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		if (Poll[0].revents & POLLIN) HandleEvent();
+
+		// If we fell behind, catch up on every frame we missed, as a real bus would have run them.
+		if ((Poll[1].revents & POLLIN) && (read(Timer, &Expired, sizeof(Expired)) == sizeof(Expired)))
+			while (Expired--) Frame(Number++, TogglePeriod);
+	}
+
+	Destroy();
+	SaveEEPROM();
+	return 0;
+}
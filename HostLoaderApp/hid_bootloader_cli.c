@@ -39,18 +39,36 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "image.h"
+
 #define USBEMANI_VID     0x0573
 #define USBEMANI_PID_KOC 0x0001
 #define USBEMANI_PID_DAO 0x0002
 
+// The LUFA HID bootloader the controllers are flashed with
+#define LOADER_VID       0x03EB
+#define LOADER_PID       0x2067
+
+// An output report asking the USBemani firmware for its bootloader:
+// no lights, command 0xF5 with its key. The board drops off the bus
+// as soon as the request completes and the bootloader appears in its
+// place, so there's no need to wait before looking for it.
+static unsigned char reboot_command[4] = {0x00, 0x00, 0xF5, 0x73};
+
 void usage(void)
 {
-	fprintf(stderr, "Usage: hid_bootloader_cli -mmcu=<MCU> [-w] [-h] [-n] [-v] <file.hex>\n");
+	fprintf(stderr, "Usage: hid_bootloader_cli -mmcu=<MCU> [-w] [-h] [-n] [-v] [-d] [-a] <file>\n");
 	fprintf(stderr, "\t-w : Wait for device to appear\n");
 	fprintf(stderr, "\t-r : Use hard reboot if device not online\n");
 	fprintf(stderr, "\t-n : No reboot after programming\n");
 	fprintf(stderr, "\t-v : Verbose output\n");
+	fprintf(stderr, "\t-d : Differential: skip blocks the device already has\n");
+	fprintf(stderr, "\t-m=<file> : This device's manifest for -d; with -a, each device's USB path\n");
+	fprintf(stderr, "\t            goes on the end (default ~/.usemani-flash-<path>.manifest,\n");
+	fprintf(stderr, "\t            only trusted for a board -r sent to its bootloader)\n");
+	fprintf(stderr, "\t-a : Program every connected device at once\n");
 	fprintf(stderr, "\n<MCU> = atmegaXXuY or at90usbXXXY");
+	fprintf(stderr, "\n<file> = Intel hex, an ELF from avr-gcc, or a raw .bin");
 
 	fprintf(stderr, "\nFor support and more information, please visit:\n");
 	fprintf(stderr, "http://www.lufa-lib.org\n");
@@ -66,10 +84,58 @@ int teensy_write(void *buf, int len, double timeout);
 void teensy_close(void);
 int hard_reboot(void);
 
-// Intel Hex File Functions
-int read_intel_hex(const char *filename);
-int ihex_bytes_within_range(int begin, int end);
-void ihex_get_data(int addr, int len, unsigned char *bytes);
+// Pipelined writes: queue a block while earlier ones are still going,
+// then wait for all of them. Backends without this just write.
+int teensy_write_async(void *buf, int len, double timeout);
+int teensy_write_finish(void);
+// Wait for a device to show up, returning early if one does.
+void teensy_wait_for_device(double timeout);
+
+// Every bootloader at once, each by its own handle. Only backends that
+// can have several devices open and writing together have these.
+#if defined(USE_LIBUSB1) || defined(USE_MOCK)
+#define HAVE_MULTI_DEVICE
+#define MAX_DEVICES 64
+struct loader_device;
+int loader_find_all(struct loader_device **list, int max);
+const char *loader_path(struct loader_device *d);
+const char *teensy_path(void);
+int loader_write(struct loader_device *d, void *buf, int len, double timeout);
+int loader_write_async(struct loader_device *d, void *buf, int len, double timeout);
+int loader_write_finish(struct loader_device *d);
+void loader_close(struct loader_device *d);
+// The ports hard_reboot() found a board running its firmware on
+void reboot_note_port(const char *path);
+int reboot_was_port(const char *path);
+#endif
+
+// Differential Flashing Functions
+#define MAX_BLOCKS (MAX_MEMORY_SIZE / 128)
+struct manifest {
+	uint64_t hash[MAX_BLOCKS];
+	unsigned char valid[MAX_BLOCKS];
+	char path[1100];
+	int trusted;			// known to be this board's
+};
+void manifest_init(struct manifest *m, const char *device_path);
+void manifest_load(struct manifest *m);
+void manifest_invalidate(struct manifest *m);
+int manifest_has_block(struct manifest *m, int addr, uint64_t hash);
+void manifest_set_block(struct manifest *m, int addr, uint64_t hash);
+int manifest_save(struct manifest *m);
+
+// Programming one device, from the first block to the reboot
+struct target {
+	struct loader_device *dev;	// NULL for the one teensy_open() found
+	struct manifest *manifest;
+	char name[32];			// empty for the one teensy_open() found
+	volatile int done;		// blocks written or skipped so far...
+	int total;			// ...out of this many
+	int skipped;
+	volatile int finished;
+	char error[64];
+};
+int program_target(struct target *t);
 
 // Misc stuff
 int printf_verbose(const char *format, ...);
@@ -82,6 +148,9 @@ int wait_for_device_to_appear = 0;
 int hard_reboot_device = 0;
 int reboot_after_programming = 1;
 int verbose = 0;
+int differential = 0;
+int all_devices = 0;
+const char *manifest_filename = NULL;
 int code_size = 0, block_size = 0;
 const char *filename=NULL;
 
@@ -92,10 +161,120 @@ const char *filename=NULL;
 /*                                                              */
 /****************************************************************/
 
+#if defined(HAVE_MULTI_DEVICE)
+#include <pthread.h>
+
+static char rebooted_ports[MAX_DEVICES][32];
+static int rebooted_count = 0;
+
+void reboot_note_port(const char *path)
+{
+	if (rebooted_count < MAX_DEVICES)
+		snprintf(rebooted_ports[rebooted_count++], sizeof(rebooted_ports[0]), "%s", path);
+}
+
+int reboot_was_port(const char *path)
+{
+	int i;
+
+	for (i=0; i<rebooted_count; i++) {
+		if (strcmp(rebooted_ports[i], path) == 0) return 1;
+	}
+	return 0;
+}
+
+static void *program_thread(void *arg)
+{
+	struct target *t = arg;
+
+	program_target(t);
+	loader_close(t->dev);
+	t->finished = 1;
+	return NULL;
+}
+
+// Each device gets a thread of its own, so a slow or failing one holds
+// up nothing but itself.
+static int program_all(void)
+{
+	struct loader_device *devs[MAX_DEVICES];
+	struct target *targets;
+	pthread_t *threads;
+	int i, n, waited=0, running, failed=0, rebooted=0, tries=0;
+
+	if (hard_reboot_device) {
+		rebooted = hard_reboot();
+		printf_verbose("Hard Reboot performed on %d device%s\n", rebooted, rebooted == 1 ? "" : "s");
+		wait_for_device_to_appear = 1;
+	}
+	while (1) {
+		n = loader_find_all(devs, MAX_DEVICES);
+		// give every board we rebooted a few seconds to turn up
+		if (n && (n >= rebooted || ++tries > 5)) break;
+		for (i=0; i<n; i++) loader_close(devs[i]);
+		if (!wait_for_device_to_appear) die("Unable to open device\n");
+		if (!waited) {
+			printf_verbose("Waiting for Teensy devices...\n");
+			waited = 1;
+		}
+		teensy_wait_for_device(1.0);
+	}
+	printf_verbose("Found %d HalfKay Bootloader%s\n", n, n == 1 ? "" : "s");
+	if (waited && read_image(filename) < 0)
+		die("error reading firmware file \"%s\"", filename);
+
+	targets = calloc(n, sizeof(*targets));
+	threads = calloc(n, sizeof(*threads));
+	if (!targets || !threads) die("Out of memory\n");
+	for (i=0; i<n; i++) {
+		targets[i].dev = devs[i];
+		// a copy, as the device goes away when its thread is done
+		snprintf(targets[i].name, sizeof(targets[i].name), "%s", loader_path(devs[i]));
+		if (differential) {
+			targets[i].manifest = malloc(sizeof(struct manifest));
+			if (!targets[i].manifest) die("Out of memory\n");
+			manifest_init(targets[i].manifest, targets[i].name);
+		}
+		if (pthread_create(&threads[i], NULL, program_thread, &targets[i]) != 0)
+			die("Unable to start a thread for %s\n", targets[i].name);
+	}
+
+	// progress for every device on one line, until they're all done
+	do {
+		delay(0.25);
+		running = 0;
+		for (i=0; i<n; i++) {
+			if (!targets[i].finished) running = 1;
+			printf_verbose("%s%s %3d%%", i ? "  " : "\r", targets[i].name,
+				targets[i].total ? targets[i].done * 100 / targets[i].total : 0);
+		}
+	} while (running);
+	for (i=0; i<n; i++) pthread_join(threads[i], NULL);
+	printf_verbose("\n");
+
+	for (i=0; i<n; i++) {
+		if (targets[i].error[0]) {
+			fprintf(stderr, "%s: %s\n", targets[i].name, targets[i].error);
+			failed++;
+		} else if (differential) {
+			printf("%s: ok, %d blocks written, %d unchanged\n", targets[i].name,
+				targets[i].total - targets[i].skipped, targets[i].skipped);
+		} else {
+			printf("%s: ok, %d blocks written\n", targets[i].name, targets[i].total);
+		}
+		free(targets[i].manifest);
+	}
+	free(targets);
+	free(threads);
+	return failed ? 1 : 0;
+}
+#endif
+
 int main(int argc, char **argv)
 {
-	unsigned char buf[260];
-	int num, addr, r, first_block=1, waited=0;
+	static struct manifest manifest;
+	struct target target;
+	int num, waited=0;
 
 	// parse command line arguments
 	parse_options(argc, argv);
@@ -108,14 +287,28 @@ int main(int argc, char **argv)
 		usage();
 	}
 	printf_verbose("Teensy Loader, Command Line, Version 2.0\n");
+	#if !defined(HAVE_MULTI_DEVICE)
+	// this backend can't tell one device from another, so one manifest
+	// would be trusted for whichever board happened to be plugged in
+	if (differential && !all_devices && !manifest_filename)
+		die("-d needs -m=<file> naming this device's manifest with this build\n");
+	#endif
 
-	// read the intel hex file
+	// read the firmware file
 	// this is done first so any error is reported before using USB
-	num = read_intel_hex(filename);
-	if (num < 0) die("error reading intel hex file \"%s\"", filename);
+	num = read_image(filename);
+	if (num < 0) die("error reading firmware file \"%s\"", filename);
 	printf_verbose("Read \"%s\": %d bytes, %.1f%% usage\n",
 		filename, num, (double)num / (double)code_size * 100.0);
 
+	if (all_devices) {
+		#if defined(HAVE_MULTI_DEVICE)
+		return program_all();
+		#else
+		die("-a needs the libusb-1.0 build\n");
+		#endif
+	}
+
 	// open the USB device
 	while (1) {
 		if (teensy_open()) break;
@@ -131,29 +324,95 @@ int main(int argc, char **argv)
 			printf_verbose(" (hint: press the reset button)\n");
 			waited = 1;
 		}
-		delay(0.25);
+		teensy_wait_for_device(1.0);
 	}
 	printf_verbose("Found HalfKay Bootloader\n");
 
-	// if we waited for the device, read the hex file again
+	// if we waited for the device, read the file again
 	// perhaps it changed while we were waiting?
 	if (waited) {
-		num = read_intel_hex(filename);
-		if (num < 0) die("error reading intel hex file \"%s\"", filename);
+		num = read_image(filename);
+		if (num < 0) die("error reading firmware file \"%s\"", filename);
 		printf_verbose("Read \"%s\": %d bytes, %.1f%% usage\n",
 		 	filename, num, (double)num / (double)code_size * 100.0);
 	}
 
-	// program the data
+	memset(&target, 0, sizeof(target));
+	if (differential) {
+		#if defined(HAVE_MULTI_DEVICE)
+		// -m names this board's own manifest, wherever it's plugged in
+		manifest_init(&manifest, manifest_filename ? NULL : teensy_path());
+		#else
+		manifest_init(&manifest, NULL);
+		#endif
+		target.manifest = &manifest;
+	}
 	printf_verbose("Programming");
 	fflush(stdout);
+	if (!program_target(&target)) die("%s\n", target.error);
+	printf_verbose("\n");
+	if (differential) printf_verbose("Skipped %d unchanged blocks\n", target.skipped);
+	if (reboot_after_programming) printf_verbose("Booting\n");
+	teensy_close();
+	return 0;
+}
+
+static int target_write(struct target *t, void *buf, int len, double timeout, int queue)
+{
+	#if defined(HAVE_MULTI_DEVICE)
+	if (t->dev) {
+		if (queue) return loader_write_async(t->dev, buf, len, timeout);
+		return loader_write(t->dev, buf, len, timeout);
+	}
+	#endif
+	if (queue) return teensy_write_async(buf, len, timeout);
+	return teensy_write(buf, len, timeout);
+}
+
+static int target_write_finish(struct target *t)
+{
+	#if defined(HAVE_MULTI_DEVICE)
+	if (t->dev) return loader_write_finish(t->dev);
+	#endif
+	return teensy_write_finish();
+}
+
+// Returns 0 with t->error set on failure, rather than exiting, as
+// there may be other devices still going
+int program_target(struct target *t)
+{
+	unsigned char buf[260];
+	int addr, r, total=0, first_block=1;
+	uint64_t hash=0;
+
+	for (addr = 0; addr < code_size; addr += block_size) {
+		if (addr == 0 || image_bytes_within_range(addr, addr + block_size - 1)) total++;
+	}
+	t->total = total;
+
+	// with -d, find out what the device should already have, and make
+	// sure a flash that doesn't finish leaves nothing to trust
+	if (t->manifest) {
+		manifest_load(t->manifest);
+		manifest_invalidate(t->manifest);
+	}
+
+	// program the data
 	for (addr = 0; addr < code_size; addr += block_size) {
-		if (addr > 0 && !ihex_bytes_within_range(addr, addr + block_size - 1)) {
+		if (addr > 0 && !image_bytes_within_range(addr, addr + block_size - 1)) {
 			// don't waste time on blocks that are unused,
 			// but always do the first one to erase the chip
 			continue;
 		}
-		printf_verbose(".");
+		if (t->manifest) hash = image_block_hash(addr, block_size);
+		if (t->manifest && !first_block && manifest_has_block(t->manifest, addr, hash)) {
+			// the device already holds exactly this
+			t->skipped++;
+			t->done++;
+			continue;
+		}
+		if (!t->dev) printf_verbose(".");
+		image_get_data(addr, block_size, buf + 2);
 		if (code_size < 0x10000) {
 			buf[0] = addr & 255;
 			buf[1] = (addr >> 8) & 255;
@@ -161,23 +420,33 @@ int main(int argc, char **argv)
 			buf[0] = (addr >> 8) & 255;
 			buf[1] = (addr >> 16) & 255;
 		}
-		ihex_get_data(addr, block_size, buf + 2);
-		r = teensy_write(buf, block_size + 2, first_block ? 3.0 : 0.25);
-		if (!r) die("error writing to Teensy\n");
+		// the first block erases, so it goes alone; after that the
+		// next block is always queued behind the one being written
+		r = target_write(t, buf, block_size + 2, first_block ? 3.0 : 0.25, !first_block);
+		if (!r) {
+			snprintf(t->error, sizeof(t->error), "error writing to Teensy at %05X", addr);
+			return 0;
+		}
+		if (t->manifest) manifest_set_block(t->manifest, addr, hash);
 		first_block = 0;
+		t->done++;
 	}
-	printf_verbose("\n");
+	if (!target_write_finish(t)) {
+		snprintf(t->error, sizeof(t->error), "error writing to Teensy");
+		return 0;
+	}
+	if (t->manifest && !manifest_save(t->manifest))
+		printf_verbose("Unable to save manifest for %s; next flash will be full\n",
+			t->name[0] ? t->name : "device");
 
 	// reboot to the user's new code
 	if (reboot_after_programming) {
-		printf_verbose("Booting\n");
 		buf[0] = 0xFF;
 		buf[1] = 0xFF;
 		memset(buf + 2, 0, sizeof(buf) - 2);
-		teensy_write(buf, block_size + 2, 0.25);
+		target_write(t, buf, block_size + 2, 0.25, 0);
 	}
-	teensy_close();
-	return 0;
+	return 1;
 }
 
 
@@ -253,10 +522,7 @@ static usb_dev_handle *libusb_teensy_handle = NULL;
 int teensy_open(void)
 {
 	teensy_close();
-	libusb_teensy_handle = open_usb_device(USBEMANI_VID, USBEMANI_PID_KOC);
-
-	if (!libusb_teensy_handle)
-		libusb_teensy_handle = open_usb_device(USBEMANI_VID, USBEMANI_PID_DAO);
+	libusb_teensy_handle = open_usb_device(LOADER_VID, LOADER_PID);
 
 	if (!libusb_teensy_handle) return 0;
 	return 1;
@@ -292,7 +558,7 @@ int hard_reboot(void)
 		rebootor = open_usb_device(USBEMANI_VID, USBEMANI_PID_DAO);
 
 	if (!rebootor) return 0;
-	r = usb_control_msg(rebootor, 0x21, 9, 0x0200, 0, "reboot", 6, 100);
+	r = usb_control_msg(rebootor, 0x21, 9, 0x0200, 0, (char *)reboot_command, sizeof(reboot_command), 100);
 	usb_release_interface(rebootor, 0);
 	usb_close(rebootor);
 	if (r < 0) return 0;
@@ -302,6 +568,527 @@ int hard_reboot(void)
 #endif
 
 
+/****************************************************************/
+/*                                                              */
+/*                  USB Access - libusb-1.0                     */
+/*                                                              */
+/****************************************************************/
+
+#if defined(USE_LIBUSB1)
+
+// http://libusb.info/
+#include <libusb.h>
+#include <sys/time.h>
+
+// Blocks in flight at once: one being written, one waiting behind it
+#define PIPELINE_DEPTH 2
+
+struct loader_device {
+	libusb_device_handle *handle;
+	char path[32];
+	volatile int in_flight;
+	volatile int failed;
+	volatile int completed;		// a write finished since we last looked
+};
+
+static libusb_context *libusb1_context = NULL;
+static struct loader_device *teensy_device = NULL;
+
+static int is_bootloader(libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+
+	if (libusb_get_device_descriptor(dev, &desc) < 0) return 0;
+	return desc.idVendor == LOADER_VID && desc.idProduct == LOADER_PID;
+}
+
+static int is_usbemani(libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+
+	if (libusb_get_device_descriptor(dev, &desc) < 0) return 0;
+	return desc.idVendor == USBEMANI_VID &&
+		(desc.idProduct == USBEMANI_PID_KOC || desc.idProduct == USBEMANI_PID_DAO);
+}
+
+static struct loader_device * open_usb_device1(libusb_device *dev)
+{
+	struct loader_device *d;
+	uint8_t ports[8];
+	int i, n, len;
+
+	d = calloc(1, sizeof(*d));
+	if (!d) return NULL;
+	if (libusb_open(dev, &d->handle) < 0) {
+		printf_verbose("Found device but unable to open");
+		free(d);
+		return NULL;
+	}
+	libusb_set_auto_detach_kernel_driver(d->handle, 1);
+	if (libusb_claim_interface(d->handle, 0) < 0) {
+		libusb_close(d->handle);
+		free(d);
+		printf_verbose("Unable to claim interface, check USB permissions");
+		return NULL;
+	}
+	// bus and port path, the same as the kernel's: 1-2.4
+	len = snprintf(d->path, sizeof(d->path), "%d", libusb_get_bus_number(dev));
+	n = libusb_get_port_numbers(dev, ports, sizeof(ports));
+	for (i = 0; i < n && len < (int)sizeof(d->path); i++)
+		len += snprintf(d->path + len, sizeof(d->path) - len, "%c%d", i ? '.' : '-', ports[i]);
+	return d;
+}
+
+int loader_find_all(struct loader_device **list, int max)
+{
+	libusb_device **devs;
+	struct loader_device *d;
+	ssize_t n;
+	int i, count = 0;
+
+	if (!libusb1_context && libusb_init(&libusb1_context) < 0) return 0;
+	n = libusb_get_device_list(libusb1_context, &devs);
+	for (i = 0; i < n && count < max; i++) {
+		if (!is_bootloader(devs[i])) continue;
+		d = open_usb_device1(devs[i]);
+		if (d) list[count++] = d;
+	}
+	if (n >= 0) libusb_free_device_list(devs, 1);
+	return count;
+}
+
+const char *loader_path(struct loader_device *d)
+{
+	return d->path;
+}
+
+int loader_write(struct loader_device *d, void *buf, int len, double timeout)
+{
+	int r;
+
+	r = libusb_control_transfer(d->handle, 0x21, 9, 0x0200, 0,
+		(unsigned char *)buf, len, (int)(timeout * 1000.0));
+	if (r < 0) return 0;
+	return 1;
+}
+
+// This may run on whichever thread is handling events, so the counts
+// it touches are only ever changed atomically.
+static void LIBUSB_CALL write_done(struct libusb_transfer *transfer)
+{
+	struct loader_device *d = transfer->user_data;
+
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED) d->failed = 1;
+	__sync_fetch_and_sub(&d->in_flight, 1);
+	__sync_lock_test_and_set(&d->completed, 1);
+}
+
+// Every device's thread waits on the one context, and only one of them
+// handles events at a time. The flag is cleared before in_flight is
+// looked at, so a write finishing on another thread in between is never
+// missed: libusb checks the flag before sleeping, and again whenever the
+// thread that was handling events lets go.
+static int wait_for_writes(struct loader_device *d, int most)
+{
+	while (1) {
+		__sync_lock_test_and_set(&d->completed, 0);
+		if (d->in_flight <= most) return 1;
+		if (libusb_handle_events_completed(libusb1_context, (int *)&d->completed) < 0) return 0;
+	}
+}
+
+int loader_write_async(struct loader_device *d, void *buf, int len, double timeout)
+{
+	struct libusb_transfer *transfer;
+	unsigned char *setup;
+
+	if (d->failed) return 0;
+	if (!wait_for_writes(d, PIPELINE_DEPTH - 1)) return 0;
+	if (d->failed) return 0;
+
+	// the transfer owns a copy, so the caller can fill buf again
+	setup = malloc(LIBUSB_CONTROL_SETUP_SIZE + len);
+	transfer = libusb_alloc_transfer(0);
+	if (!setup || !transfer) {
+		free(setup);
+		libusb_free_transfer(transfer);
+		return 0;
+	}
+	libusb_fill_control_setup(setup, 0x21, 9, 0x0200, 0, len);
+	memcpy(setup + LIBUSB_CONTROL_SETUP_SIZE, buf, len);
+	libusb_fill_control_transfer(transfer, d->handle, setup,
+		write_done, d, (unsigned int)(timeout * 1000.0));
+	transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER | LIBUSB_TRANSFER_FREE_TRANSFER;
+	__sync_fetch_and_add(&d->in_flight, 1);
+	if (libusb_submit_transfer(transfer) < 0) {
+		__sync_fetch_and_sub(&d->in_flight, 1);
+		libusb_free_transfer(transfer);
+		return 0;
+	}
+	return 1;
+}
+
+int loader_write_finish(struct loader_device *d)
+{
+	if (!wait_for_writes(d, 0)) return 0;
+	return !d->failed;
+}
+
+void loader_close(struct loader_device *d)
+{
+	loader_write_finish(d);
+	libusb_release_interface(d->handle, 0);
+	libusb_close(d->handle);
+	free(d);
+}
+
+int teensy_open(void)
+{
+	teensy_close();
+	return loader_find_all(&teensy_device, 1);
+}
+
+const char *teensy_path(void)
+{
+	if (!teensy_device) return NULL;
+	return loader_path(teensy_device);
+}
+
+int teensy_write(void *buf, int len, double timeout)
+{
+	if (!teensy_device) return 0;
+	return loader_write(teensy_device, buf, len, timeout);
+}
+
+int teensy_write_async(void *buf, int len, double timeout)
+{
+	if (!teensy_device) return 0;
+	return loader_write_async(teensy_device, buf, len, timeout);
+}
+
+int teensy_write_finish(void)
+{
+	if (!teensy_device) return 0;
+	return loader_write_finish(teensy_device);
+}
+
+static int LIBUSB_CALL device_arrived(libusb_context *ctx, libusb_device *dev,
+	libusb_hotplug_event event, void *user_data)
+{
+	*(int *)user_data = 1;
+	return 1;	// one is all we wait for, so deregister
+}
+
+void teensy_wait_for_device(double timeout)
+{
+	libusb_hotplug_callback_handle callback;
+	struct timeval tv, now, end;
+	int arrived = 0;
+
+	if (!libusb1_context && libusb_init(&libusb1_context) < 0) {
+		delay(0.25);
+		return;
+	}
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)
+	  || libusb_hotplug_register_callback(libusb1_context, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+		0, LOADER_VID, LOADER_PID, LIBUSB_HOTPLUG_MATCH_ANY,
+		device_arrived, &arrived, &callback) != LIBUSB_SUCCESS) {
+		delay(0.25);
+		return;
+	}
+
+	gettimeofday(&end, NULL);
+	end.tv_sec += (int)timeout;
+	end.tv_usec += (int)((timeout - (int)timeout) * 1000000.0);
+	if (end.tv_usec >= 1000000) {
+		end.tv_sec++;
+		end.tv_usec -= 1000000;
+	}
+	while (!arrived) {
+		gettimeofday(&now, NULL);
+		if (!timercmp(&now, &end, <)) break;
+		timersub(&end, &now, &tv);
+		libusb_handle_events_timeout_completed(libusb1_context, &tv, &arrived);
+	}
+	if (!arrived) libusb_hotplug_deregister_callback(libusb1_context, callback);
+}
+
+void teensy_close(void)
+{
+	if (!teensy_device) return;
+	loader_close(teensy_device);
+	teensy_device = NULL;
+}
+
+// Every USBemani board running its firmware is sent to its bootloader,
+// which -a then finds along with any that were there already
+int hard_reboot(void)
+{
+	libusb_device **devs;
+	struct loader_device *rebootor;
+	ssize_t n;
+	int i, r, count = 0;
+
+	if (!libusb1_context && libusb_init(&libusb1_context) < 0) return 0;
+	n = libusb_get_device_list(libusb1_context, &devs);
+	for (i = 0; i < n; i++) {
+		if (!is_usbemani(devs[i])) continue;
+		// the generic interface, which takes our output reports, is always 0
+		rebootor = open_usb_device1(devs[i]);
+		if (!rebootor) continue;
+		r = libusb_control_transfer(rebootor->handle, 0x21, 9, 0x0200, 0,
+			reboot_command, sizeof(reboot_command), 100);
+		if (r >= 0) {
+			reboot_note_port(rebootor->path);
+			count++;
+		}
+		loader_close(rebootor);
+		if (!all_devices) break;
+	}
+	if (n >= 0) libusb_free_device_list(devs, 1);
+	return count;
+}
+
+#endif
+
+
+/****************************************************************/
+/*                                                              */
+/*                     USB Access - Mock                        */
+/*                                                              */
+/****************************************************************/
+
+#if defined(USE_MOCK)
+
+// Pretend bootloaders, for testing without hardware. Set with:
+//   USEMANI_MOCK_DEVICES     how many there are (default 1)
+//   USEMANI_MOCK_LATENCY_MS  how long each block takes to write, as a
+//                            page erase and write does (default 4);
+//                            each device after the first is 10% slower
+//   USEMANI_MOCK_FAIL_AT     fail this block, counting from 1...
+//   USEMANI_MOCK_FAIL_DEVICE ...on this device, counting from 0
+//   USEMANI_MOCK_IMAGE       save each flash here on close, with the
+//                            device path on the end if there are several
+// A synchronous write also loses the rest of a frame before the next
+// one can start, which a queued one doesn't.
+#include <sys/time.h>
+
+#define PIPELINE_DEPTH 2
+#define MOCK_MAX_DEVICES 64
+
+struct loader_device {
+	char path[32];
+	int index;
+	double latency, busy_until;
+	int in_flight, writes, fail_at, failed;
+	unsigned char flash[0x20000];
+};
+
+static int mock_devices = 1;
+static struct loader_device *teensy_device = NULL;
+
+static double mock_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// The bootloader erases and writes the page each block lands in
+static int mock_block(struct loader_device *d, unsigned char *buf, int len)
+{
+	int addr;
+
+	if (++d->writes == d->fail_at) return 0;
+	if (buf[0] == 0xFF && buf[1] == 0xFF) return 1;	// reboot
+	if (code_size < 0x10000) addr = buf[0] | (buf[1] << 8);
+	else addr = (buf[0] << 8) | (buf[1] << 16);
+	if (addr + len - 2 > (int)sizeof(d->flash)) return 0;
+	memcpy(d->flash + addr, buf + 2, len - 2);
+	return 1;
+}
+
+// Let time pass until everything queued up to now would be finished
+static void mock_settle(struct loader_device *d)
+{
+	double left = d->busy_until - mock_now();
+
+	if (left > 0) delay(left);
+	d->in_flight = 0;
+}
+
+int loader_find_all(struct loader_device **list, int max)
+{
+	const char *env;
+	double latency = 0.004;
+	int i, fail_at = 0, fail_device = 0;
+
+	if ((env = getenv("USEMANI_MOCK_DEVICES"))) mock_devices = atoi(env);
+	if ((env = getenv("USEMANI_MOCK_LATENCY_MS"))) latency = atof(env) / 1000.0;
+	if ((env = getenv("USEMANI_MOCK_FAIL_AT"))) fail_at = atoi(env);
+	if ((env = getenv("USEMANI_MOCK_FAIL_DEVICE"))) fail_device = atoi(env);
+	if (mock_devices > MOCK_MAX_DEVICES) mock_devices = MOCK_MAX_DEVICES;
+
+	for (i = 0; i < mock_devices && i < max; i++) {
+		struct loader_device *d = calloc(1, sizeof(*d));
+		if (!d) break;
+		snprintf(d->path, sizeof(d->path), "1-%d", i + 1);
+		d->index = i;
+		d->latency = latency * (1.0 + 0.1 * i);
+		d->fail_at = (i == fail_device) ? fail_at : 0;
+		memset(d->flash, 0xFF, sizeof(d->flash));
+		list[i] = d;
+	}
+	return i;
+}
+
+const char *loader_path(struct loader_device *d)
+{
+	return d->path;
+}
+
+int loader_write(struct loader_device *d, void *buf, int len, double timeout)
+{
+	mock_settle(d);
+	delay(d->latency + 0.001);
+	return mock_block(d, buf, len);
+}
+
+int loader_write_async(struct loader_device *d, void *buf, int len, double timeout)
+{
+	double start;
+
+	if (d->failed) return 0;
+	if (d->in_flight >= PIPELINE_DEPTH) {
+		// wait for the oldest to finish
+		double left = d->busy_until - d->latency - mock_now();
+		if (left > 0) delay(left);
+		d->in_flight--;
+	}
+	start = d->busy_until > mock_now() ? d->busy_until : mock_now();
+	d->busy_until = start + d->latency;
+	d->in_flight++;
+	if (!mock_block(d, buf, len)) d->failed = 1;
+	return !d->failed;
+}
+
+int loader_write_finish(struct loader_device *d)
+{
+	mock_settle(d);
+	return !d->failed;
+}
+
+void loader_close(struct loader_device *d)
+{
+	const char *image = getenv("USEMANI_MOCK_IMAGE");
+	char name[1100];
+	FILE *fp;
+
+	mock_settle(d);
+	if (image) {
+		if (mock_devices > 1) snprintf(name, sizeof(name), "%s.%s", image, d->path);
+		else snprintf(name, sizeof(name), "%s", image);
+		if ((fp = fopen(name, "wb"))) {
+			fwrite(d->flash, 1, code_size, fp);
+			fclose(fp);
+		}
+	}
+	free(d);
+}
+
+int teensy_open(void)
+{
+	teensy_close();
+	return loader_find_all(&teensy_device, 1);
+}
+
+const char *teensy_path(void)
+{
+	if (!teensy_device) return NULL;
+	return loader_path(teensy_device);
+}
+
+int teensy_write(void *buf, int len, double timeout)
+{
+	if (!teensy_device) return 0;
+	return loader_write(teensy_device, buf, len, timeout);
+}
+
+int teensy_write_async(void *buf, int len, double timeout)
+{
+	if (!teensy_device) return 0;
+	return loader_write_async(teensy_device, buf, len, timeout);
+}
+
+int teensy_write_finish(void)
+{
+	if (!teensy_device) return 0;
+	return loader_write_finish(teensy_device);
+}
+
+void teensy_wait_for_device(double timeout)
+{
+	delay(timeout);
+}
+
+void teensy_close(void)
+{
+	if (!teensy_device) return;
+	printf_verbose("Mock: %d blocks written\n", teensy_device->writes);
+	loader_close(teensy_device);
+	teensy_device = NULL;
+}
+
+// Each pretend board comes back as a bootloader on the port it was on
+int hard_reboot(void)
+{
+	const char *env = getenv("USEMANI_MOCK_DEVICES");
+	char path[32];
+	int i, n;
+
+	if (env) mock_devices = atoi(env);
+	if (mock_devices > MOCK_MAX_DEVICES) mock_devices = MOCK_MAX_DEVICES;
+	printf_verbose("Mock: command %02X %02X to %d device%s\n", reboot_command[2],
+		reboot_command[3], mock_devices, mock_devices == 1 ? "" : "s");
+	n = all_devices ? mock_devices : 1;
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "1-%d", i + 1);
+		reboot_note_port(path);
+	}
+	return n;
+}
+
+#endif
+
+
+/****************************************************************/
+/*                                                              */
+/*                   USB Access - Synchronous                   */
+/*                                                              */
+/****************************************************************/
+
+#if !defined(USE_LIBUSB1) && !defined(USE_MOCK)
+
+// Everything else writes one block at a time, and polls for devices
+int teensy_write_async(void *buf, int len, double timeout)
+{
+	return teensy_write(buf, len, timeout);
+}
+
+int teensy_write_finish(void)
+{
+	return 1;
+}
+
+void teensy_wait_for_device(double timeout)
+{
+	delay(0.25);
+}
+
+#endif
+
+
 /****************************************************************/
 /*                                                              */
 /*               USB Access - Microsoft WIN32                   */
@@ -438,10 +1225,8 @@ int hard_reboot(void)
 	if (!rebootor)
 		rebootor = open_usb_device(USBEMANI_VID, USBEMANI_PID_DAO);
 
-	uint8_t buf[4] = {0xFF, 0xFF, 0xFF, 0xFF};
-
 	if (!rebootor) return 0;
-	r = write_usb_device(rebootor, &buf, 4, 100);
+	r = write_usb_device(rebootor, reboot_command, sizeof(reboot_command), 100);
 	CloseHandle(rebootor);
 	return r;
 }
@@ -632,14 +1417,9 @@ int hard_reboot(void)
 	if (!rebootor)
 		rebootor = open_usb_device(USBEMANI_VID, USBEMANI_PID_DAO);
 
-	if (!rebootor)
-		rebootor = open_usb_device(0x03eb, 0x2067);
-
-	uint8_t buf[4] = {0xFF, 0xFF, 0xFF, 0xFF};
-
 	if (!rebootor) return 0;
 	ret = IOHIDDeviceSetReport(rebootor,
-		kIOHIDReportTypeOutput, 0, buf, 4);
+		kIOHIDReportTypeOutput, 0, reboot_command, sizeof(reboot_command));
 	close_usb_device(rebootor);
 	if (ret == kIOReturnSuccess) return 1;
 	return 0;
@@ -712,13 +1492,10 @@ int open_usb_device(int vid, int pid)
 
 static int uhid_teensy_fd = -1;
 
-int teensy_open(void)Set
+int teensy_open(void)
 {
 	teensy_close();
-	uhid_teensy_fd = open_usb_device(USBEMANI_VID, USBEMANI_PID_KOC);
-
-	if (uhid_teensy_fd < 0)
-		uhid_teensy_fd = open_usb_device(USBEMANI_VID, USBEMANI_PID_DAO);
+	uhid_teensy_fd = open_usb_device(LOADER_VID, LOADER_PID);
 
 	if (uhid_teensy_fd < 0) return 0;
 	return 1;
@@ -752,10 +1529,9 @@ int hard_reboot(void)
 		rebootor_fd = open_usb_device(USBEMANI_VID, USBEMANI_PID_DAO);
 
 	if (rebootor_fd < 0) return 0;
-	r = write(rebootor_fd, "reboot", 6);
-	delay(0.1);
+	r = write(rebootor_fd, reboot_command, sizeof(reboot_command));
 	close(rebootor_fd);
-	if (r == 6) return 1;
+	if (r == sizeof(reboot_command)) return 1;
 	return 0;
 }
 
@@ -765,164 +1541,156 @@ int hard_reboot(void)
 
 /****************************************************************/
 /*                                                              */
-/*                     Read Intel Hex File                      */
+/*                   Differential Flashing                      */
 /*                                                              */
 /****************************************************************/
 
-// the maximum flash image size we can support
-// chips with larger memory may be used, but only this
-// much intel-hex data can be loaded into memory!
-#define MAX_MEMORY_SIZE 0x10000
+// The manifest is a list of block hashes for what was last flashed,
+// so blocks the device already holds can be skipped. The bootloader
+// erases and writes one page per block, so a skipped block keeps what
+// it had. A block is only listed once its write has succeeded, and the
+// file is marked incomplete before the first write of every flash, so
+// a flash that dies part way leaves a manifest that is ignored: the
+// next flash is a full one. Anything wrong with the file, or a
+// different chip, means the same. A device flashed by some other tool
+// isn't something the manifest can know about, so don't use -d after
+// one without deleting the manifest first.
+//
+// A USB path names a port, not a board, and boards get moved between
+// ports. A manifest named after one is only trusted when this run sent
+// the board on that port to its bootloader with -r; a bootloader that
+// was already there, or turned up some other way, gets everything. That
+// still can't tell two boards apart that swapped ports since the last
+// flash, so with boards being moved around, give each its own -m.
+
+#define MANIFEST_MAGIC "usemani-flash-manifest 1"
+
+// Every device has its own, named after where it's plugged in. Without
+// a path, -m names the file for this one board: backends that can't
+// tell devices apart refuse -d without it.
+void manifest_init(struct manifest *m, const char *device_path)
+{
+	const char *home = getenv("HOME");
 
-static unsigned char firmware_image[MAX_MEMORY_SIZE];
-static unsigned char firmware_mask[MAX_MEMORY_SIZE];
-static int end_record_seen=0;
-static int byte_count;
-static unsigned int extended_addr = 0;
-static int parse_hex_line(char *line);
+	memset(m->valid, 0, sizeof(m->valid));
+	#if defined(HAVE_MULTI_DEVICE)
+	m->trusted = !device_path || reboot_was_port(device_path);
+	#else
+	m->trusted = !device_path;
+	#endif
+	if (manifest_filename && device_path)
+		snprintf(m->path, sizeof(m->path), "%s.%s", manifest_filename, device_path);
+	else if (manifest_filename)
+		snprintf(m->path, sizeof(m->path), "%s", manifest_filename);
+	else if (device_path)
+		snprintf(m->path, sizeof(m->path), "%s/.usemani-flash-%s.manifest", home ? home : ".", device_path);
+	else
+		snprintf(m->path, sizeof(m->path), "%s/.usemani-flash.manifest", home ? home : ".");
+}
 
-int read_intel_hex(const char *filename)
+void manifest_load(struct manifest *m)
 {
 	FILE *fp;
-	int i, lineno=0;
-	char buf[1024];
-
-	byte_count = 0;
-	end_record_seen = 0;
-	for (i=0; i<MAX_MEMORY_SIZE; i++) {
-		firmware_image[i] = 0xFF;
-		firmware_mask[i] = 0;
+	char line[256];
+	unsigned int addr;
+	unsigned long long hash;
+	int size, block, complete=0;
+
+	memset(m->valid, 0, sizeof(m->valid));
+	if (!m->trusted) {
+		printf_verbose("Not rebooted here, so no telling which board this is; flashing everything\n");
+		return;
 	}
-	extended_addr = 0;
-
-	fp = fopen(filename, "r");
+	fp = fopen(m->path, "r");
 	if (fp == NULL) {
-		//printf("Unable to read file %s\n", filename);
-		return -1;
-	}
-	while (!feof(fp)) {
-		*buf = '\0';
-		if (!fgets(buf, sizeof(buf), fp)) break;
-		lineno++;
-		if (*buf) {
-			if (parse_hex_line(buf) == 0) {
-				//printf("Warning, parse error line %d\n", lineno);
-				fclose(fp);
-				return -2;
-			}
-		}
-		if (end_record_seen) break;
-		if (feof(stdin)) break;
+		printf_verbose("No manifest, flashing everything\n");
+		return;
 	}
-	fclose(fp);
-	return byte_count;
-}
-
-
-/* from ihex.c, at http://www.pjrc.com/tech/8051/pm2_docs/intel-hex.html */
-
-/* parses a line of intel hex code, stores the data in bytes[] */
-/* and the beginning address in addr, and returns a 1 if the */
-/* line was valid, or a 0 if an error occurred.  The variable */
-/* num gets the number of bytes that were stored into bytes[] */
-
-
-int
-parse_hex_line(char *line)
-{
-	int addr, code, num;
-        int sum, len, cksum, i;
-        char *ptr;
-
-        num = 0;
-        if (line[0] != ':') return 0;
-        if (strlen(line) < 11) return 0;
-        ptr = line+1;
-        if (!sscanf(ptr, "%02x", &len)) return 0;
-        ptr += 2;
-        if ((int)strlen(line) < (11 + (len * 2)) ) return 0;
-        if (!sscanf(ptr, "%04x", &addr)) return 0;
-        ptr += 4;
-          /* printf("Line: length=%d Addr=%d\n", len, addr); */
-        if (!sscanf(ptr, "%02x", &code)) return 0;
-	if (addr + extended_addr + len >= MAX_MEMORY_SIZE) return 0;
-        ptr += 2;
-        sum = (len & 255) + ((addr >> 8) & 255) + (addr & 255) + (code & 255);
-	if (code != 0) {
-		if (code == 1) {
-			end_record_seen = 1;
-			return 1;
-		}
-		if (code == 2 && len == 2) {
-			if (!sscanf(ptr, "%04x", &i)) return 1;
-			ptr += 4;
-			sum += ((i >> 8) & 255) + (i & 255);
-        		if (!sscanf(ptr, "%02x", &cksum)) return 1;
-			if (((sum & 255) + (cksum & 255)) & 255) return 1;
-			extended_addr = i << 4;
-			//printf("ext addr = %05X\n", extended_addr);
+	if (!fgets(line, sizeof(line), fp) || strncmp(line, MANIFEST_MAGIC, strlen(MANIFEST_MAGIC))
+	  || !fgets(line, sizeof(line), fp) || sscanf(line, "mcu %d %d", &size, &block) != 2
+	  || size != code_size || block != block_size
+	  || !fgets(line, sizeof(line), fp) || strcmp(line, "complete\n")) {
+		printf_verbose("Manifest is stale, flashing everything\n");
+		fclose(fp);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%x %llx", &addr, &hash) != 2) {
+			complete = -1;
+			break;
 		}
-		if (code == 4 && len == 2) {
-			if (!sscanf(ptr, "%04x", &i)) return 1;
-			ptr += 4;
-			sum += ((i >> 8) & 255) + (i & 255);
-        		if (!sscanf(ptr, "%02x", &cksum)) return 1;
-			if (((sum & 255) + (cksum & 255)) & 255) return 1;
-			extended_addr = i << 16;
-			//printf("ext addr = %08X\n", extended_addr);
+		if (addr % block_size || addr >= MAX_MEMORY_SIZE) {
+			complete = -1;
+			break;
 		}
-		return 1;	// non-data line
-	}
-	byte_count += len;
-        while (num != len) {
-                if (sscanf(ptr, "%02x", &i) != 1) return 0;
-		i &= 255;
-		firmware_image[addr + extended_addr + num] = i;
-		firmware_mask[addr + extended_addr + num] = 1;
-                ptr += 2;
-                sum += i;
-                (num)++;
-                if (num >= 256) return 0;
-        }
-        if (!sscanf(ptr, "%02x", &cksum)) return 0;
-        if (((sum & 255) + (cksum & 255)) & 255) return 0; /* checksum error */
-        return 1;
-}
-
-int ihex_bytes_within_range(int begin, int end)
-{
-	int i;
-
-	if (begin < 0 || begin >= MAX_MEMORY_SIZE ||
-	   end < 0 || end >= MAX_MEMORY_SIZE) {
-		return 0;
+		m->hash[addr / block_size] = hash;
+		m->valid[addr / block_size] = 1;
+		complete = 1;
 	}
-	for (i=begin; i<=end; i++) {
-		if (firmware_mask[i]) return 1;
+	fclose(fp);
+	if (complete < 0) {
+		printf_verbose("Manifest is damaged, flashing everything\n");
+		memset(m->valid, 0, sizeof(m->valid));
 	}
-	return 0;
 }
 
-void ihex_get_data(int addr, int len, unsigned char *bytes)
+// Mark the manifest as incomplete on disk, keeping what we loaded in
+// memory. If it can't be, a flash that dies part way would leave the
+// old one to be trusted, so nothing loaded is used.
+void manifest_invalidate(struct manifest *m)
 {
-	int i;
+	FILE *fp = fopen(m->path, "w");
 
-	if (addr < 0 || len < 0 || addr + len >= MAX_MEMORY_SIZE) {
-		for (i=0; i<len; i++) {
-			bytes[i] = 255;
-		}
-		return;
+	if (fp != NULL) {
+		fprintf(fp, "%s\nmcu %d %d\nincomplete\n", MANIFEST_MAGIC, code_size, block_size);
+		if (fclose(fp) == 0) return;
 	}
-	for (i=0; i<len; i++) {
-		if (firmware_mask[addr]) {
-			bytes[i] = firmware_image[addr];
-		} else {
-			bytes[i] = 255;
-		}
-		addr++;
+	printf_verbose("Unable to mark the manifest incomplete, flashing everything\n");
+	memset(m->valid, 0, sizeof(m->valid));
+}
+
+// Hashes are image_block_hash(), a 64 bit FNV-1a; a changed block is
+// never going to collide by chance
+int manifest_has_block(struct manifest *m, int addr, uint64_t hash)
+{
+	int block = addr / block_size;
+
+	if (block >= MAX_BLOCKS || !m->valid[block]) return 0;
+	return m->hash[block] == hash;
+}
+
+void manifest_set_block(struct manifest *m, int addr, uint64_t hash)
+{
+	int block = addr / block_size;
+
+	if (block >= MAX_BLOCKS) return;
+	m->hash[block] = hash;
+	m->valid[block] = 1;
+}
+
+// Written to a temporary file first, so it's either all there or not at all
+int manifest_save(struct manifest *m)
+{
+	char tmp[sizeof(m->path) + 4];
+	FILE *fp;
+	int block;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", m->path);
+	fp = fopen(tmp, "w");
+	if (fp == NULL) return 0;
+	fprintf(fp, "%s\nmcu %d %d\ncomplete\n", MANIFEST_MAGIC, code_size, block_size);
+	for (block=0; block < MAX_BLOCKS && block * block_size < code_size; block++) {
+		if (m->valid[block])
+			fprintf(fp, "%05X %016llX\n", block * block_size, (unsigned long long)m->hash[block]);
 	}
+	if (fclose(fp) != 0) return 0;
+	#ifdef WIN32
+	remove(m->path);
+	#endif
+	return rename(tmp, m->path) == 0;
 }
 
+
 /****************************************************************/
 /*                                                              */
 /*                       Misc Functions                         */
@@ -983,6 +1751,12 @@ void parse_options(int argc, char **argv)
 				reboot_after_programming = 0;
 			} else if (strcmp(arg, "-v") == 0) {
 				verbose = 1;
+			} else if (strcmp(arg, "-d") == 0) {
+				differential = 1;
+			} else if (strcmp(arg, "-a") == 0) {
+				all_devices = 1;
+			} else if (strncmp(arg, "-m=", 3) == 0) {
+				manifest_filename = arg + 3;
 			} else if (strncmp(arg, "-mmcu=", 6) == 0) {
 				arg += 6;
 
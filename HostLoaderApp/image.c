@@ -0,0 +1,325 @@
+/* Firmware image loading, shared by hid_bootloader_cli and the
+ * Win32 config utility.
+ *
+ * Derived from the Intel hex reader in the Teensy Loader, Command
+ * Line Interface, Copyright 2008-2010, PJRC.COM, LLC, and under the
+ * same GNU General Public License, version 3.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+
+#define NUM_PAGES (MAX_MEMORY_SIZE / IMAGE_PAGE_SIZE)
+
+// Only pages with data in them exist; the rest of flash reads as
+// erased. A firmware is a few KB in a 32 KB or 128 KB part, so this
+// is a handful of pages rather than a full image and mask to clear
+// and search on every load.
+struct image_page {
+	unsigned char data[IMAGE_PAGE_SIZE];
+	unsigned char mask[IMAGE_PAGE_SIZE / 8];
+};
+
+static struct image_page *pages[NUM_PAGES];
+static int byte_count;
+
+static void image_clear(void)
+{
+	int i;
+
+	for (i=0; i<NUM_PAGES; i++) {
+		free(pages[i]);
+		pages[i] = NULL;
+	}
+	byte_count = 0;
+}
+
+static int image_put(unsigned int addr, const unsigned char *bytes, int len)
+{
+	struct image_page *p;
+	int i, offset;
+
+	// in this order, so nothing here can wrap around
+	if (len < 0 || addr > MAX_MEMORY_SIZE || (unsigned int)len > MAX_MEMORY_SIZE - addr) return 0;
+	for (i=0; i<len; i++, addr++) {
+		p = pages[addr / IMAGE_PAGE_SIZE];
+		if (!p) {
+			p = malloc(sizeof(*p));
+			if (!p) return 0;
+			memset(p->data, 0xFF, sizeof(p->data));
+			memset(p->mask, 0, sizeof(p->mask));
+			pages[addr / IMAGE_PAGE_SIZE] = p;
+		}
+		offset = addr % IMAGE_PAGE_SIZE;
+		p->data[offset] = bytes[i];
+		p->mask[offset / 8] |= 1 << (offset % 8);
+	}
+	byte_count += len;
+	return 1;
+}
+
+// The whole file at once; even a full 128 KB part is well under a
+// megabyte of hex, and it saves parsing around buffer boundaries.
+static unsigned char * read_file(const char *filename, long *size)
+{
+	FILE *fp;
+	unsigned char *buf = NULL, *more;
+	long len = 0, alloc = 0;
+	size_t n;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL) return NULL;
+	while (1) {
+		if (len == alloc) {
+			alloc = alloc ? alloc * 2 : 65536;
+			more = realloc(buf, alloc + 1);
+			if (!more) {
+				free(buf);
+				fclose(fp);
+				return NULL;
+			}
+			buf = more;
+		}
+		n = fread(buf + len, 1, alloc - len, fp);
+		if (n == 0) break;
+		len += n;
+	}
+	fclose(fp);
+	buf[len] = '\0';
+	*size = len;
+	return buf;
+}
+
+
+/****************************************************************/
+/*                                                              */
+/*                       Intel Hex Files                        */
+/*                                                              */
+/****************************************************************/
+
+static signed char hex_digit[256];
+
+static void hex_init(void)
+{
+	int i;
+
+	if (hex_digit['1']) return;
+	memset(hex_digit, -1, sizeof(hex_digit));
+	for (i=0; i<10; i++) hex_digit['0' + i] = i;
+	for (i=0; i<6; i++) {
+		hex_digit['A' + i] = 10 + i;
+		hex_digit['a' + i] = 10 + i;
+	}
+}
+
+// two hex digits, or -1 if they aren't
+static int hex_byte(const unsigned char *p)
+{
+	int hi = hex_digit[p[0]], lo = hex_digit[p[1]];
+
+	if (hi < 0 || lo < 0) return -1;
+	return (hi << 4) | lo;
+}
+
+// One record, with its checksum checked. Returns 0 for a bad one,
+// otherwise 1, or 2 for the end of file record.
+static int parse_hex_line(const unsigned char *line, int len, unsigned int *extended_addr)
+{
+	unsigned char bytes[255 + 5];
+	int i, n, b, sum = 0, addr;
+
+	if (len < 11 || line[0] != ':') return 0;
+	n = hex_byte(line + 1);
+	if (n < 0 || len < 11 + n * 2) return 0;
+	for (i=0; i<n + 5; i++) {
+		b = hex_byte(line + 1 + i * 2);
+		if (b < 0) return 0;
+		bytes[i] = b;
+		sum += b;
+	}
+	if (sum & 255) return 0;	/* checksum error */
+
+	addr = (bytes[1] << 8) | bytes[2];
+	switch (bytes[3]) {
+	case 0:		// data
+		if (*extended_addr > UINT_MAX - addr) return 0;
+		return image_put(*extended_addr + addr, bytes + 4, n);
+	case 1:		// end of file
+		return 2;
+	case 2:		// extended segment address
+		if (n != 2) return 0;
+		*extended_addr = ((bytes[4] << 8) | bytes[5]) << 4;
+		return 1;
+	case 4:		// extended linear address
+		if (n != 2) return 0;
+		*extended_addr = (unsigned int)((bytes[4] << 8) | bytes[5]) << 16;
+		return 1;
+	default:	// start addresses, which don't matter here
+		return 1;
+	}
+}
+
+static int read_hex(unsigned char *buf, long size)
+{
+	unsigned int extended_addr = 0;
+	unsigned char *line = buf, *end;
+	int r;
+
+	hex_init();
+	while (line < buf + size) {
+		end = memchr(line, '\n', buf + size - line);
+		if (!end) end = buf + size;
+		r = end - line;
+		while (r > 0 && (line[r - 1] == '\r' || line[r - 1] == ' ' || line[r - 1] == '\t')) r--;
+		if (r > 0) {
+			r = parse_hex_line(line, r, &extended_addr);
+			if (r == 0) return -2;
+			if (r == 2) break;
+		}
+		line = end + 1;
+	}
+	return byte_count;
+}
+
+
+/****************************************************************/
+/*                                                              */
+/*                          ELF Files                           */
+/*                                                              */
+/****************************************************************/
+
+// Just enough of ELF for what avr-gcc makes: 32 bit, little endian.
+#define EM_AVR 83
+#define PT_LOAD 1
+
+// avr-gcc puts RAM, EEPROM and fuses in its address space above flash
+#define AVR_FLASH_END 0x800000
+
+static unsigned int get16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Loads the segments, not the sections: .data is in a segment whose
+// physical address is where it sits in flash, after .text, while the
+// section itself only gives its address in RAM.
+static int read_elf(unsigned char *buf, long size)
+{
+	unsigned int phoff, phentsize, phnum, i;
+	unsigned int type, offset, paddr, filesz;
+	const unsigned char *ph;
+
+	if (size < 52 || buf[4] != 1 || buf[5] != 1) return -2;	// ELFCLASS32, ELFDATA2LSB
+	if (get16(buf + 18) != EM_AVR) return -2;
+	phoff = get32(buf + 28);
+	phentsize = get16(buf + 42);
+	phnum = get16(buf + 44);
+	if (phentsize < 32 || phoff > (unsigned long)size
+	  || phnum > ((unsigned long)size - phoff) / phentsize) return -2;
+
+	for (i=0; i<phnum; i++) {
+		ph = buf + phoff + i * phentsize;
+		type = get32(ph);
+		offset = get32(ph + 4);
+		paddr = get32(ph + 12);
+		filesz = get32(ph + 16);
+		if (type != PT_LOAD || filesz == 0 || paddr >= AVR_FLASH_END) continue;
+		if (offset > (unsigned long)size || filesz > (unsigned long)size - offset) return -2;
+		if (!image_put(paddr, buf + offset, filesz)) return -2;
+	}
+	return byte_count;
+}
+
+
+/****************************************************************/
+/*                                                              */
+/*                        Image Access                          */
+/*                                                              */
+/****************************************************************/
+
+int read_image(const char *filename)
+{
+	unsigned char *buf;
+	const char *ext;
+	long size;
+	int r;
+
+	image_clear();
+	buf = read_file(filename, &size);
+	if (buf == NULL) return -1;
+
+	ext = strrchr(filename, '.');
+	if (size >= 4 && memcmp(buf, "\177ELF", 4) == 0) {
+		r = read_elf(buf, size);
+	} else if (ext && (strcmp(ext, ".bin") == 0 || strcmp(ext, ".BIN") == 0)) {
+		r = image_put(0, buf, size) ? byte_count : -2;
+	} else {
+		r = read_hex(buf, size);
+	}
+	free(buf);
+	return r;
+}
+
+int image_bytes_within_range(int begin, int end)
+{
+	struct image_page *p;
+	int addr;
+
+	if (begin < 0 || begin >= MAX_MEMORY_SIZE ||
+	   end < 0 || end >= MAX_MEMORY_SIZE) {
+		return 0;
+	}
+	for (addr=begin; addr<=end; addr++) {
+		p = pages[addr / IMAGE_PAGE_SIZE];
+		if (!p) {
+			// nothing anywhere in this page
+			addr |= IMAGE_PAGE_SIZE - 1;
+			continue;
+		}
+		if (p->mask[(addr % IMAGE_PAGE_SIZE) / 8] & (1 << (addr % 8))) return 1;
+	}
+	return 0;
+}
+
+void image_get_data(int addr, int len, unsigned char *bytes)
+{
+	struct image_page *p;
+	int i, n;
+
+	if (addr < 0 || len < 0 || addr + len > MAX_MEMORY_SIZE) {
+		memset(bytes, 255, len > 0 ? len : 0);
+		return;
+	}
+	// bytes a page has never been given are already 0xFF in it
+	for (i=0; i<len; i+=n, addr+=n) {
+		n = IMAGE_PAGE_SIZE - addr % IMAGE_PAGE_SIZE;
+		if (n > len - i) n = len - i;
+		p = pages[addr / IMAGE_PAGE_SIZE];
+		if (p) memcpy(bytes + i, p->data + addr % IMAGE_PAGE_SIZE, n);
+		else memset(bytes + i, 255, n);
+	}
+}
+
+// Straight from the pages, without copying the block out first
+uint64_t image_block_hash(int addr, int len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	struct image_page *p;
+	int i;
+
+	for (i=0; i<len; i++, addr++) {
+		p = (addr >= 0 && addr < MAX_MEMORY_SIZE) ? pages[addr / IMAGE_PAGE_SIZE] : NULL;
+		h ^= p ? p->data[addr % IMAGE_PAGE_SIZE] : 0xFF;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
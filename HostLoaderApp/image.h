@@ -0,0 +1,34 @@
+/* Firmware image loading, shared by hid_bootloader_cli and the
+ * Win32 config utility.
+ *
+ * Derived from the Intel hex reader in the Teensy Loader, Command
+ * Line Interface, Copyright 2008-2010, PJRC.COM, LLC, and under the
+ * same GNU General Public License, version 3.
+ */
+
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <stdint.h>
+
+// the maximum flash image size we can support; only the pages that
+// hold data take any memory, so this covers the biggest parts
+#define MAX_MEMORY_SIZE 0x20000
+
+// the image is kept in pages of this many bytes, the smallest
+// block any of the bootloaders write
+#define IMAGE_PAGE_SIZE 128
+
+// Load an Intel hex file, an ELF file straight from avr-gcc, or a raw
+// binary (by a .bin extension) starting at address 0. Returns the
+// number of bytes loaded, -1 if the file can't be read, or -2 if it
+// isn't valid. Anything loaded before is thrown away first.
+int read_image(const char *filename);
+
+int image_bytes_within_range(int begin, int end);
+void image_get_data(int addr, int len, unsigned char *bytes);
+
+// 64 bit FNV-1a of a block as it would be written, unused bytes as 0xFF
+uint64_t image_block_hash(int addr, int len);
+
+#endif
@@ -0,0 +1,66 @@
+#include "HAL.h"
+#include "Instrument.h"
+
+// Our running numbers. The totals are kept wide, so the average can be worked out when asked for.
+typedef struct {
+	uint16_t Count;
+	uint16_t Min;
+	uint16_t Max;
+	uint32_t Total;
+} InstrumentSlot_t;
+
+volatile InstrumentSlot_t InstrumentSlots[INSTRUMENT_SLOTS];
+
+// Function for initializing our instrumentation. This starts timer 1 running freely at the CPU clock.
+void Instrument_Init(void) {
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);
+
+	Instrument_Reset();
+}
+
+// Function for recording a single run. Each slot is only recorded from one place, either the main loop or its
+// interrupt, but the USB interrupt can read or clear any of them in between, so we hold it off while we update.
+void Instrument_Record(INSTRUMENT_SLOT slot, uint16_t cycles) {
+	volatile InstrumentSlot_t* s = &InstrumentSlots[slot];
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ((s->Count == 0) || (cycles < s->Min)) s->Min = cycles;
+		if (cycles > s->Max)                      s->Max = cycles;
+
+		// If our count is full, we halve everything, so we keep the same average.
+		if (s->Count == 0xFFFF) {
+			s->Count >>= 1;
+			s->Total >>= 1;
+		}
+
+		s->Count++;
+		s->Total += cycles;
+	}
+}
+
+// Function for building the diagnostics report. The interrupts update their slots at any time, so we hold them off while we copy.
+// This is called from the USB interrupt, so we leave the interrupt state as we found it.
+void Instrument_GetReport(Instrument_Report_t* const report) {
+	for (uint8_t i = 0; i < INSTRUMENT_SLOTS; i++) {
+		InstrumentSlot_t s;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) s = InstrumentSlots[i];
+
+		report->Slots[i].Count   = s.Count;
+		report->Slots[i].Min     = s.Min;
+		report->Slots[i].Max     = s.Max;
+		report->Slots[i].Average = (s.Count ? (s.Total / s.Count) : 0);
+	}
+}
+
+// Function for clearing our numbers, at the host's request.
+void Instrument_Reset(void) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for (uint8_t i = 0; i < INSTRUMENT_SLOTS; i++) {
+			InstrumentSlots[i].Count = 0;
+			InstrumentSlots[i].Min   = 0;
+			InstrumentSlots[i].Max   = 0;
+			InstrumentSlots[i].Total = 0;
+		}
+	}
+}
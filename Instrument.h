@@ -0,0 +1,50 @@
+#ifndef _INSTRUMENT_H_
+#define _INSTRUMENT_H_
+
+#include "HAL.h"
+#include "Config/AppConfig.h"
+
+// Everything we time. Each of these gets its own set of numbers in the diagnostics report.
+typedef enum {
+	InstrumentHIDTask = 0,
+	InstrumentUSBTask,
+	InstrumentPS2Load,
+	InstrumentRotaryISR,
+	InstrumentSPIISR,
+	// How long each task waited to run after its first event, as timed by the scheduler.
+	InstrumentHIDLatency,
+	InstrumentUSBLatency,
+	InstrumentPS2Latency,
+	INSTRUMENT_SLOTS
+} INSTRUMENT_SLOT;
+
+/* The Instrument struct. These are the numbers for one slot, in CPU cycles. */
+typedef struct {
+	// How many times this has run. Once this fills up, the count and average are halved, so the average keeps moving.
+	uint16_t Count;
+	uint16_t Min;
+	uint16_t Max;
+	uint16_t Average;
+} Instrument_t;
+
+/* The diagnostics report, as it goes out in the feature report. */
+typedef struct {
+	Instrument_t Slots[INSTRUMENT_SLOTS];
+} Instrument_Report_t;
+
+// Timing a task is a matter of wrapping it in these. Timer 1 runs freely at the CPU clock, so anything up to
+// 4ms can be timed. Without INSTRUMENTATION, these are nothing at all.
+#if defined(INSTRUMENTATION)
+	#define INSTRUMENT_BEGIN(slot) uint16_t InstrumentStart_##slot = TCNT1
+	#define INSTRUMENT_END(slot)   Instrument_Record(slot, TCNT1 - InstrumentStart_##slot)
+#else
+	#define INSTRUMENT_BEGIN(slot)
+	#define INSTRUMENT_END(slot)
+#endif
+
+void Instrument_Init(void);
+void Instrument_Record(INSTRUMENT_SLOT slot, uint16_t cycles);
+void Instrument_GetReport(Instrument_Report_t* const report);
+void Instrument_Reset(void);
+
+#endif
@@ -0,0 +1,39 @@
+#include "HAL.h"
+#include <string.h>
+#include "Config.h"
+#include "Button.h"
+#include "Rotary.h"
+#include "Keyboard.h"
+#include "Profile.h"
+
+// Sets the bit for a single key usage. Unmapped (0x00) and out-of-range usages are ignored.
+static void Keyboard_Press(Keyboard_t* const ReportData, uint8_t usage) {
+  if ((usage >= 0xE0) && (usage <= 0xE7))
+    ReportData->Modifier |= (1 << (usage - 0xE0));
+  else if (usage && (usage < KEYBOARD_KEY_COUNT))
+    ReportData->Keys[usage >> 3] |= (1 << (usage & 0x07));
+}
+
+// Function for creating the keyboard report. This uses the same button samples as the joystick report.
+void Keyboard_CreateReport(Keyboard_t* const ReportData) {
+  memset(ReportData, 0, sizeof(Keyboard_t));
+
+  // Our key mapping comes from the current profile.
+  const Profile_t* profile = Profile_Get();
+
+  Buttons_t buttons = Button_GetState(ReaderKeyboard);
+  for (uint8_t i = 0; i < 16; i++) {
+    if (buttons & ((Buttons_t)1 << i))
+      Keyboard_Press(ReportData, profile->KeyMap[i]);
+  }
+
+  // Each encoder gets a key for each direction, held for as long as the encoder reports motion.
+  for (uint8_t i = 0; i < 2; i++) {
+    uint8_t direction = Rotary_GetDirection(i);
+
+    if (direction == 1)
+      Keyboard_Press(ReportData, profile->RotaryMap[(i * 2)]);
+    else if (direction)
+      Keyboard_Press(ReportData, profile->RotaryMap[(i * 2) + 1]);
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef _KEYBOARD_H_
+#define _KEYBOARD_H_
+
+#include <stdint.h>
+
+/** Number of key usages covered by the key bitmap, starting from usage 0x00. Modifiers (0xE0-0xE7) are reported separately. */
+#define KEYBOARD_KEY_COUNT 120
+
+/** The Keyboard struct. This is the NKRO report that will go out to the OS, one bit per key. */
+typedef struct {
+	// Our modifiers. One bit each, for 0xE0 (Left Control) through 0xE7 (Right GUI).
+	uint8_t Modifier;
+	// Our keys. One bit for each usage from 0x00 up to KEYBOARD_KEY_COUNT.
+	uint8_t Keys[KEYBOARD_KEY_COUNT / 8];
+} Keyboard_t;
+
+void Keyboard_CreateReport(Keyboard_t* const ReportData);
+
+#endif
@@ -1,15 +1,12 @@
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include "HAL.h"
 #include "Config.h"
 #include "Lights.h"
+#include "Board.h"
 
-#define L07_DDR  DDRD
-#define L07_PORT PORTD
-#define L07_PIN  PIND
-
-#define L8F_DDR  DDRB
-#define L8F_PORT PORTB
-#define L8F_PIN  PINB
+// Each group of light pins, driven out with its lights. Pins an analog input has taken are left alone.
+#define LIGHTS_GROUP_WRITE(port, mask, shift) \
+  DDR##port |= BOARD_GROUP_MASK(port, mask); \
+  PORT##port = (PORT##port & (uint8_t)~BOARD_GROUP_MASK(port, mask)) | (BOARD_SHIFT(OutputData, -(shift)) & BOARD_GROUP_MASK(port, mask));
 
 Settings_Lights_t *SettingsLights;
 Settings_Device_t *SettingsDevice;
@@ -42,12 +39,12 @@ void Lights_Init(void) {
   //                                                                             CY74:OUT--------FET
 	// * Wire each unused input on the CY74FCT573T to ground.                      CY74:IN---------GND
   //
-  // This specific implementation uses the following pins for I/O:
+  // The pins used for I/O depend on the board; see Board.h. On USBemani boards, these are:
   // * PD0-PD7
   // * PB4-PB7 (PB0-PB3 are the SPI bus used for PS2)
 
   // For setup, we only configure the latching pin.
-  DDRF |= 0x80;
+  BOARD_LATCH_DDR |= BOARD_LATCH_MASK;
 
 	// Since setup is done, we can re-enable interrupts.
 	sei();
@@ -55,29 +52,31 @@ void Lights_Init(void) {
 
 
 void Lights_SetState(uint16_t OutputData) {
-  // USBemani boards have an onboard LED at PE6.
+  // Boards have an onboard LED; USBemani boards have it at PE6.
   // We'll turn it on any time there's a light turned on.
   if(OutputData) {
-    DDRE  |=  0x40;
-    PORTE |=  0x40;
+    BOARD_LED_DDR  |=  BOARD_LED_MASK;
+    #if defined(BOARD_LED_ACTIVE_LOW)
+    BOARD_LED_PORT &= (uint8_t)~BOARD_LED_MASK;
+    #else
+    BOARD_LED_PORT |=  BOARD_LED_MASK;
+    #endif
   } else {
-    DDRE  &= ~0x40;
-    PORTE &= ~0x40;
+    BOARD_LED_DDR  &= (uint8_t)~BOARD_LED_MASK;
+    BOARD_LED_PORT &= (uint8_t)~BOARD_LED_MASK;
   }
 
+  // Our buttons share these pins, and are sampled from the timer interrupt. We hold it off until the latch is done.
+  cli();
+
   // For lighting, we'll switch to output mode.
-	L07_DDR  |=  0xFF;
-	L8F_DDR  |=  0xF0;
-  // Clear the pins we'll be setting first, then set them to the desired output.
-  L07_PORT  = (L07_PORT & ~0xFF) |  (OutputData &   0xFF);
-  L8F_PORT  = (L8F_PORT & ~0xF0) | ((OutputData & 0x0F00) >> 4);
-	// L07_PORT &= ~0xFF;
-	// L8F_PORT &= ~0xF0;
-	// L07_PORT |= (OutputData & 0xFF);
-	// L8F_PORT |= (OutputData & 0x0F00) >> 4;
+  // Each group's pins are cleared first, then set to the desired output.
+  BOARD_LIGHT_PINS(LIGHTS_GROUP_WRITE)
 
   // Send a pulse to the latch. This only takes a brief moment of time.
-	PORTF |=  0x80;
+	BOARD_LATCH_PORT |=  BOARD_LATCH_MASK;
 	asm volatile("nop\n");
-	PORTF &= ~0x80;
+	BOARD_LATCH_PORT &= (uint8_t)~BOARD_LATCH_MASK;
+
+	sei();
 }
@@ -0,0 +1,386 @@
+/* usemani_config - command line configuration for USBemani controllers
+ *
+ * Profiles are text, one setting per line:
+ *
+ *	# Player 1 cabinet
+ *	button_map = iidx
+ *	rotary_hold = 200
+ *	key_map = 0x1D 0x1B 0x06 0x19 0x05 0x11 0x10
+ *	name = Cabinet 3 P1
+ *
+ * Anything a profile leaves out keeps the board's current value, as
+ * does the rest of a list that stops early. Apply reads back what each
+ * board is running with, sends only the bytes that differ in one batch,
+ * saves, and reads back again to check. With -a, every connected board
+ * is done at once, each on its own thread.
+ *
+ * Boards keep a bank of USEMANI_PROFILE_COUNT profiles, and run one at
+ * a time. With -p, each board switches to that one first, so that is
+ * the one the profile is saved into; otherwise it goes into whichever
+ * the board is running.
+ *
+ * usage: usemani_config list
+ *        usemani_config dump [-d /dev/hidrawN]
+ *        usemani_config apply [-a | -d /dev/hidrawN] [-p bank] [-n] profile.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "device.h"
+
+#define MAX_BOARDS	32
+#define TIMEOUT_MS	2000
+
+/* Every field a profile can set. Arrays are written as a list of
+ * values; the enumerated ones also take the names below.
+ */
+struct field {
+	const char *key;
+	int offset;
+	int size;		/* bytes per value */
+	int count;		/* values */
+	const char *const *names;	/* names of values 0, 1, ..., or NULL */
+};
+
+static const char *const button_maps[] = { "direct", "iidx", "iidx_us", "iidx_jp", "popn", "ddr", "gfdm", NULL };
+static const char *const lights_comms[] = { "direct", "ws28xx", "owled", NULL };
+static const char *const device_comms[] = { "default", "usb_only", NULL };
+static const char *const device_names[] = { "default", "p1", "p2", NULL };
+
+static const struct field fields[] = {
+	{ "rotary_invert",	USEMANI_OFS_ROTARY_INVERT,	1, 1,	NULL },
+	{ "rotary_hold",	USEMANI_OFS_ROTARY_HOLD,	2, 1,	NULL },
+	{ "rotary_ppr",		USEMANI_OFS_ROTARY_PPR,		2, 1,	NULL },
+	{ "lights_invert_tt",	USEMANI_OFS_LIGHTS_INVERT_TT,	1, 1,	NULL },
+	{ "lights_comm",	USEMANI_OFS_LIGHTS_COMM,	1, 1,	lights_comms },
+	{ "device_comm",	USEMANI_OFS_DEVICE_COMM,	1, 1,	device_comms },
+	{ "device_name",	USEMANI_OFS_DEVICE_NAME,	1, 1,	device_names },
+	{ "button_map",		USEMANI_OFS_BUTTON_MAP,		1, 1,	button_maps },
+	{ "custom_map",		USEMANI_OFS_CUSTOM_MAP,		1, 12,	NULL },
+	{ "key_map",		USEMANI_OFS_KEY_MAP,		1, 16,	NULL },
+	{ "rotary_map",		USEMANI_OFS_ROTARY_MAP,		1, 4,	NULL },
+	{ "debounce_integrate",	USEMANI_OFS_DEBOUNCE_INTEGRATE,	2, 1,	NULL },
+	{ "debounce_time",	USEMANI_OFS_DEBOUNCE_TIME,	1, 16,	NULL },
+	{ "bank_combo",		USEMANI_OFS_BANK_COMBO,		2, 1,	NULL },
+};
+#define FIELDS		(int)(sizeof(fields) / sizeof(fields[0]))
+
+/* A profile: which settings bytes it sets, and to what */
+struct profile {
+	uint8_t settings[USEMANI_SETTINGS_SIZE];
+	uint8_t set[USEMANI_SETTINGS_SIZE];
+	char name[USEMANI_NAME_LENGTH + 1];
+	int has_name;
+};
+
+struct board {
+	struct usemani_device_info info;
+	const struct profile *profile;
+	int bank;		/* bank profile to switch to first, or -1 */
+	int dry_run;
+	int changed;
+	int result;
+	char message[128];
+};
+
+static char *trim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char)*s)) s++;
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1])) *--end = 0;
+	return s;
+}
+
+// A number, or one of the field's names. 0xFF is always "custom".
+static int parse_value(const struct field *f, const char *word, long *value)
+{
+	char *end;
+	int i;
+
+	for (i = 0; f->names && f->names[i]; i++) {
+		if (!strcmp(word, f->names[i])) {
+			*value = i;
+			return 0;
+		}
+	}
+	if (f->names && !strcmp(word, "custom")) {
+		*value = 0xFF;
+		return 0;
+	}
+	*value = strtol(word, &end, 0);
+	if (*end || end == word) return -1;
+	return (*value < 0 || *value >= (1L << (8 * f->size))) ? -1 : 0;
+}
+
+static int load_profile(const char *path, struct profile *p)
+{
+	char line[512];
+	int number = 0;
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	memset(p, 0, sizeof(*p));
+
+	while (fgets(line, sizeof(line), f)) {
+		char *key, *value, *word, *save;
+		const struct field *field = NULL;
+		int i, n = 0;
+
+		number++;
+		line[strcspn(line, "#\n")] = 0;
+		key = trim(line);
+		if (!*key) continue;
+		value = strchr(key, '=');
+		if (!value) goto bad;
+		*value++ = 0;
+		key = trim(key);
+		value = trim(value);
+
+		if (!strcmp(key, "name")) {
+			if (strlen(value) > USEMANI_NAME_LENGTH) {
+				fprintf(stderr, "%s:%d: name is longer than %d characters\n", path, number, USEMANI_NAME_LENGTH);
+				fclose(f);
+				return -1;
+			}
+			strcpy(p->name, value);
+			p->has_name = 1;
+			continue;
+		}
+
+		for (i = 0; i < FIELDS; i++)
+			if (!strcmp(key, fields[i].key)) field = &fields[i];
+		if (!field) {
+			fprintf(stderr, "%s:%d: unknown setting \"%s\"\n", path, number, key);
+			fclose(f);
+			return -1;
+		}
+
+		for (word = strtok_r(value, " \t,", &save); word; word = strtok_r(NULL, " \t,", &save)) {
+			int offset = field->offset + n * field->size;
+			long v;
+
+			if (n >= field->count || parse_value(field, word, &v)) goto bad;
+			p->settings[offset] = v;
+			p->set[offset] = 1;
+			if (field->size == 2) {
+				p->settings[offset + 1] = v >> 8;
+				p->set[offset + 1] = 1;
+			}
+			n++;
+		}
+		if (!n) goto bad;
+	}
+	fclose(f);
+	return 0;
+
+bad:
+	fprintf(stderr, "%s:%d: can't make sense of this line\n", path, number);
+	fclose(f);
+	return -1;
+}
+
+static void dump(const uint8_t *settings, const char *name)
+{
+	int i, j;
+
+	for (i = 0; i < FIELDS; i++) {
+		const struct field *f = &fields[i];
+
+		printf("%s =", f->key);
+		for (j = 0; j < f->count; j++) {
+			const uint8_t *p = settings + f->offset + j * f->size;
+			int v = (f->size == 2) ? (p[0] | (p[1] << 8)) : p[0];
+			int k;
+
+			for (k = 0; f->names && f->names[k] && k != v; k++) ;
+			if (f->names && f->names[k]) printf(" %s", f->names[k]);
+			else if (f->names && v == 0xFF) printf(" custom");
+			else if (f->count > 1) printf(" 0x%02X", v);
+			else printf(" %d", v);
+		}
+		printf("\n");
+	}
+	printf("name = %s\n", name);
+	printf("# running bank profile %d\n", settings[USEMANI_OFS_BANK_PROFILE]);
+}
+
+// Everything for one board, start to finish. These run side by side.
+static void *apply(void *arg)
+{
+	struct board *b = arg;
+	const struct profile *p = b->profile;
+	uint8_t current[USEMANI_SETTINGS_SIZE], wanted[USEMANI_SETTINGS_SIZE], changed[USEMANI_SETTINGS_SIZE];
+	char name[USEMANI_NAME_LENGTH + 1];
+	struct usemani_device *dev;
+	int i, n, name_changed;
+
+	b->result = -1;
+	dev = usemani_open_hidraw(b->info.path);
+	if (!dev) {
+		snprintf(b->message, sizeof(b->message), "can't open: %s", strerror(errno));
+		return NULL;
+	}
+	// A dry run compares against whatever the board is running, as
+	// switching would change it.
+	if (b->bank >= 0 && !b->dry_run) {
+		usemani_queue(dev, USEMANI_CMD_SELECT_PROFILE, b->bank);
+		if (usemani_flush(dev, TIMEOUT_MS)) {
+			snprintf(b->message, sizeof(b->message), "can't switch profiles: %s", strerror(errno));
+			goto done;
+		}
+		usleep(20000);
+	}
+	if (usemani_get_settings(dev, current, name)) {
+		snprintf(b->message, sizeof(b->message), "can't read settings back; firmware too old?");
+		goto done;
+	}
+
+	for (i = 0; i < USEMANI_SETTINGS_SIZE; i++)
+		wanted[i] = p->set[i] ? p->settings[i] : current[i];
+	n = usemani_settings_diff(current, wanted, changed);
+	name_changed = p->has_name && strcmp(name, p->name);
+	b->changed = n + name_changed;
+
+	if (!b->changed) {
+		b->result = 0;
+		snprintf(b->message, sizeof(b->message), "already up to date");
+		goto done;
+	}
+	if (b->dry_run) {
+		b->result = 0;
+		snprintf(b->message, sizeof(b->message), "%d bytes%s would change", n, name_changed ? " and the name" : "");
+		goto done;
+	}
+
+	// The whole batch goes in the queue first, then out in one go
+	for (i = 0; i < n; i++)
+		usemani_queue(dev, USEMANI_CMD_SETTINGS + changed[i], wanted[changed[i]]);
+	if (name_changed) {
+		int len = strlen(p->name);
+
+		for (i = 0; i < len; i++)
+			usemani_queue(dev, USEMANI_CMD_NAME + i, p->name[i]);
+		if (len < USEMANI_NAME_LENGTH) usemani_queue(dev, USEMANI_CMD_NAME + len, 0);
+	}
+	usemani_queue(dev, USEMANI_CMD_SAVE, 0);
+	if (usemani_flush(dev, TIMEOUT_MS)) {
+		snprintf(b->message, sizeof(b->message), "write failed: %s", strerror(errno));
+		goto done;
+	}
+
+	// The last report may still be sitting in the board's endpoint, so
+	// give it a few polls before checking.
+	usleep(20000);
+	if (usemani_get_settings(dev, current, name) || usemani_settings_diff(current, wanted, changed)
+	  || (p->has_name && strcmp(name, p->name))) {
+		snprintf(b->message, sizeof(b->message), "settings didn't stick");
+		goto done;
+	}
+	b->result = 0;
+	snprintf(b->message, sizeof(b->message), "%d bytes%s changed", n, name_changed ? " and the name" : "");
+
+done:
+	usemani_close(dev);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s list\n"
+		"       %s dump [-d /dev/hidrawN]\n"
+		"       %s apply [-a | -d /dev/hidrawN] [-p bank] [-n] profile.txt\n", name, name, name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static struct board boards[MAX_BOARDS];
+	struct usemani_device_info found[MAX_BOARDS];
+	pthread_t threads[MAX_BOARDS];
+	struct profile profile;
+	const char *command, *path = NULL;
+	int all = 0, dry_run = 0, bank = -1, count, i, opt, failed = 0;
+
+	if (argc < 2) usage(argv[0]);
+	command = argv[1];
+	optind = 2;
+	while ((opt = getopt(argc, argv, "ad:np:")) != -1) {
+		switch (opt) {
+		case 'a': all = 1; break;
+		case 'd': path = optarg; break;
+		case 'n': dry_run = 1; break;
+		case 'p':
+			bank = atoi(optarg);
+			if (bank < 0 || bank >= USEMANI_PROFILE_COUNT) usage(argv[0]);
+			break;
+		default: usage(argv[0]);
+		}
+	}
+
+	count = usemani_find(found, MAX_BOARDS);
+	if (count > MAX_BOARDS) count = MAX_BOARDS;
+
+	if (!strcmp(command, "list")) {
+		for (i = 0; i < count; i++) printf("%s\t%s\n", found[i].path, found[i].name);
+		return 0;
+	}
+
+	// Without -a or -d, there had better be just the one board
+	if (path) {
+		snprintf(found[0].path, sizeof(found[0].path), "%s", path);
+		found[0].name[0] = 0;
+		count = 1;
+	} else if (count == 0) {
+		fprintf(stderr, "No boards found\n");
+		return 1;
+	} else if (count > 1 && !all) {
+		fprintf(stderr, "%d boards found; pick one with -d, or use -a for all of them\n", count);
+		return 1;
+	}
+
+	if (!strcmp(command, "dump")) {
+		uint8_t settings[USEMANI_SETTINGS_SIZE];
+		char name[USEMANI_NAME_LENGTH + 1];
+		struct usemani_device *dev = usemani_open_hidraw(found[0].path);
+
+		if (!dev || usemani_get_settings(dev, settings, name)) {
+			fprintf(stderr, "Unable to read settings from %s\n", found[0].path);
+			return 1;
+		}
+		dump(settings, name);
+		usemani_close(dev);
+		return 0;
+	}
+
+	if (strcmp(command, "apply") || optind >= argc) usage(argv[0]);
+	if (load_profile(argv[optind], &profile)) return 1;
+
+	for (i = 0; i < count; i++) {
+		boards[i].info = found[i];
+		boards[i].profile = &profile;
+		boards[i].bank = bank;
+		boards[i].dry_run = dry_run;
+		if (pthread_create(&threads[i], NULL, apply, &boards[i])) {
+			fprintf(stderr, "Unable to start a thread for %s\n", found[i].path);
+			return 1;
+		}
+	}
+	for (i = 0; i < count; i++) {
+		pthread_join(threads[i], NULL);
+		printf("%s: %s\n", boards[i].info.path, boards[i].message);
+		if (boards[i].result) failed++;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+/* usemani_jitter - report stream analyzer for USBemani controllers
+ *
+ * Reads every input report from the hidraw node and keeps histograms
+ * of:
+ *   - the interval between reports, as seen by the host
+ *   - how old each input change was when its report was made (needs
+ *     firmware built with EXTENDED_REPORT, which stamps every change)
+ * Memory use is fixed, so this can run for hours at 1 kHz. Histograms
+ * are written as CSV or JSON, at the end and every so often during a
+ * long run.
+ *
+ * hidraw gives no timestamp of its own, so each report is stamped with
+ * CLOCK_MONOTONIC as soon as epoll wakes up for it.
+ *
+ * usage: usemani_jitter [-t seconds] [-p seconds] [-f csv|json] [-o file] /dev/hidrawN
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "report.h"
+
+#define BINS		10000	/* 1 us each; anything later lands in the last */
+
+struct histogram {
+	uint64_t count;
+	double mean, m2;	/* running mean and variance, Welford style */
+	uint32_t min, max;
+	uint64_t bins[BINS];
+};
+
+static struct histogram interval, change_age;
+static uint64_t reports, changes, dropped, bad;
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void add(struct histogram *h, int64_t us)
+{
+	double delta;
+
+	if (us < 0) us = 0;
+	if (!h->count || us < h->min) h->min = us;
+	if (us > h->max) h->max = us;
+	h->count++;
+	delta = us - h->mean;
+	h->mean += delta / h->count;
+	h->m2 += delta * (us - h->mean);
+	h->bins[us < BINS ? us : BINS - 1]++;
+}
+
+static uint32_t percentile(const struct histogram *h, double p)
+{
+	uint64_t target = (uint64_t)(h->count * p), seen = 0;
+	int i;
+
+	for (i = 0; i < BINS; i++) {
+		seen += h->bins[i];
+		if (seen > target) return i;
+	}
+	return BINS - 1;
+}
+
+static double stddev(const struct histogram *h)
+{
+	return h->count > 1 ? sqrt(h->m2 / (h->count - 1)) : 0.0;
+}
+
+static void write_csv(FILE *f)
+{
+	const struct histogram *h[2] = { &interval, &change_age };
+	const char *name[2] = { "interval", "change_age" };
+	int i, j;
+
+	fprintf(f, "histogram,us,count\n");
+	for (j = 0; j < 2; j++)
+		for (i = 0; i < BINS; i++)
+			if (h[j]->bins[i]) fprintf(f, "%s,%d,%llu\n", name[j], i, (unsigned long long)h[j]->bins[i]);
+}
+
+static void write_json_histogram(FILE *f, const char *name, const struct histogram *h)
+{
+	int i, first = 1;
+
+	fprintf(f, "\"%s\": {\"count\": %llu, \"min\": %u, \"max\": %u, \"mean\": %.2f, \"stddev\": %.2f, "
+		"\"p50\": %u, \"p99\": %u, \"p999\": %u, \"bins\": {",
+		name, (unsigned long long)h->count, h->min, h->max, h->mean, stddev(h),
+		percentile(h, 0.5), percentile(h, 0.99), percentile(h, 0.999));
+	for (i = 0; i < BINS; i++) {
+		if (!h->bins[i]) continue;
+		fprintf(f, "%s\"%d\": %llu", first ? "" : ", ", i, (unsigned long long)h->bins[i]);
+		first = 0;
+	}
+	fprintf(f, "}}");
+}
+
+static void write_json(FILE *f)
+{
+	fprintf(f, "{\"reports\": %llu, \"changes\": %llu, \"dropped\": %llu, \"bad\": %llu,\n",
+		(unsigned long long)reports, (unsigned long long)changes,
+		(unsigned long long)dropped, (unsigned long long)bad);
+	write_json_histogram(f, "interval_us", &interval);
+	fprintf(f, ",\n");
+	write_json_histogram(f, "change_age_us", &change_age);
+	fprintf(f, "}\n");
+}
+
+// Write to a temporary file and rename, so a reader never sees half of it
+static int export(const char *path, int json)
+{
+	char tmp[4096];
+	FILE *f;
+
+	if (!path) {
+		if (json) write_json(stdout);
+		else write_csv(stdout);
+		return 0;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if (!f) return -1;
+	if (json) write_json(f);
+	else write_csv(f);
+	fclose(f);
+	return rename(tmp, path);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t seconds] [-p seconds] [-f csv|json] [-o file] /dev/hidrawN\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct usemani_report report;
+	struct epoll_event ev;
+	uint8_t buf[64];
+	const char *output = NULL;
+	int64_t start, last = 0, next_export, duration = 0, period = 0;
+	int fd, ep, n, i, json = 0, opt;
+
+	while ((opt = getopt(argc, argv, "t:p:f:o:")) != -1) {
+		switch (opt) {
+		case 't': duration = strtoll(optarg, NULL, 0) * 1000000000LL; break;
+		case 'p': period = strtoll(optarg, NULL, 0) * 1000000000LL; break;
+		case 'f': json = !strcmp(optarg, "json"); break;
+		case 'o': output = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc) usage(argv[0]);
+
+	fd = open(argv[optind], O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	ep = epoll_create1(0);
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev)) {
+		fprintf(stderr, "epoll: %s\n", strerror(errno));
+		return 1;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	start = now_ns();
+	next_export = start + period;
+	while (!stop) {
+		int64_t now;
+
+		n = epoll_wait(ep, &ev, 1, 100);
+		now = now_ns();
+		if (duration && now - start >= duration) break;
+		if (period && now >= next_export) {
+			export(output, json);
+			next_export += period;
+		}
+		if (n <= 0) continue;
+
+		// Several reports may be waiting; they all get the same stamp
+		while ((n = read(fd, buf, sizeof(buf))) > 0) {
+			if (usemani_decode_report(buf, n, &report)) {
+				bad++;
+				continue;
+			}
+			reports++;
+			if (last) add(&interval, (now - last) / 1000);
+			last = now;
+
+			if (!report.extended) continue;
+			dropped += report.dropped;
+			for (i = 0; i < report.count; i++) {
+				changes++;
+				add(&change_age, usemani_event_age_ns(&report, i) / 1000);
+			}
+		}
+		if (n < 0 && errno != EAGAIN) {
+			fprintf(stderr, "Read failed: %s\n", strerror(errno));
+			break;
+		}
+	}
+
+	if (export(output, json)) {
+		fprintf(stderr, "Unable to write %s\n", output);
+		return 1;
+	}
+	fprintf(stderr, "%llu reports, interval p50 %u us p99 %u us max %u us, stddev %.1f us\n",
+		(unsigned long long)reports, percentile(&interval, 0.5), percentile(&interval, 0.99),
+		interval.max, stddev(&interval));
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,170 @@
+/* usemani_probe - end to end latency for USBemani controllers
+ *
+ * Needs firmware built with LATENCY_PROBE. Sends a tagged output
+ * report, waits for the input report that carries the tag back, and
+ * keeps histograms of:
+ *   - round trip time, from write() to the tagged report's read()
+ *   - frame phase: where inside the device's 1 ms USB frame the host
+ *     received each reply, relative to the first one
+ * Memory use is fixed, so this can run for millions of samples. Works
+ * with any hidraw node, including one made by usemani_uhid.
+ *
+ * usage: usemani_probe /dev/hidrawN [samples] [histogram.csv]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "report.h"
+
+#define RTT_BINS	20000	/* 1 us each; anything later lands in the last */
+#define PHASE_BINS	1000	/* 1 us each, across a frame */
+#define TIMEOUT_MS	100
+
+static uint64_t rtt_histogram[RTT_BINS];
+static uint64_t rtt_max;	/* exact, as the last bin holds everything later */
+static uint64_t phase_histogram[PHASE_BINS];
+
+static int64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Throw away anything already queued, so it isn't mistaken for a reply
+static void drain(int fd)
+{
+	uint8_t buf[64];
+	struct pollfd p = { fd, POLLIN, 0 };
+
+	while (poll(&p, 1, 0) > 0 && read(fd, buf, sizeof(buf)) > 0) ;
+}
+
+// Wait for the report carrying our tag. Returns 0, or -1 on timeout.
+static int await(int fd, uint8_t tag, struct usemani_report *report, int64_t deadline)
+{
+	uint8_t buf[64];
+	struct pollfd p = { fd, POLLIN, 0 };
+	int n;
+
+	for (;;) {
+		int64_t left = deadline - now_us();
+		if (left <= 0) return -1;
+		if (poll(&p, 1, (int)(left / 1000) + 1) <= 0) continue;
+		n = read(fd, buf, sizeof(buf));
+		if (n < 0) return -1;
+		if (usemani_decode_report(buf, n, report) || !report->probed) continue;
+		if (report->probe.tag == tag) return 0;
+	}
+}
+
+// Nearest rank: the smallest value with at least p of the samples at
+// or below it
+static uint32_t percentile(const uint64_t *histogram, int bins, uint64_t total, double p)
+{
+	uint64_t target = (uint64_t)ceil(total * p), seen = 0;
+	int i;
+
+	if (target < 1) target = 1;
+	for (i = 0; i < bins; i++) {
+		seen += histogram[i];
+		if (seen >= target) return i;
+	}
+	return bins - 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct usemani_report report;
+	uint64_t samples = 100000, done = 0, lost = 0;
+	int64_t base = 0;
+	int fd, first = 1, i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s /dev/hidrawN [samples] [histogram.csv]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2) samples = strtoull(argv[2], NULL, 0);
+
+	fd = open(argv[1], O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+
+	while (done + lost < samples) {
+		uint8_t tag = (uint8_t)((done + lost) % 255) + 1;
+		// Report number 0, then lights, command and data
+		uint8_t out[5] = { 0, 0, 0, USEMANI_CMD_PROBE, tag };
+		int64_t sent, received, rtt;
+
+		drain(fd);
+		sent = now_us();
+		if (write(fd, out, sizeof(out)) != sizeof(out)) {
+			fprintf(stderr, "Write failed: %s\n", strerror(errno));
+			return 1;
+		}
+		if (await(fd, tag, &report, sent + TIMEOUT_MS * 1000)) {
+			lost++;
+			continue;
+		}
+		received = now_us();
+
+		rtt = received - sent;
+		rtt_histogram[rtt < RTT_BINS ? rtt : RTT_BINS - 1]++;
+		if ((uint64_t)rtt > rtt_max) rtt_max = rtt;
+
+		// The frame counter wraps every 2048 frames, and so does this
+		int64_t offset = received - (int64_t)report.probe.frame * 1000;
+		if (first) {
+			base = offset;
+			first = 0;
+		}
+		int64_t phase = (offset - base) % 1000;
+		if (phase < 0) phase += 1000;
+		phase_histogram[phase]++;
+
+		done++;
+		if (done % 10000 == 0) {
+			fprintf(stderr, "\r%llu samples", (unsigned long long)done);
+			fflush(stderr);
+		}
+	}
+	if (done >= 10000) fprintf(stderr, "\n");
+
+	printf("samples %llu\nlost %llu\n", (unsigned long long)done, (unsigned long long)lost);
+	if (done) {
+		printf("rtt_us p50 %u p90 %u p99 %u p99.9 %u max %llu\n",
+			percentile(rtt_histogram, RTT_BINS, done, 0.50),
+			percentile(rtt_histogram, RTT_BINS, done, 0.90),
+			percentile(rtt_histogram, RTT_BINS, done, 0.99),
+			percentile(rtt_histogram, RTT_BINS, done, 0.999),
+			(unsigned long long)rtt_max);
+	}
+
+	if (argc > 3) {
+		FILE *f = fopen(argv[3], "w");
+		if (!f) {
+			fprintf(stderr, "Unable to write %s\n", argv[3]);
+			return 1;
+		}
+		fprintf(f, "histogram,us,count\n");
+		for (i = 0; i < RTT_BINS; i++)
+			if (rtt_histogram[i]) fprintf(f, "rtt,%d,%llu\n", i, (unsigned long long)rtt_histogram[i]);
+		for (i = 0; i < PHASE_BINS; i++)
+			if (phase_histogram[i]) fprintf(f, "phase,%d,%llu\n", i, (unsigned long long)phase_histogram[i]);
+		fclose(f);
+	}
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,14 @@
+#include "HAL.h"
+#include <string.h>
+#include "Rotary.h"
+#include "Mouse.h"
+
+// Function for creating the mouse report.
+// Each encoder keeps a 16-bit count of every step since we last took it, so no motion is lost between polls, however fast the encoder spins.
+void Mouse_CreateReport(Mouse_t* const ReportData) {
+  memset(ReportData, 0, sizeof(Mouse_t));
+
+  // The first encoder (the turntable) is our X axis, the second is Y.
+  ReportData->X = Rotary_TakeDelta(0);
+  ReportData->Y = Rotary_TakeDelta(1);
+}
@@ -0,0 +1,17 @@
+#ifndef _MOUSE_H_
+#define _MOUSE_H_
+
+#include <stdint.h>
+
+/** The Mouse struct. This is the relative report that will go out to the OS. */
+typedef struct {
+	// Our buttons. We don't have any, but some hosts won't treat a device as a mouse without them.
+	uint8_t Button;
+	// Our X and Y axes. These are the steps each encoder has taken since the last report.
+	int16_t X;
+	int16_t Y;
+} Mouse_t;
+
+void Mouse_CreateReport(Mouse_t* const ReportData);
+
+#endif
@@ -1,6 +1,4 @@
-#include <avr/interrupt.h>
-#include <avr/io.h>
-#include <avr/pgmspace.h>
+#include "HAL.h"
 // We need access to our lights, to deactivate the assertion.
 #include "Lights.h"
 // We need access to our rotary data via pointer.
@@ -8,6 +6,10 @@
 // We also need access to our functions for the buttons.
 #include "Button.h"
 #include "Config.h"
+#include "Board.h"
+#include "Instrument.h"
+#include "Scheduler.h"
+#include "Profile.h"
 #include "PS2.h"
 
 /** The default mappings. Each of these will load from program memory on startup of PS2 mode. */
@@ -126,22 +128,6 @@ const uint8_t INPUT_DIRECT[12]  PROGMEM = {
     CIRCLE,
 };
 
-// Our loaded mapping. We'll load our mapping from PROGMEM or EEPROM depending on whatever is specified.
-uint8_t  PS2_INPUTMAP[12] = {
-	NC,
-	NC,
-	NC,
-	NC,
-	NC,
-	NC,
-	NC,
-	NC,
-	NC,
-	NC,
-	NC,
-	NC
-};
-
 // The current state of the PS2. There are a total of 5 bytes of data that we need to transmit, and we'll keep track of where we are.
 uint8_t  PS2_State;
 // The final data buffer. This will hold the data that gets pushed out via the interrupt. We're storing this out here so we're never without a valid set of data.
@@ -154,53 +140,43 @@ uint8_t  InvertMask = 0x00;
 
 Settings_Device_t *SettingsDevice;
 Settings_Lights_t *SettingsLights;
-Settings_Button_t *SettingsButton;
 
 
 
+// Function for building a profile's input mapping, from PROGMEM or the custom mapping depending on whatever is specified.
+// This is done for every profile up front, so switching profiles never has to.
+void PS2_CompileMap(const Settings_Button_t* button, uint8_t* map) {
+	const uint8_t* source;
+
+	switch(button->ButtonMap) {
+		case B_Direct: source = INPUT_DIRECT; break;
+		case B_IIDX:   source = INPUT_IIDX;   break;
+		case B_IIDXUS: source = INPUT_IIDXUS; break;
+		case B_IIDXJP: source = INPUT_IIDXJP; break;
+		case B_POPN:   source = INPUT_POPN;   break;
+		case B_DDR:    source = INPUT_DDR;    break;
+		case B_GFDM:   source = INPUT_GFDM;   break;
+		case B_Custom:
+			for (int i = 0; i < 12; i++)
+				map[i] = button->CustomMap[i];
+			return;
+		default:
+			// Nothing we know of. Nothing gets mapped.
+			for (int i = 0; i < 12; i++)
+				map[i] = NC;
+			return;
+	}
+
+	for (int i = 0; i < 12; i++)
+		map[i] = pgm_read_byte(&(source[i]));
+}
+
 void PS2_Init(void) {
 	cli();
 	// For initialization, we need some information about the device.
-	// We also need access to our lighting and button data.
+	// We also need access to our lighting data. Our mapping comes from the active profile.
 	Config_AddressDevice(&SettingsDevice);
 	Config_AddressLights(&SettingsLights);
-	Config_AddressButton(&SettingsButton);
-
-	// We need to configure our input mapping. By default, we will use a direct mapping, which is primarily used for debugging.
-	switch(SettingsButton->ButtonMap) {
-		case B_Direct:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = pgm_read_byte(&(INPUT_DIRECT[i])); }
-			break;
-		case B_IIDX:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = pgm_read_byte(&(INPUT_IIDX[i]));   }
-			break;
-		case B_IIDXUS:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = pgm_read_byte(&(INPUT_IIDXUS[i]));   }
-			break;
-		case B_IIDXJP:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = pgm_read_byte(&(INPUT_IIDXJP[i]));   }
-			break;	
-		case B_POPN:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = pgm_read_byte(&(INPUT_POPN[i]));   }
-			break;
-		case B_DDR:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = pgm_read_byte(&(INPUT_DDR[i]));    }
-			break;
-		case B_GFDM:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = pgm_read_byte(&(INPUT_GFDM[i]));   }
-			break;
-		case B_Custom:
-			for (int i = 0; i < 12; i++) {
-				PS2_INPUTMAP[i] = SettingsButton->CustomMap[i]; }
-			break;
-	}
 
 	// If the device is configured to use both USB and PS2 (the default behavior), then we'll configure PS2 support.
 	// Otherwise, we don't do anything.
@@ -223,6 +199,8 @@ void PS2_Init(void) {
 // The interrupt for PS2 communications.
 // This interrupt goes above all other currently used interrupts. Any interrupt-based process, like the rotary encoders, will completely halt during this time.
 ISR(SPI_STC_vect) {
+	INSTRUMENT_BEGIN(InstrumentSPIISR);
+
 	SPDR = 0x00;
 	// Any time we receive a packet from the PS2, we'll set a variable for PS2 assertion.
 	// If the PS2 is active, USB lighting will be inactived, and will not be reactivated unless the assertion is cleared by USB input.
@@ -270,16 +248,27 @@ ISR(SPI_STC_vect) {
 	// Every time we finish here, we need to increment our state.
 	PS2_State++;
 	// And finally, we'll send our acknowledgement. We do this last to buy us a bit of time. The PS2 will sit and wait a bit
+
+	// The main loop can have the next poll's data ready while the PS2 waits.
+	Scheduler_Post(SchedulerPS2);
+
+	INSTRUMENT_END(InstrumentSPIISR);
 }
 
 // During our free time between interrupts, we need to read in the data for the PS2 and transform it.
 void PS2_LoadData(void) {
 	// We only do this while we're in PS2 mode.
 	if (SettingsDevice->PS2Assert) {
-		DDRE  |=  0x40;
-		PORTE |=  0x40;
+		const Profile_t* profile = Profile_Get();
+		// The onboard LED shows we're in PS2 mode.
+		BOARD_LED_DDR  |=  BOARD_LED_MASK;
+		#if defined(BOARD_LED_ACTIVE_LOW)
+		BOARD_LED_PORT &= (uint8_t)~BOARD_LED_MASK;
+		#else
+		BOARD_LED_PORT |=  BOARD_LED_MASK;
+		#endif
 		// We need a temporary place to read data into.
-		uint16_t r_temp = Button_GetState();
+		uint16_t r_temp = Button_GetState(ReaderPS2);
 		// We also need some temporary space to write data to.
 		uint16_t w_temp = 0;
 
@@ -289,7 +278,7 @@ void PS2_LoadData(void) {
 		// Therefore, if a button is not pressed, we add a high bit.
 		for (int i = 0; i < 12; i++) {
 			if (r_temp & (1 << i))
-				 w_temp |= (1 << PS2_INPUTMAP[i]);
+				 w_temp |= (1 << profile->PS2Map[i]);
 		}
 
 		// We also need to deal with our rotary encoders here.
@@ -311,7 +300,7 @@ void PS2_LoadData(void) {
 
 		// Additionally, we also need to handle any specialty cases here.
 		// Todo: Look up more specialty cases?
-		switch (SettingsButton->ButtonMap) {
+		switch (profile->ButtonMap) {
 			case B_POPN:
 				// pop'n requires that down, left, AND right be held.
 				w_temp |= (1 << DPAD_DOWN);
@@ -337,11 +326,13 @@ void PS2_LoadData(void) {
 // An acknowledgement statement.
 // Each time we have received a chunk of data from the PS2, we need to acknowledge that we have received said data.
 void PS2_Acknowledge(void) {
+	#if defined(BOARD_PS2_ACK_MASK)
 	// This is very simple. We hold our acknowledge line down...
-	DDRF  |=  0x40;
-	PORTF &= ~0x40;
+	BOARD_PS2_ACK_DDR  |=  BOARD_PS2_ACK_MASK;
+	BOARD_PS2_ACK_PORT &= (uint8_t)~BOARD_PS2_ACK_MASK;
 	// ...and wait... (adjust this until it recognizes)
 	asm volatile("nop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\nnop\n");
 	// ...and release.
-	DDRF &= ~0x40;
+	BOARD_PS2_ACK_DDR &= (uint8_t)~BOARD_PS2_ACK_MASK;
+	#endif
 }
\ No newline at end of file
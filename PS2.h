@@ -1,6 +1,9 @@
 #ifndef _PS2_H_
 #define _PS2_H_
 
+#include <stdint.h>
+#include "Config.h"
+
 /* Input mappings. These are all the predefined mappings. */
 /** The necessary defines. These point to the bits that make up bytes 4 and 5 of the PS2 communication (LSB first). */
 /** The values work off of bitshifting. "NC" as 16 will shove the data right off. */
@@ -22,6 +25,7 @@
 #define SQUARE     15
 #define NC         16
 
+void PS2_CompileMap(const Settings_Button_t* button, uint8_t* map);
 void PS2_Init(void);
 void PS2_LoadData(void);
 void PS2_Acknowledge(void);
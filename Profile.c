@@ -0,0 +1,125 @@
+#include "HAL.h"
+#include <string.h>
+#include "Config.h"
+#include "Button.h"
+#include "PS2.h"
+#include "Profile.h"
+
+Settings_Bank_t *SettingsBank;
+
+// Every profile in the bank, compiled, and which one is current. The index is a single byte, so the timer interrupt
+// can switch it and anyone can read it without holding the other off.
+static Profile_t        Profiles[CONFIG_PROFILE_COUNT];
+static volatile uint8_t ProfileIndex;
+
+// The buttons to hold to switch profiles, and the button that picks each profile while they're held.
+static Buttons_t ProfileCombo;
+static Buttons_t ProfileSelect[CONFIG_PROFILE_COUNT];
+// The buttons as of the last sample, so only a fresh press picks a profile.
+static Buttons_t ProfileLast;
+// Every select button, and the buttons we're keeping from the host: whatever of the combo and the select buttons was
+// held while the combo was, until it's let go.
+static Buttons_t ProfileSelectAll;
+static Buttons_t ProfileHidden;
+
+// Builds a profile's tables from its settings.
+static void Profile_Compile(Profile_t* profile, const Settings_Profile_t* settings) {
+	profile->ButtonMap = settings->Button.ButtonMap;
+	PS2_CompileMap(&settings->Button, profile->PS2Map);
+
+	memcpy(profile->KeyMap,    settings->Keyboard.KeyMap,    sizeof(profile->KeyMap));
+	memcpy(profile->RotaryMap, settings->Keyboard.RotaryMap, sizeof(profile->RotaryMap));
+
+	profile->RotaryInvert = ((settings->Rotary.RotaryInvert & R_InvertA) ? 0x01 : 0) |
+	                        ((settings->Rotary.RotaryInvert & R_InvertC) ? 0x02 : 0);
+	profile->RotaryHold   = settings->Rotary.RotaryHold;
+	// The encoders wrap their position at this, so it had better not be 0.
+	profile->RotaryPPR    = settings->Rotary.RotaryPPR ? settings->Rotary.RotaryPPR : 256;
+}
+
+// Function for compiling every profile in the bank. This runs whenever our settings are applied.
+void Profile_Init(void) {
+	// We'll turn off interrupts temporarily during setup procedures.
+	cli();
+
+	// The bank only knows our profile at boot. After that, a switch may have happened that Profile_Task hasn't caught
+	// up with yet, and the current index is the one to keep.
+	if (!SettingsBank) {
+		Config_AddressBank(&SettingsBank);
+		ProfileIndex = SettingsBank->BankProfile;
+	}
+
+	for (uint8_t i = 0; i < CONFIG_PROFILE_COUNT; i++) {
+		Settings_Profile_t settings;
+		Config_GetProfile(i, &settings);
+		Profile_Compile(&Profiles[i], &settings);
+	}
+
+	// Each profile is picked by one of the first buttons outside the combo, in order.
+	ProfileCombo     = SettingsBank->BankCombo;
+	ProfileSelectAll = 0;
+	Buttons_t bit = 1;
+	uint8_t   n   = 0;
+	for (uint8_t i = 0; i < BUTTON_COUNT; i++, bit <<= 1) {
+		if ((n < CONFIG_PROFILE_COUNT) && !(ProfileCombo & bit)) {
+			ProfileSelect[n++] = bit;
+			ProfileSelectAll  |= bit;
+		}
+	}
+	while (n < CONFIG_PROFILE_COUNT)
+		ProfileSelect[n++] = 0;
+	ProfileHidden = 0;
+
+	// Anything held right now has to be let go and pressed again to count.
+	ProfileLast = (Buttons_t)~0;
+
+	// Since setup is done, we can re-enable interrupts.
+	sei();
+}
+
+// Function for retrieving the current profile.
+const Profile_t* Profile_Get(void) {
+	return &Profiles[ProfileIndex];
+}
+
+// Function for watching for the combo. This is called from the timer interrupt with each debounced sample, so a switch
+// takes effect before the next report is built. Returns the buttons to keep from the host, so switching never presses
+// anything in a game.
+Buttons_t Profile_Sample(Buttons_t state) {
+	Buttons_t pressed = state & ~ProfileLast;
+	ProfileLast    = state;
+	ProfileHidden &= state;
+
+	if (!ProfileCombo || ((state & ProfileCombo) != ProfileCombo)) return ProfileHidden;
+	ProfileHidden |= state & (ProfileCombo | ProfileSelectAll);
+
+	for (uint8_t i = 0; i < CONFIG_PROFILE_COUNT; i++) {
+		if (pressed & ProfileSelect[i]) {
+			ProfileIndex = i;
+			break;
+		}
+	}
+	return ProfileHidden;
+}
+
+// Function for switching profiles at the host's request.
+void Profile_Select(uint8_t index) {
+	if (index < CONFIG_PROFILE_COUNT) ProfileIndex = index;
+}
+
+// Function for catching our settings up after a switch. This is called from the main loop. The switch has already
+// taken effect; this only makes the new profile our working copy and remembers it, and takes any changes that were
+// never saved back out of the old one.
+void Profile_Task(void) {
+	uint8_t index = ProfileIndex;
+	uint8_t old   = SettingsBank->BankProfile;
+	if (index == old) return;
+
+	Config_SelectProfile(index);
+
+	Profile_t          profile;
+	Settings_Profile_t settings;
+	Config_GetProfile(old, &settings);
+	Profile_Compile(&profile, &settings);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) Profiles[old] = profile;
+}
@@ -0,0 +1,29 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdint.h>
+#include "Config.h"
+#include "Button.h"
+
+/** A profile, compiled. Everything that reads a profile at runtime reads it from here, already in the form it needs, so
+ *  switching profiles is just switching which of these is current. Each is built from its settings in the bank. */
+typedef struct {
+	BUTTON_TRANSFORM ButtonMap;
+	// Each button's PS2 bit.
+	uint8_t          PS2Map[12];
+	// Each button's key usage, and each encoder direction's.
+	uint8_t          KeyMap[16];
+	uint8_t          RotaryMap[4];
+	// One bit per encoder, set if it's inverted.
+	uint8_t          RotaryInvert;
+	uint16_t         RotaryHold;
+	uint16_t         RotaryPPR;
+} Profile_t;
+
+void             Profile_Init(void);
+const Profile_t* Profile_Get(void);
+Buttons_t        Profile_Sample(Buttons_t state);
+void             Profile_Select(uint8_t index);
+void             Profile_Task(void);
+
+#endif
@@ -1,11 +1,12 @@
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include "HAL.h"
 #include "Rotary.h"
+#include "Button.h"
+#include "Events.h"
+#include "Instrument.h"
+#include "Scheduler.h"
 #include "Config.h"
-
-#define R_DDR  DDRF
-#define R_PORT PORTF
-#define R_PIN  PINF
+#include "Board.h"
+#include "Profile.h"
 
 #define MAX_NUMBER_OF_ENCODERS 2
 #define HALF_STEP
@@ -37,13 +38,12 @@ const unsigned char rotary_lookup[7][4] = {
 /* Our encoders. */
 Rotary_t Rotary[MAX_NUMBER_OF_ENCODERS];
 
-/* Our pointer to the settings in Config. */
-Settings_Rotary_t *SettingsRotary;
-uint16_t HoldTime = 4000;
+/* Our time base, counting interrupts. */
+volatile uint16_t RotaryTicks;
+
 
-/* Internal rotary processing command. This will grab the current state and determine if a change occured. */
-uint8_t RotaryProcess(uint8_t encoder) {
-	unsigned char pinState = ((R_PIN >> Rotary[encoder].pin) & 0x03);
+/* Internal rotary processing command. This will take the encoder's pins and determine if a change occured. */
+static inline uint8_t RotaryProcess(uint8_t encoder, uint8_t pinState) {
 	Rotary[encoder].state = rotary_lookup[Rotary[encoder].state & 0xf][pinState];
 	
 	return (Rotary[encoder].state & 0x30);
@@ -54,10 +54,6 @@ void Rotary_Init(ROTARY_FREQ rate) {
 	// Start by disabling interrupts as a whole. We re-enable them at the end.
 	cli();
 
-	// Before we configure our interrupt, we need to load in our settings.
-	Config_AddressRotary(&SettingsRotary);
-	HoldTime = SettingsRotary->RotaryHold;
-
 	// Clear both registers.
 	TCCR0A  = 0;
 	TCCR0B  = 0;
@@ -78,32 +74,18 @@ void Rotary_Init(ROTARY_FREQ rate) {
 }
 
 /* Attach encoders for use. */
-void Rotary_AttachEncoder(uint8_t encoder, ROTARY_CONNECTION pin) {
-	// We need to store the pin connection into this specific encoder.
-	Rotary[encoder].pin = pin;
-	R_DDR  &= ~(0x03 << pin);
-	R_PORT |=  (0x03 << pin);
-
-
-	switch(encoder) {
-		case 0:
-			if (SettingsRotary->RotaryInvert & R_InvertA) 
-				 Rotary[encoder].isInverted = 1;
-			else Rotary[encoder].isInverted = 0;
-			break;
-		case 1:
-			if (SettingsRotary->RotaryInvert & R_InvertC) 
-				 Rotary[encoder].isInverted = 1;
-			else Rotary[encoder].isInverted = 0;
-			break;
-	}
+void Rotary_AttachEncoder(uint8_t encoder) {
+	// Each encoder's pins come from the board. These are inputs with pullups.
+	ROTARY_CONNECTION pin = (encoder ? BOARD_ENCODER1 : BOARD_ENCODER0);
+	BOARD_ENCODER_DDR  &= (uint8_t)~(0x03 << pin);
+	BOARD_ENCODER_PORT |=  (0x03 << pin);
 }
 
 /* Grab the current direction of motion. */
 uint8_t Rotary_GetDirection(uint8_t encoder) {
 	// As long as we have an output, check if we need to invert it.
 	if (Rotary[encoder].direction) {
-		if (Rotary[encoder].isInverted) return Rotary[encoder].direction  * -1;
+		if (Profile_Get()->RotaryInvert & (1 << encoder)) return Rotary[encoder].direction  * -1;
 		else                            return Rotary[encoder].direction;
 	}
 	else return 0;
@@ -111,34 +93,88 @@ uint8_t Rotary_GetDirection(uint8_t encoder) {
 
 /* Grab the current position of the encoder. */
 uint8_t Rotary_GetPosition(uint8_t encoder) {
-	if (Rotary[encoder].isInverted) return Rotary[encoder].position ^ 0xFF;
+	if (Profile_Get()->RotaryInvert & (1 << encoder)) return Rotary[encoder].position ^ 0xFF;
 	else                            return Rotary[encoder].position;
 }
 
-/* The interrupt that is executed, based on the defined rate. */
-ISR(TIMER0_COMPA_vect) {
-	// We need to iterate through each encoder.
-	for (int i = 0; i < MAX_NUMBER_OF_ENCODERS; i++) {
-		// For each encoder, we'll update the current position and direction, along with the hold time for legacy use.
-		uint8_t result = RotaryProcess(i);
-		if (result) {
-	     	// We pass the tooth count into our position function. We start with it as a base, add the current position, plus or minus direction, and mod the whole thing against the tooth count.
-    		Rotary[i].position  = 
-    			(
-    				SettingsRotary->RotaryPPR + (
-    					result == CounterClockwise ?
-    						Rotary[i].position - 1 : 
-    						Rotary[i].position + 1
-    				)
-    			) % SettingsRotary->RotaryPPR;
-    			
-		    Rotary[i].direction = (result == CounterClockwise ? -1 : 1);
-    		Rotary[i].hold      = HoldTime;
-		}
-		// If there hasn't been a change in state, we start counting down the hold time.
-		else {
-			Rotary[i].hold      = (Rotary[i].hold ? Rotary[i].hold - 1 : 0);
+/* Grab the steps taken since we were last asked. */
+int16_t Rotary_TakeDelta(uint8_t encoder) {
+	// The interrupt updates this, so we need to hold it off while we swap it out.
+	int16_t delta;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		delta = Rotary[encoder].delta;
+		Rotary[encoder].delta = 0;
+	}
+
+	if (Profile_Get()->RotaryInvert & (1 << encoder)) return -delta;
+	else                            return  delta;
+}
+
+/* Grab the current tick. */
+uint16_t Rotary_GetTicks(void) {
+	// This is two bytes wide, so the interrupt could change it halfway through reading.
+	uint16_t ticks;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) ticks = RotaryTicks;
+
+	return ticks;
+}
+
+/* One encoder's update, from its pins. This is inlined for each encoder, so each is specialized to its own state. */
+static inline __attribute__((always_inline)) void RotaryUpdate(uint8_t i, uint8_t pinState, const Profile_t* profile) {
+	// For each encoder, we'll update the current position and direction, along with the hold time for legacy use.
+	uint8_t result = RotaryProcess(i, pinState);
+	if (result) {
+	  // We pass the tooth count into our position function. We start with it as a base, add the current position, plus or minus direction, and mod the whole thing against the tooth count.
+		Rotary[i].position  = 
+			(
+				profile->RotaryPPR + (
+					result == CounterClockwise ?
+						Rotary[i].position - 1 : 
+						Rotary[i].position + 1
+				)
+			) % profile->RotaryPPR;
+			
+		Rotary[i].direction = (result == CounterClockwise ? -1 : 1);
+		Rotary[i].hold      = profile->RotaryHold;
+
+		// Count the step for relative output. If nobody reads it for a long time, we stop at the limits instead of wrapping.
+		// The limits are the mouse axes' logical range, which is symmetric, so inverting the count never overflows it.
+		if (result == CounterClockwise) {
+			if (Rotary[i].delta != -INT16_MAX) Rotary[i].delta--;
+		} else {
+			if (Rotary[i].delta != INT16_MAX) Rotary[i].delta++;
 		}
-		if (Rotary[i].hold == 0)   Rotary[i].direction = 0;
 	}
+	// If there hasn't been a change in state, we start counting down the hold time.
+	else {
+		Rotary[i].hold      = (Rotary[i].hold ? Rotary[i].hold - 1 : 0);
+	}
+	if (Rotary[i].hold == 0)   Rotary[i].direction = 0;
+}
+
+/* The interrupt that is executed, based on the defined rate. */
+ISR(TIMER0_COMPA_vect) {
+	INSTRUMENT_BEGIN(InstrumentRotaryISR);
+
+	RotaryTicks++;
+
+	// Both encoders are read at once. Where each one sits is fixed by the board, so picking them out is constant.
+	uint8_t pins = BOARD_ENCODER_PIN;
+	// Our settings come from the current profile, which is read fresh on every interrupt.
+	const Profile_t* profile = Profile_Get();
+	RotaryUpdate(0, (pins >> BOARD_ENCODER0) & 0x03, profile);
+	RotaryUpdate(1, (pins >> BOARD_ENCODER1) & 0x03, profile);
+
+	// This timer also paces our button sampling, which watches for a profile switch. A switch takes effect from the
+	// next tick.
+	Button_Sample();
+
+	#if defined(EXTENDED_REPORT)
+	// With everything sampled, we can record anything that changed.
+	Events_Sample(RotaryTicks);
+	#endif
+
+	Scheduler_Post(SchedulerTick);
+
+	INSTRUMENT_END(InstrumentRotaryISR);
 }
\ No newline at end of file
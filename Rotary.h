@@ -28,21 +28,24 @@ typedef enum {
 
 /** Turntable structure. Holds the state of each encoder. */
 typedef struct {
-	ROTARY_CONNECTION pin;        // The current connection mask.
 	uint8_t           position;   // Reported position of each encoder.
 	uint8_t           state;      // Internal state. Holds current and previous states.
 	ROTARY_DIRECTION  direction;  // Contains the current direction, for legacy use.
 	uint16_t          hold;       // Used to provide a sustained output, for legacy use.
-	ROTARY_INVERT     isInverted; // Used to determine if our output needs to be flipped.
+	int16_t           delta;      // Steps taken since the last time the delta was read, for relative output.
 } Rotary_t;
 
 /* Function prototypes */
 /** Initialize the encoders. This sets up the interrupt. */
 void Rotary_Init(ROTARY_FREQ rate);
-/** Attaches an encoder for use. */
-void Rotary_AttachEncoder(uint8_t encoder, ROTARY_CONNECTION pin);
+/** Attaches an encoder for use. Its pins come from the board profile. */
+void Rotary_AttachEncoder(uint8_t encoder);
 /** Outputs for direction and position. */
 uint8_t Rotary_GetDirection(uint8_t encoder);
 uint8_t Rotary_GetPosition (uint8_t encoder);
+/** Output for relative motion. This returns the steps taken since the last call, and starts counting again from zero. */
+int16_t Rotary_TakeDelta   (uint8_t encoder);
+/** Our time base. This counts encoder interrupts, which is also when buttons are sampled, and wraps around. */
+uint16_t Rotary_GetTicks(void);
 
 #endif
\ No newline at end of file
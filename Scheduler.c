@@ -0,0 +1,96 @@
+#include "HAL.h"
+#include "Scheduler.h"
+
+// Our task table, from Scheduler_Init().
+static const Scheduler_Task_t* Tasks;
+static uint8_t                 TaskCount;
+
+// Events posted since the main loop last looked, and the tasks they've made ready.
+static volatile uint8_t Pending;
+static uint8_t          Ready;
+
+#if defined(INSTRUMENTATION)
+// When each pending event was first posted, and when each ready task was first made ready, by timer 1.
+static volatile uint16_t PostedAt[SCHEDULER_EVENTS];
+static uint16_t          ReadyAt[8];
+#endif
+
+// Function for setting up our task table. Nothing is ready until an event comes in.
+void Scheduler_Init(const Scheduler_Task_t* const tasks, uint8_t count) {
+	Tasks     = tasks;
+	TaskCount = count;
+	Ready     = 0;
+	Pending   = 0;
+}
+
+// Function for posting events. This is called from our interrupts, and the USB control interrupt runs with the
+// others enabled, so one post can interrupt another. We hold them off until ours is done.
+void Scheduler_Post(uint8_t events) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		#if defined(INSTRUMENTATION)
+		uint8_t fresh = events & ~Pending;
+		for (uint8_t i = 0; i < SCHEDULER_EVENTS; i++)
+			if (fresh & (1 << i)) PostedAt[i] = TCNT1;
+		#endif
+
+		Pending |= events;
+	}
+}
+
+// Function for running the next task. Whatever came in while the last task ran is taken in first, so a task never
+// waits behind one of lower priority for more than one run of it. Returns false if there was nothing to do.
+bool Scheduler_Step(void) {
+	cli();
+	uint8_t events = Pending;
+	Pending = 0;
+	#if defined(INSTRUMENTATION)
+	uint16_t posted[SCHEDULER_EVENTS];
+	for (uint8_t i = 0; i < SCHEDULER_EVENTS; i++) posted[i] = PostedAt[i];
+	#endif
+	sei();
+
+	for (uint8_t i = 0; i < TaskCount; i++) {
+		if (!(Tasks[i].Events & events) || (Ready & (1 << i))) continue;
+		Ready |= (1 << i);
+
+		#if defined(INSTRUMENTATION)
+		// A task's wait starts with the oldest of its events. Timer 1 wraps, so we compare ages rather than times.
+		uint16_t now = TCNT1, oldest = 0;
+		for (uint8_t e = 0; e < SCHEDULER_EVENTS; e++)
+			if ((Tasks[i].Events & events & (1 << e)) && ((uint16_t)(now - posted[e]) > oldest)) oldest = now - posted[e];
+		ReadyAt[i] = now - oldest;
+		#endif
+	}
+
+	for (uint8_t i = 0; i < TaskCount; i++) {
+		if (!(Ready & (1 << i))) continue;
+		Ready &= ~(1 << i);
+
+		#if defined(INSTRUMENTATION)
+		uint16_t start = TCNT1;
+		Instrument_Record(Tasks[i].Latency, start - ReadyAt[i]);
+		Tasks[i].Run();
+		Instrument_Record(Tasks[i].Duration, TCNT1 - start);
+		#else
+		Tasks[i].Run();
+		#endif
+		return true;
+	}
+
+	return false;
+}
+
+// Function for waiting on the next event. Interrupts stay off from the check until we're asleep, so an event that
+// comes in just before we sleep still wakes us: sei() always lets the next instruction run first.
+void Scheduler_Idle(void) {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+
+	cli();
+	if (!Pending) {
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	sei();
+}
@@ -0,0 +1,37 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdbool.h>
+#include "HAL.h"
+#include "Instrument.h"
+
+// Events, as posted by our interrupts. Each is a bit, so any number can be pending at once.
+typedef enum {
+	// Timer 0 has sampled our buttons and encoders.
+	SchedulerTick   = (1 << 0),
+	// The host has started a USB frame.
+	SchedulerFrame  = (1 << 1),
+	// The PS2 has polled us, and will want fresh data next time.
+	SchedulerPS2    = (1 << 2),
+	// The host has sent an output report over the control endpoint.
+	SchedulerOutput = (1 << 3),
+	SCHEDULER_EVENTS = 4
+} SCHEDULER_EVENT;
+
+/* The Task struct. Tasks go in a table in priority order, highest first, and each runs once for any number of its
+ * events posted since it last ran. A task must return promptly: nothing else runs until it does. */
+typedef struct {
+	void          (*Run)(void);
+	uint8_t         Events;
+	// Instrumentation slots for how long the task ran, and how long it waited after its first event to start.
+	INSTRUMENT_SLOT Duration;
+	INSTRUMENT_SLOT Latency;
+} Scheduler_Task_t;
+
+// At most 8 tasks, as the ready set is a byte.
+void Scheduler_Init(const Scheduler_Task_t* const tasks, uint8_t count);
+void Scheduler_Post(uint8_t events);
+bool Scheduler_Step(void);
+void Scheduler_Idle(void);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "USBemani.h"
+#include "Config.h"
+
+// Host tests. Each test is its own program, linked against the host build of the firmware, and exits non-zero if
+// anything it checked was wrong. A failed check says where and why, then the test carries on, so one run shows
+// everything that's wrong at once. Run "make check".
+
+extern Settings_Button_t *Button;
+extern Settings_Lights_t *Lights;
+extern Settings_Device_t *Device;
+
+// The firmware samples at 4kHz, and the host polls us every frame.
+#define TEST_TICKS_PER_FRAME 4
+
+static int TestChecks, TestFailures;
+
+#define CHECK(condition, ...) do {                                                   \
+	TestChecks++;                                                                    \
+	if (!(condition)) {                                                              \
+		TestFailures++;                                                              \
+		printf("%s:%d: failed: %s: ", __FILE__, __LINE__, #condition);               \
+		printf(__VA_ARGS__);                                                         \
+		printf("\n");                                                                \
+	}                                                                                \
+} while (0)
+
+// Brings the firmware up as its main() does, short of its loop, on an erased EEPROM, and has the host configure it.
+static inline void Test_Boot(void) {
+	memset(Host_EEPROM, 0xFF, sizeof(Host_EEPROM));
+
+	Config_Init();
+	Config_AddressButton(&Button);
+	Config_AddressLights(&Lights);
+	Config_AddressDevice(&Device);
+
+	SetupHardware();
+	SetupScheduler();
+	USB_Init();
+	GlobalInterruptEnable();
+	Host_USB_Configure();
+}
+
+// One USB frame: a frame's worth of timer interrupts, then the main loop until it would sleep.
+static inline void Test_Frame(void) {
+	for (uint8_t i = 0; i < TEST_TICKS_PER_FRAME; i++) Host_Tick();
+	Host_USB_StartOfFrame();
+	while (Scheduler_Step());
+}
+
+static inline int Test_Done(const char* name) {
+	printf("%s: %d checks, %d failed\n", name, TestChecks, TestFailures);
+	return TestFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,188 @@
+// Pin maps. This presses each button and lights each light on its own, and checks it lands on the pin the board's
+// pinout says it should, with nothing else moving. The pinouts below are written out by hand, from the wiring, rather
+// than taken from Board.h, so a mistake there shows up here. Pins an analog input has taken have no button or light.
+
+#include "Test.h"
+#include "Lights.h"
+#include "PS2.h"
+#include "Board.h"
+
+// One pin, by its registers.
+typedef struct {
+	volatile uint8_t* Pin;
+	volatile uint8_t* Port;
+	volatile uint8_t* DDR;
+	uint8_t           Mask;
+} Pin_t;
+
+#define PIN(port, bit) { &PIN##port, &PORT##port, &DDR##port, (1 << (bit)) }
+#define NO_PIN         { NULL, NULL, NULL, 0 }
+
+#define PINS 12
+
+#if (BOARD_PROFILE == PROFILE_HOME) || (BOARD_PROFILE == PROFILE_ARCADE)
+static const Pin_t Buttons[PINS] = {
+	PIN(D, 0), PIN(D, 1), PIN(D, 2), PIN(D, 3), PIN(D, 4), PIN(D, 5), PIN(D, 6), PIN(D, 7),
+	PIN(B, 4), PIN(B, 5), PIN(B, 6), PIN(B, 7),
+};
+#if defined(SHIFT_REGISTER_BUTTONS)
+// The USART and the shift registers' load pin have PD2-PD5.
+static const Pin_t LightPins[PINS] = {
+	PIN(D, 0), PIN(D, 1), NO_PIN,    NO_PIN,    NO_PIN,    NO_PIN,    PIN(D, 6), PIN(D, 7),
+	PIN(B, 4), PIN(B, 5), PIN(B, 6), PIN(B, 7),
+};
+#else
+#define LightPins Buttons
+#endif
+static const Pin_t Encoders[4] = { PIN(F, 0), PIN(F, 1), PIN(F, 4), PIN(F, 5) };
+static const Pin_t Latch       = PIN(F, 7);
+static const Pin_t LED         = PIN(E, 6);
+#define LED_ACTIVE_LOW false
+#if (BOARD_PROFILE == PROFILE_ARCADE)
+#define TYPE ARCADE
+#else
+#define TYPE HOME
+#endif
+#elif (BOARD_PROFILE == PROFILE_PROMICRO)
+static const Pin_t Buttons[PINS] = {
+	PIN(D, 0), PIN(D, 1), PIN(D, 2), PIN(D, 3), PIN(D, 4), PIN(C, 6), PIN(D, 7), PIN(E, 6),
+	PIN(B, 4), PIN(B, 5), PIN(B, 6), PIN(B, 2),
+};
+#define LightPins Buttons
+static const Pin_t Encoders[4] = { PIN(F, 4), PIN(F, 5), PIN(F, 6), PIN(F, 7) };
+static const Pin_t Latch       = PIN(B, 3);
+static const Pin_t LED         = PIN(B, 0);
+#define LED_ACTIVE_LOW true
+#define TYPE HOME
+#endif
+
+// Whether an analog input has this pin, leaving it to nothing else.
+static bool Analog(const Pin_t* Pin) {
+	#if defined(ANALOG_INPUTS)
+	// The pin under each ADC channel, as the datasheet has them.
+	static const Pin_t ADCPins[14] = {
+		PIN(F, 0), PIN(F, 1), NO_PIN,    NO_PIN,    PIN(F, 4), PIN(F, 5), PIN(F, 6), PIN(F, 7),
+		PIN(D, 4), PIN(D, 6), PIN(D, 7), PIN(B, 4), PIN(B, 5), PIN(B, 6),
+	};
+	static const uint8_t Channels[] = { ANALOG_INPUTS };
+
+	for (uint8_t i = 0; i < sizeof(Channels); i++) {
+		if ((ADCPins[Channels[i]].Pin == Pin->Pin) && (ADCPins[Channels[i]].Mask == Pin->Mask)) return true;
+	}
+	#endif
+	(void)Pin;
+	return false;
+}
+
+static void ReleaseAll(void) {
+	PINB = PINC = PIND = PINE = PINF = 0xFF;
+	memset(Host_ShiftRegisters, 0xFF, sizeof(Host_ShiftRegisters));
+}
+
+// With debouncing off, each button follows its pin from the next tick.
+static void CheckButtons(void) {
+	Settings_Debounce_t* Debounce;
+
+	Config_AddressDebounce(&Debounce);
+	memset(Debounce->DebounceTime, 0, sizeof(Debounce->DebounceTime));
+	Debounce->DebounceIntegrate = 0;
+	ReleaseAll();
+	Button_Init();
+
+	#if defined(SHIFT_REGISTER_BUTTONS)
+	// Buttons 1-8 are inputs A-H on the first shift register, 9-16 on the second, and so on. The pins are the lights'.
+	(void)Buttons;
+	for (uint8_t i = 0; i < SHIFT_REGISTER_BUTTONS; i++) {
+		ReleaseAll();
+		Host_ShiftRegisters[i / 8] &= (uint8_t)~(1 << (i % 8));
+		Host_Tick();
+		CHECK(Button_GetLast() == ((Buttons_t)1 << i), "input %u on shift register %u read as buttons 0x%08lX", i % 8,
+		      i / 8, (unsigned long)Button_GetLast());
+	}
+	#else
+	for (uint8_t i = 0; i < PINS; i++) {
+		Buttons_t Expected = Analog(&Buttons[i]) ? 0 : (1 << i);
+
+		ReleaseAll();
+		*Buttons[i].Pin &= (uint8_t)~Buttons[i].Mask;
+		Host_Tick();
+		CHECK(Button_GetLast() == Expected, "button %u's pin read as buttons 0x%04X", i + 1, (unsigned)Button_GetLast());
+
+		// Read as an input with its pull-up, unless it isn't ours.
+		if (Expected) {
+			CHECK(!(*Buttons[i].DDR & Buttons[i].Mask), "button %u's pin is an output", i + 1);
+			CHECK(*Buttons[i].Port & Buttons[i].Mask, "button %u's pin has no pull-up", i + 1);
+		} else {
+			CHECK(!(*Buttons[i].Port & Buttons[i].Mask), "button %u's pin, an analog input, has a pull-up", i + 1);
+		}
+	}
+	#endif
+
+	ReleaseAll();
+	Host_Tick();
+}
+
+// Each light drives its own pin high, and every other light's pin low, then the latch takes them.
+static void CheckLights(void) {
+	for (uint8_t i = 0; i < PINS; i++) {
+		for (uint8_t j = 0; j < PINS; j++) {
+			if (!LightPins[j].Port) continue;
+			*LightPins[j].DDR  &= (uint8_t)~LightPins[j].Mask;
+			*LightPins[j].Port &= (uint8_t)~LightPins[j].Mask;
+		}
+
+		Lights_SetState(1 << i);
+
+		for (uint8_t j = 0; j < PINS; j++) {
+			if (!LightPins[j].Port) continue;
+
+			if (Analog(&LightPins[j])) {
+				CHECK(!(*LightPins[j].DDR & LightPins[j].Mask), "light %u's pin, an analog input, was driven", j + 1);
+				continue;
+			}
+			CHECK(*LightPins[j].DDR & LightPins[j].Mask, "light %u's pin isn't an output", j + 1);
+			CHECK(!(*LightPins[j].Port & LightPins[j].Mask) == (i != j), "light %u's pin is %s with light %u on", j + 1,
+			      (*LightPins[j].Port & LightPins[j].Mask) ? "high" : "low", i + 1);
+		}
+
+		CHECK(*Latch.DDR & Latch.Mask, "the latch pin isn't an output");
+		CHECK(!(*Latch.Port & Latch.Mask), "the latch was left open");
+	}
+}
+
+// The onboard LED, which is on whenever any light is, and in PS2 mode.
+static bool LEDOn(void) {
+	if (!(*LED.DDR & LED.Mask)) return false;
+	return LED_ACTIVE_LOW ? !(*LED.Port & LED.Mask) : (*LED.Port & LED.Mask);
+}
+
+static void CheckLED(void) {
+	Lights_SetState(0x0001);
+	CHECK(LEDOn(), "the LED is off with a light on");
+	Lights_SetState(0x0000);
+	CHECK(!LEDOn(), "the LED is on with every light off");
+
+	Device->PS2Assert = 1;
+	PS2_LoadData();
+	CHECK(LEDOn(), "the LED is off in PS2 mode");
+	Device->PS2Assert = 0;
+	Lights_SetState(0x0000);
+}
+
+int main(void) {
+	Test_Boot();
+
+	CHECK(Device->DeviceType == TYPE, "board type is 0x%02X, expected 0x%02X", Device->DeviceType, TYPE);
+
+	// Encoders are inputs with their pull-ups, from startup.
+	for (uint8_t i = 0; i < 4; i++) {
+		CHECK(!(*Encoders[i].DDR & Encoders[i].Mask), "encoder pin %u is an output", i);
+		CHECK(*Encoders[i].Port & Encoders[i].Mask, "encoder pin %u has no pull-up", i);
+	}
+
+	CheckButtons();
+	CheckLights();
+	CheckLED();
+
+	return Test_Done("board");
+}
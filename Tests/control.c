@@ -0,0 +1,76 @@
+// Output reports over the control endpoint. SET_REPORT arrives in the USB interrupt, which only queues the report;
+// HID_Task processes it from the main loop. This checks that nothing is processed early, that queued reports are
+// processed in the order they came, and that a full queue stalls the request for the host to retry.
+
+#include "Test.h"
+
+// The queue holds one less than its size, so full and empty can be told apart.
+#define QUEUE_ROOM 3
+
+// Sends an output report as SET_REPORT. Returns how much the device took: all of it, or nothing if it stalled.
+static uint16_t SetReport(uint16_t Lights, uint8_t Command, uint8_t Data) {
+	Output_t Report = { .Lights = Lights, .Command = Command, .Data = Data };
+
+	USB_Request_Header_t Request = {
+		.bmRequestType = REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE,
+		.bRequest      = HID_REQ_SetReport,
+		.wValue        = (0x02 << 8),
+		.wIndex        = INTERFACE_ID_GenericHID,
+		.wLength       = sizeof(Report),
+	};
+	return Host_USB_ControlRequest(&Request, &Report);
+}
+
+// Sends an output report on the OUT endpoint instead.
+static void WriteOUT(uint8_t Command, uint8_t Data) {
+	Output_t Report = { .Lights = 0, .Command = Command, .Data = Data };
+
+	Host_USB_WriteOUT(GENERIC_OUT_EPADDR, &Report, sizeof(Report));
+}
+
+static void GetName(char* Name) {
+	Config_GetName(Name);
+	Name[CONFIG_NAME_LENGTH] = '\0';
+}
+
+int main(void) {
+	char Before[CONFIG_NAME_LENGTH + 1], After[CONFIG_NAME_LENGTH + 1];
+
+	Test_Boot();
+	Test_Frame();
+	GetName(Before);
+
+	// Name commands write EEPROM, so they can't be done from the interrupt. In order, these cut the name down to "x";
+	// in any other order, they leave it longer.
+	CHECK(SetReport(0, 0x20, 'x') == sizeof(Output_t), "first report stalled");
+	CHECK(SetReport(0, 0x21, 'y') == sizeof(Output_t), "second report stalled");
+	CHECK(SetReport(0, 0x21, 0)   == sizeof(Output_t), "third report stalled");
+
+	// The queue is full, so the next one stalls, and nothing has been done yet.
+	CHECK(SetReport(0, 0x22, 'z') == 0, "a report past the queue's %u was taken", QUEUE_ROOM);
+	GetName(After);
+	CHECK(!strcmp(Before, After), "name changed to \"%s\" from the interrupt", After);
+
+	// The main loop processes all of them, in order.
+	Test_Frame();
+	GetName(After);
+	CHECK(!strcmp(After, "x"), "name is \"%s\", expected \"x\"", After);
+
+	// With the queue empty again, the host's retry goes through. Its lights only take effect from the main loop.
+	Lights->LightsAssert = 0;
+	CHECK(SetReport(0x0001, 0x00, 0x00) == sizeof(Output_t), "retry stalled");
+	CHECK(Lights->LightsAssert == 0, "lights were set from the interrupt");
+	Test_Frame();
+	CHECK(Lights->LightsAssert != 0, "lights were never set");
+
+	// Reports on the OUT endpoint go around the queue, but still come after anything already in it. In order, these
+	// leave "a"; with the OUT endpoint first, "ab".
+	CHECK(SetReport(0, 0x20, 'a') == sizeof(Output_t), "report stalled on an empty queue");
+	CHECK(SetReport(0, 0x21, 'b') == sizeof(Output_t), "report stalled on a queue with room");
+	WriteOUT(0x21, 0);
+	Test_Frame();
+	GetName(After);
+	CHECK(!strcmp(After, "a"), "name is \"%s\", expected \"a\"", After);
+
+	return Test_Done("control");
+}
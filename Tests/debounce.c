@@ -0,0 +1,84 @@
+// Debouncing. This drives button 1's pin one timer tick at a time and checks what the firmware makes of it, for each
+// way a button can be debounced: eager, integrating, and not at all. Each trace is the pin, then the button, one
+// character a tick, with 1 for pressed.
+
+#include "Test.h"
+
+static Settings_Debounce_t* Debounce;
+
+// Button 1 is PD0 on every board we have pins for.
+static void SetPin(bool Pressed) {
+	if (Pressed) PIND &= (uint8_t)~0x01;
+	else         PIND |= 0x01;
+}
+
+// Sets button 1 up to debounce this way, starting from released, with nothing left over from before.
+static void Setup(uint8_t Time, bool Integrate) {
+	SetPin(false);
+	Debounce->DebounceTime[0]   = Time;
+	Debounce->DebounceIntegrate = Integrate ? 0x0001 : 0x0000;
+	Button_Init();
+}
+
+// Plays the pin trace into the button, one tick a character, and checks the button comes out as expected.
+static void Trace(const char* Name, const char* Pin, const char* Expected) {
+	char Button[64];
+	uint8_t i;
+
+	for (i = 0; Pin[i] && (i < sizeof(Button) - 1); i++) {
+		SetPin(Pin[i] == '1');
+		Host_Tick();
+		Button[i] = (Button_GetLast() & 0x0001) ? '1' : '0';
+	}
+	Button[i] = '\0';
+
+	CHECK(!strcmp(Button, Expected), "%s: pin %s gave %s, expected %s", Name, Pin, Button, Expected);
+}
+
+// Sends an output report with a command, as the host would, and gives the main loop a frame to act on it.
+static void Command(uint8_t Command, uint8_t Data) {
+	Output_t Report = { .Lights = 0, .Command = Command, .Data = Data };
+
+	Host_USB_WriteOUT(GENERIC_OUT_EPADDR, &Report, sizeof(Report));
+	Test_Frame();
+}
+
+int main(void) {
+	Test_Boot();
+	Config_AddressDebounce(&Debounce);
+
+	// Eager: the first edge goes out on the tick it's seen, then the pin is ignored for 4 ticks.
+	Setup(4, false);
+	Trace("eager", "0111111110000000", "0111111110000000");
+	Setup(4, false);
+	Trace("eager bounce", "0101100000000000", "0111110000000000");
+	Setup(4, false);
+	Trace("eager glitch", "0100000000000000", "0111110000000000");
+
+	// Integrating: the pin has to hold a change for 4 ticks, net of bounces, before it goes out.
+	Setup(4, true);
+	Trace("integrate", "0111111100000000", "0000111111100000");
+	Setup(4, true);
+	Trace("integrate bounce", "0110111110000000", "0000001111110000");
+	Setup(4, true);
+	Trace("integrate glitch", "0100000000000000", "0000000000000000");
+
+	// Off: the pin, as it is.
+	Setup(0, false);
+	Trace("off", "0101100100000000", "0101100100000000");
+
+	// A press too short to see from the host is still reported, once, to each reader.
+	Setup(4, true);
+	Trace("integrate short", "0111100000000000", "0000111100000000");
+	CHECK(Button_GetState(ReaderJoystick) & 0x0001, "short press never reached the joystick");
+	CHECK(!(Button_GetState(ReaderJoystick) & 0x0001), "short press reached the joystick twice");
+
+	// And the host can change all of this: integrate button 1 over 2 ticks, then apply.
+	SetPin(false);
+	Command(0x40 + offsetof(Settings_t, Debounce.DebounceIntegrate), 0x01);
+	Command(0x40 + offsetof(Settings_t, Debounce.DebounceTime[0]), 2);
+	Command(0xF0, 0x00);
+	Trace("from the host", "0111100000000000", "0011110000000000");
+
+	return Test_Done("debounce");
+}
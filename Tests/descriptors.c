@@ -0,0 +1,240 @@
+// Enumeration. This fetches our descriptors as a USB host would, and checks that they agree with each other and with
+// what the firmware actually sends: the configuration descriptor's lengths and counts, each interface's report
+// descriptor, and the size of each report against its endpoint and against what comes out of it.
+
+#include "Test.h"
+
+#define MAX_INTERFACES 4
+
+// What the configuration descriptor says about one interface.
+typedef struct {
+	uint8_t  Number;
+	uint8_t  TotalEndpoints;
+	uint8_t  Endpoints;
+	uint16_t ReportLength;
+	uint8_t  INAddress;
+	uint16_t INSize;
+	uint8_t  OUTAddress;
+	uint16_t OUTSize;
+} Interface_t;
+
+// What a report descriptor says about its reports, in bits. We never use report IDs, so there's one of each.
+typedef struct {
+	uint32_t Input;
+	uint32_t Output;
+	uint32_t Feature;
+} Reports_t;
+
+// Walks a report descriptor, adding up the size of each kind of report. Returns false if it isn't well formed: an
+// item running off the end, a collection left open or closed twice, or anything we don't expect to use.
+static bool ParseReport(const uint8_t* Report, uint16_t Length, Reports_t* Reports) {
+	uint32_t Size = 0, Count = 0;
+	int      Depth = 0;
+
+	memset(Reports, 0, sizeof(*Reports));
+	for (uint16_t i = 0; i < Length; ) {
+		uint8_t  Prefix = Report[i];
+		uint8_t  Bytes  = ((Prefix & 0x03) == 0x03) ? 4 : (Prefix & 0x03);
+		uint32_t Value  = 0;
+
+		// Long items are reserved, and report IDs, push and pop would all change the sums below.
+		if ((Prefix == 0xFE) || ((Prefix & 0xFC) == 0x84) || ((Prefix & 0xFC) == 0xA4) || ((Prefix & 0xFC) == 0xB4)) {
+			printf("unexpected item 0x%02X at %u\n", Prefix, i);
+			return false;
+		}
+		if ((i + 1 + Bytes) > Length) {
+			printf("item at %u runs off the end\n", i);
+			return false;
+		}
+		for (uint8_t b = 0; b < Bytes; b++) Value |= (uint32_t)Report[i + 1 + b] << (8 * b);
+
+		switch (Prefix & 0xFC) {
+			case 0x74: Size  = Value;                     break; // Report Size
+			case 0x94: Count = Value;                     break; // Report Count
+			case 0x80: Reports->Input   += Size * Count;  break;
+			case 0x90: Reports->Output  += Size * Count;  break;
+			case 0xB0: Reports->Feature += Size * Count;  break;
+			case 0xA0: Depth++;                           break; // Collection
+			case 0xC0:                                           // End Collection
+				if (--Depth < 0) {
+					printf("collection closed at %u was never opened\n", i);
+					return false;
+				}
+				break;
+		}
+		i += 1 + Bytes;
+	}
+
+	if (Depth) printf("%d collections left open\n", Depth);
+	return Depth == 0;
+}
+
+// Interrupt endpoints on the chip are a power of two from 8 to 64 bytes.
+static bool ValidEndpointSize(uint16_t Size) {
+	return (Size == 8) || (Size == 16) || (Size == 32) || (Size == 64);
+}
+
+static void CheckDevice(void) {
+	USB_Descriptor_Device_t Device;
+	uint16_t                Size = Host_USB_GetDescriptor(DTYPE_Device << 8, 0, &Device, sizeof(Device));
+
+	CHECK(Size == sizeof(Device), "device descriptor is %u bytes", Size);
+	CHECK(Device.Header.Size == sizeof(Device), "device descriptor says it's %u bytes", Device.Header.Size);
+	CHECK(Device.Header.Type == DTYPE_Device, "device descriptor has type %u", Device.Header.Type);
+	CHECK(Device.Endpoint0Size == FIXED_CONTROL_ENDPOINT_SIZE, "control endpoint is %u bytes", Device.Endpoint0Size);
+	CHECK(Device.NumberOfConfigurations == 1, "%u configurations", Device.NumberOfConfigurations);
+}
+
+// Reads the configuration descriptor the way a host does, header first, and sorts what's in it by interface.
+static uint8_t ReadConfiguration(Interface_t* Interfaces) {
+	USB_Descriptor_Configuration_Header_t Header;
+	uint8_t                               Configuration[512];
+	Interface_t*                          Current = NULL;
+	uint8_t                               Count   = 0;
+
+	Host_USB_GetDescriptor(DTYPE_Configuration << 8, 0, &Header, sizeof(Header));
+	CHECK(Header.Header.Type == DTYPE_Configuration, "configuration descriptor has type %u", Header.Header.Type);
+	CHECK(Header.TotalConfigurationSize <= sizeof(Configuration), "configuration is %u bytes",
+	      Header.TotalConfigurationSize);
+	if (Header.TotalConfigurationSize > sizeof(Configuration)) return 0;
+
+	uint16_t Total = Host_USB_GetDescriptor(DTYPE_Configuration << 8, 0, Configuration, Header.TotalConfigurationSize);
+	CHECK(Total == Header.TotalConfigurationSize, "configuration is %u bytes, but says it's %u", Total,
+	      Header.TotalConfigurationSize);
+
+	for (uint16_t i = 0; i < Total; i += Configuration[i]) {
+		const USB_Descriptor_Header_t* Descriptor = (const USB_Descriptor_Header_t*)&Configuration[i];
+
+		if ((Descriptor->Size < sizeof(USB_Descriptor_Header_t)) || ((i + Descriptor->Size) > Total)) {
+			CHECK(false, "descriptor at %u is %u bytes, in a %u byte configuration", i, Descriptor->Size, Total);
+			break;
+		}
+
+		switch (Descriptor->Type) {
+			case DTYPE_Interface:
+			{
+				const USB_Descriptor_Interface_t* Interface = (const USB_Descriptor_Interface_t*)Descriptor;
+
+				CHECK(Count < MAX_INTERFACES, "more than %u interfaces", MAX_INTERFACES);
+				if (Count >= MAX_INTERFACES) return Count;
+				CHECK(Interface->InterfaceNumber == Count, "interface %u is numbered %u", Count,
+				      Interface->InterfaceNumber);
+
+				Current = &Interfaces[Count++];
+				memset(Current, 0, sizeof(*Current));
+				Current->Number         = Interface->InterfaceNumber;
+				Current->TotalEndpoints = Interface->TotalEndpoints;
+				break;
+			}
+			case HID_DTYPE_HID:
+				CHECK(Current, "HID descriptor at %u comes before any interface", i);
+				if (Current) Current->ReportLength = ((const USB_HID_Descriptor_HID_t*)Descriptor)->HIDReportLength;
+				break;
+			case DTYPE_Endpoint:
+			{
+				const USB_Descriptor_Endpoint_t* Endpoint = (const USB_Descriptor_Endpoint_t*)Descriptor;
+
+				CHECK(Current, "endpoint at %u comes before any interface", i);
+				if (!Current) break;
+				CHECK(ValidEndpointSize(Endpoint->EndpointSize), "endpoint 0x%02X is %u bytes",
+				      Endpoint->EndpointAddress, Endpoint->EndpointSize);
+
+				Current->Endpoints++;
+				if (Endpoint->EndpointAddress & ENDPOINT_DIR_IN) {
+					Current->INAddress  = Endpoint->EndpointAddress;
+					Current->INSize     = Endpoint->EndpointSize;
+				} else {
+					Current->OUTAddress = Endpoint->EndpointAddress;
+					Current->OUTSize    = Endpoint->EndpointSize;
+				}
+				break;
+			}
+		}
+	}
+
+	CHECK(Count == Header.TotalInterfaces, "%u interfaces, but the configuration says %u", Count,
+	      Header.TotalInterfaces);
+	return Count;
+}
+
+// Checks one interface's report descriptor, and the reports that go with it.
+static void CheckInterface(const Interface_t* Interface) {
+	uint8_t   Report[1024];
+	uint8_t   Packet[64];
+	Reports_t Reports;
+
+	CHECK(Interface->Endpoints == Interface->TotalEndpoints, "interface %u has %u endpoints, but says %u",
+	      Interface->Number, Interface->Endpoints, Interface->TotalEndpoints);
+	CHECK(Interface->INAddress, "interface %u has no IN endpoint", Interface->Number);
+
+	uint16_t Length = Host_USB_GetDescriptor(HID_DTYPE_Report << 8, Interface->Number, Report, sizeof(Report));
+	CHECK(Length == Interface->ReportLength, "interface %u report descriptor is %u bytes, but its HID descriptor says %u",
+	      Interface->Number, Length, Interface->ReportLength);
+	CHECK(Length && (Length <= sizeof(Report)), "interface %u report descriptor is %u bytes", Interface->Number, Length);
+	if (!Length || (Length > sizeof(Report))) return;
+
+	bool Parsed = ParseReport(Report, Length, &Reports);
+	CHECK(Parsed, "interface %u report descriptor is malformed", Interface->Number);
+	if (!Parsed) return;
+
+	CHECK(!(Reports.Input % 8) && !(Reports.Output % 8) && !(Reports.Feature % 8),
+	      "interface %u reports aren't whole bytes: %u in, %u out, %u feature", Interface->Number,
+	      Reports.Input, Reports.Output, Reports.Feature);
+
+	uint16_t InputSize = Reports.Input / 8;
+	CHECK(InputSize && (InputSize <= Interface->INSize), "interface %u input report is %u bytes, on a %u byte endpoint",
+	      Interface->Number, InputSize, Interface->INSize);
+	if (Interface->OUTAddress)
+		CHECK(Reports.Output / 8 <= Interface->OUTSize, "interface %u output report is %u bytes, on a %u byte endpoint",
+		      Interface->Number, Reports.Output / 8, Interface->OUTSize);
+
+	if (Interface->Number == INTERFACE_ID_GenericHID) {
+		CHECK(InputSize == sizeof(Input_t), "input report is %u bytes, Input_t is %zu", InputSize, sizeof(Input_t));
+		CHECK(Reports.Output / 8 == sizeof(Output_t), "output report is %u bytes, Output_t is %zu", Reports.Output / 8,
+		      sizeof(Output_t));
+		CHECK(Reports.Feature / 8 == sizeof(Feature_t), "feature report is %u bytes, Feature_t is %zu",
+		      Reports.Feature / 8, sizeof(Feature_t));
+	}
+
+	// Each report has to come out of its endpoint whole, in a single packet, as the descriptor describes it.
+	int Sent = Host_USB_ReadIN(Interface->INAddress, Packet, sizeof(Packet));
+	CHECK(Sent == InputSize, "interface %u sent a %d byte packet for a %u byte report", Interface->Number, Sent,
+	      InputSize);
+	while (Host_USB_ReadIN(Interface->INAddress, Packet, sizeof(Packet)) >= 0);
+
+	// And GET_REPORT hands back the same.
+	USB_Request_Header_t Request = {
+		.bmRequestType = REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE,
+		.bRequest      = HID_REQ_GetReport,
+		.wValue        = (0x01 << 8),
+		.wIndex        = Interface->Number,
+		.wLength       = sizeof(Report),
+	};
+	uint16_t Returned = Host_USB_ControlRequest(&Request, Report);
+	CHECK(Returned == InputSize, "interface %u GET_REPORT returned %u bytes for a %u byte report", Interface->Number,
+	      Returned, InputSize);
+
+	if (Reports.Feature) {
+		Request.wValue = (0x03 << 8);
+		Returned = Host_USB_ControlRequest(&Request, Report);
+		CHECK(Returned == Reports.Feature / 8, "interface %u feature GET_REPORT returned %u bytes for a %u byte report",
+		      Interface->Number, Returned, Reports.Feature / 8);
+	}
+}
+
+int main(void) {
+	Interface_t Interfaces[MAX_INTERFACES];
+
+	Test_Boot();
+	CheckDevice();
+
+	uint8_t Count = ReadConfiguration(Interfaces);
+	CHECK(Count == INTERFACE_ID_Total, "%u interfaces, built with %u", Count, INTERFACE_ID_Total);
+
+	// The host polls every endpoint once before we look at what came out.
+	Test_Frame();
+
+	for (uint8_t i = 0; i < Count; i++) CheckInterface(&Interfaces[i]);
+
+	return Test_Done("descriptors");
+}
@@ -0,0 +1,124 @@
+// Feature report layout. libusemani keeps its own copy of where everything is in the feature report, so the host tools
+// build without the firmware's headers. This checks that copy against Feature_t, field by field, then reads the
+// feature report as a host would and checks each part is where libusemani will look for it.
+
+#include "Test.h"
+#include "../libusemani/settings.h"
+#include "../libusemani/report.h"
+
+// One settings field, as the firmware packs it and as libusemani has it.
+typedef struct {
+	const char* Name;
+	size_t      Firmware;
+	size_t      Host;
+} Field_t;
+
+#define FIELD(field, ofs) { #field, offsetof(Settings_t, field), ofs }
+
+static const Field_t Fields[] = {
+	FIELD(Rotary.RotaryInvert,         USEMANI_OFS_ROTARY_INVERT),
+	FIELD(Rotary.RotaryHold,           USEMANI_OFS_ROTARY_HOLD),
+	FIELD(Rotary.RotaryPPR,            USEMANI_OFS_ROTARY_PPR),
+	FIELD(Lights.LightsInvertTT,       USEMANI_OFS_LIGHTS_INVERT_TT),
+	FIELD(Lights.LightsComm,           USEMANI_OFS_LIGHTS_COMM),
+	FIELD(Lights.LightsAssert,         USEMANI_OFS_LIGHTS_ASSERT),
+	FIELD(Device.DeviceType,           USEMANI_OFS_DEVICE_TYPE),
+	FIELD(Device.DeviceComm,           USEMANI_OFS_DEVICE_COMM),
+	FIELD(Device.PS2Assert,            USEMANI_OFS_PS2_ASSERT),
+	FIELD(Device.DeviceName,           USEMANI_OFS_DEVICE_NAME),
+	FIELD(Button.ButtonMap,            USEMANI_OFS_BUTTON_MAP),
+	FIELD(Button.CustomMap,            USEMANI_OFS_CUSTOM_MAP),
+	FIELD(Keyboard.KeyMap,             USEMANI_OFS_KEY_MAP),
+	FIELD(Keyboard.RotaryMap,          USEMANI_OFS_ROTARY_MAP),
+	FIELD(Debounce.DebounceIntegrate,  USEMANI_OFS_DEBOUNCE_INTEGRATE),
+	FIELD(Debounce.DebounceTime,       USEMANI_OFS_DEBOUNCE_TIME),
+	FIELD(Bank.BankProfile,            USEMANI_OFS_BANK_PROFILE),
+	FIELD(Bank.BankCombo,              USEMANI_OFS_BANK_COMBO),
+};
+
+// Sends an output report with a command, as the host would, and gives the main loop a frame to act on it.
+static void Command(uint8_t Command, uint8_t Data) {
+	Output_t Report = { .Lights = 0, .Command = Command, .Data = Data };
+
+	Host_USB_WriteOUT(GENERIC_OUT_EPADDR, &Report, sizeof(Report));
+	Test_Frame();
+}
+
+// Reads the feature report. Returns its length.
+static uint16_t GetFeature(uint8_t* Report, uint16_t Length) {
+	USB_Request_Header_t Request = {
+		.bmRequestType = REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE,
+		.bRequest      = HID_REQ_GetReport,
+		.wValue        = (0x03 << 8),
+		.wIndex        = INTERFACE_ID_GenericHID,
+		.wLength       = Length,
+	};
+	return Host_USB_ControlRequest(&Request, Report);
+}
+
+int main(void) {
+	Settings_Debounce_t* Debounce;
+	uint8_t              Report[256];
+
+	Test_Boot();
+	Config_AddressDebounce(&Debounce);
+
+	CHECK(sizeof(Settings_t) == USEMANI_SETTINGS_SIZE, "Settings_t is %zu bytes, libusemani has %u", sizeof(Settings_t),
+	      USEMANI_SETTINGS_SIZE);
+	CHECK(CONFIG_NAME_LENGTH == USEMANI_NAME_LENGTH, "names are %u characters, libusemani has %u", CONFIG_NAME_LENGTH,
+	      USEMANI_NAME_LENGTH);
+	CHECK(offsetof(Feature_t, Name) == USEMANI_SETTINGS_SIZE, "the name is at %zu, libusemani has %u",
+	      offsetof(Feature_t, Name), USEMANI_SETTINGS_SIZE);
+	for (uint8_t i = 0; i < sizeof(Fields) / sizeof(Fields[0]); i++) {
+		CHECK(Fields[i].Firmware == Fields[i].Host, "%s is at %zu, libusemani has %zu", Fields[i].Name,
+		      Fields[i].Firmware, Fields[i].Host);
+	}
+
+	#if defined(INSTRUMENTATION)
+	CHECK(offsetof(Feature_t, Instrument) == USEMANI_INSTRUMENT_OFFSET, "the diagnostics are at %zu, libusemani has %u",
+	      offsetof(Feature_t, Instrument), USEMANI_INSTRUMENT_OFFSET);
+	CHECK(sizeof(Instrument_Report_t) == USEMANI_INSTRUMENT_REPORT_SIZE, "the diagnostics are %zu bytes, libusemani has %u",
+	      sizeof(Instrument_Report_t), USEMANI_INSTRUMENT_REPORT_SIZE);
+	CHECK(INSTRUMENT_SLOTS == USEMANI_INSTRUMENT_SLOTS, "%u diagnostic slots, libusemani has %u", INSTRUMENT_SLOTS,
+	      USEMANI_INSTRUMENT_SLOTS);
+	#define FEATURE_SIZE (USEMANI_FEATURE_SIZE + USEMANI_INSTRUMENT_REPORT_SIZE)
+	#else
+	#define FEATURE_SIZE USEMANI_FEATURE_SIZE
+	#endif
+
+	// A debounce time, the last settings byte and the first name character land where libusemani reads them.
+	Command(USEMANI_CMD_NAME, 'x');
+	Command(USEMANI_CMD_NAME + 1, 0);
+	Debounce->DebounceTime[15] = 0xA5;
+	Command(USEMANI_CMD_SETTINGS + USEMANI_OFS_BANK_COMBO + 1, 0xC3);
+	Command(USEMANI_CMD_APPLY, 0);
+
+	uint16_t Length = GetFeature(Report, sizeof(Report));
+	CHECK(Length == FEATURE_SIZE, "feature report is %u bytes, libusemani expects %u", Length, FEATURE_SIZE);
+	CHECK(Report[USEMANI_OFS_DEBOUNCE_TIME + 15] == 0xA5, "the last debounce time reads as 0x%02X",
+	      Report[USEMANI_OFS_DEBOUNCE_TIME + 15]);
+	CHECK(Report[USEMANI_SETTINGS_SIZE - 1] == 0xC3, "the profile combo's high byte reads as 0x%02X",
+	      Report[USEMANI_SETTINGS_SIZE - 1]);
+	CHECK(Report[USEMANI_SETTINGS_SIZE] == 'x', "the name starts with 0x%02X", Report[USEMANI_SETTINGS_SIZE]);
+
+	// A name header that isn't one, erased or too short to hold a header, is no name at all.
+	static const uint8_t BadSizes[] = { 0xFF, 0x00, 0x01, 2 + (CONFIG_NAME_LENGTH * 2) + 2 };
+	const uint8_t*       NameHeader;
+	Config_AddressName(&NameHeader);
+	for (uint8_t i = 0; i < sizeof(BadSizes); i++) {
+		Host_EEPROM[(uintptr_t)NameHeader] = BadSizes[i];
+		GetFeature(Report, sizeof(Report));
+		for (uint8_t j = 0; j < USEMANI_NAME_LENGTH; j++) {
+			CHECK(!Report[USEMANI_SETTINGS_SIZE + j], "name size 0x%02X gave character %u as 0x%02X", BadSizes[i], j,
+			      Report[USEMANI_SETTINGS_SIZE + j]);
+		}
+	}
+
+	#if defined(INSTRUMENTATION)
+	// HID_Task has run every frame, so its count is where libusemani decodes it.
+	const uint8_t* Slot = &Report[USEMANI_INSTRUMENT_OFFSET + (USEMANI_SLOT_HID_TASK * 8)];
+	CHECK(Slot[0] | Slot[1], "HID_Task's count reads as 0");
+	#endif
+
+	return Test_Done("layout");
+}
@@ -0,0 +1,72 @@
+// Profile switching. This holds a combo of buttons 11 and 12, presses the select button for a profile, and checks the
+// switch happens without the host ever seeing the buttons it took.
+
+#include "Test.h"
+
+static Settings_Bank_t* Bank;
+
+// Buttons 1, 2, 11 and 12 are PD0, PD1, PB6 and PB7 on the home board.
+#define SELECT_1  0x0001
+#define SELECT_2  0x0002
+#define COMBO     0x0C00
+
+static void SetPins(Buttons_t Pressed) {
+	PIND = (uint8_t)~(Pressed & (SELECT_1 | SELECT_2));
+	PINB = (uint8_t)~(((Pressed & 0x0400) ? 0x40 : 0) | ((Pressed & 0x0800) ? 0x80 : 0));
+}
+
+// Sends an output report with a command, as the host would, and gives the main loop a frame to act on it.
+static void Command(uint8_t Command, uint8_t Data) {
+	Output_t Report = { .Lights = 0, .Command = Command, .Data = Data };
+
+	Host_USB_WriteOUT(GENERIC_OUT_EPADDR, &Report, sizeof(Report));
+	Test_Frame();
+}
+
+// Holds these buttons for a frame, then checks none of the hidden ones reached the host.
+static void Hold(const char* Name, Buttons_t Pressed, Buttons_t Hidden) {
+	SetPins(Pressed);
+	Test_Frame();
+
+	Buttons_t Seen = Button_GetState(ReaderJoystick);
+	CHECK(Seen == (Pressed & ~Hidden), "%s: the joystick saw buttons 0x%04X", Name, (unsigned)Seen);
+}
+
+int main(void) {
+	Settings_Debounce_t* Debounce;
+
+	SetPins(0);
+	Test_Boot();
+	Config_AddressDebounce(&Debounce);
+	Config_AddressBank(&Bank);
+
+	// No debouncing, so each button follows its pin, and a combo of buttons 11 and 12. Button 2 selects profile 1.
+	memset(Debounce->DebounceTime, 0, sizeof(Debounce->DebounceTime));
+	Debounce->DebounceIntegrate = 0;
+	Command(0x40 + offsetof(Settings_t, Bank.BankCombo), COMBO & 0xFF);
+	Command(0x40 + offsetof(Settings_t, Bank.BankCombo) + 1, COMBO >> 8);
+	Command(0xF0, 0x00);
+
+	// Half the combo is just a button, but the whole of it is ours.
+	Hold("half the combo",        0x0400,                   0);
+	Hold("the combo",             COMBO,                    COMBO);
+	Hold("the combo and select",  COMBO | SELECT_2,         COMBO | SELECT_2);
+	CHECK(Bank->BankProfile == 1, "switched to profile %u, expected 1", Bank->BankProfile);
+
+	// Each button stays ours until it's let go, even once the combo is.
+	Hold("select, after",         SELECT_2,                 SELECT_2);
+	Hold("nothing",               0,                        0);
+	Hold("select, pressed again", SELECT_2,                 0);
+	CHECK(Bank->BankProfile == 1, "switched to profile %u without the combo", Bank->BankProfile);
+	Hold("nothing",               0,                        0);
+
+	// A switch the main loop hasn't caught up with yet survives the host applying its settings.
+	SetPins(COMBO | SELECT_1);
+	for (uint8_t i = 0; i < TEST_TICKS_PER_FRAME; i++) Host_Tick();
+	SetupHardware();
+	Test_Frame();
+	CHECK(Bank->BankProfile == 0, "an apply reverted the switch, to profile %u", Bank->BankProfile);
+	Hold("nothing",               0,                        0);
+
+	return Test_Done("profile");
+}
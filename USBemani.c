@@ -39,14 +39,61 @@
 #include "Button.h"
 #include "Lights.h"
 #include "PS2.h"
+#include "Keyboard.h"
+#include "Mouse.h"
+#include "Instrument.h"
 #include "Config.h"
+#include "Profile.h"
+
+#if defined(SHIFT_REGISTER_BUTTONS)
+#include <LUFA/Drivers/Peripheral/SerialSPI.h>
+#endif
 
 Settings_Button_t *Button;
 Settings_Lights_t *Lights;
 Settings_Device_t *Device;
 
+// Set by the bootloader command, and acted on by the main loop once the command's own transfer is done.
+bool BootloaderRequested;
+
+#if defined(LATENCY_PROBE)
+// The tag the host last asked us to echo, waiting for the next input report. Output reports are only ever processed
+// from the main loop, so this is never touched from an interrupt.
+uint8_t ProbeTag;
+#endif
+
+/** Control requests are handled from the USB interrupt, with our other interrupts still running and the main loop
+ *  stopped wherever it was. Anything the handlers can't do safely from there goes through these.
+ */
+// Output reports from SET_REPORT, waiting for HID_Task to process them. This must be a power of two.
+#define CONTROL_OUTPUT_SIZE 4
+
+static Output_t         ControlOutput[CONTROL_OUTPUT_SIZE];
+static volatile uint8_t ControlOutputHead;
+static volatile uint8_t ControlOutputTail;
+
+// The last report we sent on each IN endpoint, for GET_REPORT. Building a fresh one from the interrupt would take
+// button presses and events away from the endpoint, so HID_Task builds each into the spare copy and then switches over.
+static Input_t          LastInput[2];
+static volatile uint8_t LastInputIndex;
+
+#if defined(KEYBOARD_INTERFACE)
+static Keyboard_t       LastKeyboard[2];
+static volatile uint8_t LastKeyboardIndex;
+#endif
+
+/** Our tasks, highest priority first. Each runs when our interrupts post one of its events: a sample from timer 0,
+ *  a new USB frame, an output report over the control endpoint, or a poll from the PS2. With nothing to do, the main loop sleeps until the next.
+ */
+static const Scheduler_Task_t Tasks[] = {
+	{ .Run = HID_Task,     .Events = SchedulerTick | SchedulerFrame | SchedulerOutput, .Duration = InstrumentHIDTask, .Latency = InstrumentHIDLatency },
+	{ .Run = USB_Task,     .Events = SchedulerTick | SchedulerFrame,                   .Duration = InstrumentUSBTask, .Latency = InstrumentUSBLatency },
+	// If our interrupt is holding our PS2 assertion, we'll read in new data.
+	{ .Run = PS2_LoadData, .Events = SchedulerTick | SchedulerPS2,                     .Duration = InstrumentPS2Load, .Latency = InstrumentPS2Latency },
+};
+
 /** Main program entry point. This routine configures the hardware required by the application, then
- *  enters a loop to run the application tasks in sequence.
+ *  runs the application tasks as their events come in.
  */
 int main(void)
 {
@@ -59,35 +106,67 @@ int main(void)
 	Config_AddressDevice(&Device);
 
 	SetupHardware();
+	SetupScheduler();
 	USB_Init();
 	GlobalInterruptEnable();
 
 	for (;;)
 	{
-		HID_Task();
-		USB_USBTask();
-
-		// If our interrupt is holding our PS2 assertion, we'll read in new data.
-		PS2_LoadData();
+		if (!Scheduler_Step())
+		  Scheduler_Idle();
 	}
 }
 
+/** Hands our task table to the scheduler. */
+void SetupScheduler(void)
+{
+	Scheduler_Init(Tasks, sizeof(Tasks) / sizeof(Tasks[0]));
+}
+
+/** Runs the USB stack's own housekeeping, and acts on a bootloader request once its transfer is done. */
+void USB_Task(void)
+{
+	USB_USBTask();
+
+	if (BootloaderRequested)
+	  JumpToBootloader();
+}
+
 /** Configures the board hardware and chip peripherals for the demo's functionality. */
 void SetupHardware(void)
 {
 	/* Disable clock division */
 	clock_prescale_set(clock_div_1);
 
+	/** Our profiles, compiled. Everything below that reads a profile reads it from these. */
+	Profile_Init();
+
 	/** USBemani hardware (lights, buttons, rotary) */
 	/*** Rotary encoders, such as IIDX turntable or SDVX knobs. */
 	Rotary_Init(_4kHz);
-	Rotary_AttachEncoder(0, ChannelA);
-	Rotary_AttachEncoder(1, ChannelC);
+	Rotary_AttachEncoder(0);
+	Rotary_AttachEncoder(1);
 
 	Button_Init();
 	Lights_Init();
 
+	#if (ANALOG_COUNT > 0)
+	/*** Analog inputs, such as faders and pedals. */
+	Analog_Init();
+	#endif
+
 	PS2_Init();
+
+	#if defined(EXTENDED_REPORT)
+	Events_Init();
+	#endif
+
+	#if defined(INSTRUMENTATION)
+	Instrument_Init();
+	#endif
+
+	/** USB descriptors, rebuilt against our current settings. */
+	Descriptors_Build();
 }
 
 /** Event handler for the USB_Connect event. This indicates that the device is enumerating via the status LEDs and
@@ -114,12 +193,29 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 	bool ConfigSuccess = true;
 
 	/* Setup HID Report Endpoints */
-	ConfigSuccess &= Endpoint_ConfigureEndpoint(GENERIC_IN_EPADDR, EP_TYPE_INTERRUPT, GENERIC_EPSIZE, 1);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(GENERIC_IN_EPADDR, EP_TYPE_INTERRUPT, GENERIC_IN_EPSIZE, 1);
 	ConfigSuccess &= Endpoint_ConfigureEndpoint(GENERIC_OUT_EPADDR, EP_TYPE_INTERRUPT, GENERIC_EPSIZE, 1);
 
+	#if defined(KEYBOARD_INTERFACE)
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(KEYBOARD_IN_EPADDR, EP_TYPE_INTERRUPT, KEYBOARD_EPSIZE, 1);
+	#endif
+
+	#if defined(MOUSE_INTERFACE)
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(MOUSE_IN_EPADDR, EP_TYPE_INTERRUPT, MOUSE_EPSIZE, 1);
+	#endif
+
+	/* Every frame wakes the main loop, so the host's polls are answered on time */
+	USB_Device_EnableSOFEvents();
+
 	/* Indicate endpoint configuration success or failure */
 }
 
+/** Event handler for the USB_StartOfFrame event, raised from the USB interrupt at the start of each frame. */
+void EVENT_USB_Device_StartOfFrame(void)
+{
+	Scheduler_Post(SchedulerFrame);
+}
+
 /** Event handler for the USB_ControlRequest event. This is used to catch and process control requests sent to
  *  the device from the USB host before passing along unhandled control requests to the library for processing
  *  internally.
@@ -130,37 +226,134 @@ void EVENT_USB_Device_ControlRequest(void)
 	switch (USB_ControlRequest.bRequest)
 	{
 		case HID_REQ_GetReport:
-			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE)) &&
+			    (USB_ControlRequest.wIndex == INTERFACE_ID_GenericHID) &&
+			    ((USB_ControlRequest.wValue >> 8) == 0x03)) /* Feature */
 			{
-				Joystick_t JoystickData;
-				CreateGenericHIDReport(&JoystickData);
+				Feature_t FeatureData;
+				Config_GetSettings(&FeatureData.Settings);
+				Config_GetName(FeatureData.Name);
+				#if defined(INSTRUMENTATION)
+				Instrument_GetReport(&FeatureData.Instrument);
+				#endif
 
 				Endpoint_ClearSETUP();
 
 				/* Write the report data to the control endpoint */
-				Endpoint_Write_Control_Stream_LE(&JoystickData, sizeof(JoystickData));
+				Endpoint_Write_Control_Stream_LE(&FeatureData, sizeof(FeatureData));
+				Endpoint_ClearOUT();
+			}
+			else
+			#if defined(KEYBOARD_INTERFACE)
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE)) &&
+			    (USB_ControlRequest.wIndex == INTERFACE_ID_Keyboard))
+			{
+				Endpoint_ClearSETUP();
+
+				/* Write the last report sent to the control endpoint */
+				Endpoint_Write_Control_Stream_LE(&LastKeyboard[LastKeyboardIndex], sizeof(Keyboard_t));
+				Endpoint_ClearOUT();
+			}
+			else
+			#endif
+			#if defined(MOUSE_INTERFACE)
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE)) &&
+			    (USB_ControlRequest.wIndex == INTERFACE_ID_Mouse))
+			{
+				/* Motion is only ever taken by HID_Task, so it goes out on the endpoint once; here, there's none */
+				Mouse_t MouseData;
+				memset(&MouseData, 0, sizeof(MouseData));
+
+				Endpoint_ClearSETUP();
+
+				/* Write the report data to the control endpoint */
+				Endpoint_Write_Control_Stream_LE(&MouseData, sizeof(MouseData));
+				Endpoint_ClearOUT();
+			}
+			else
+			#endif
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+
+				/* Write the last report sent to the control endpoint */
+				Endpoint_Write_Control_Stream_LE(&LastInput[LastInputIndex], sizeof(Input_t));
 				Endpoint_ClearOUT();
 			}
 
 			break;
 		case HID_REQ_SetReport:
-			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+			#if defined(INSTRUMENTATION)
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE)) &&
+			    (USB_ControlRequest.wIndex == INTERFACE_ID_GenericHID) &&
+			    ((USB_ControlRequest.wValue >> 8) == 0x03)) /* Feature */
 			{
-				Output_t LightsData;
+				Feature_t FeatureData;
+
+				Endpoint_ClearSETUP();
+
+				/* Whatever the host sends, sending it at all clears our numbers */
+				Endpoint_Read_Control_Stream_LE(&FeatureData, MIN(USB_ControlRequest.wLength, sizeof(FeatureData)));
+				Endpoint_ClearIN();
 
+				Instrument_Reset();
+			}
+			else
+			#endif
+			/* Processing a report can mean writing EEPROM or setting up our hardware again, so it waits for HID_Task.
+			   If there's no room for it, we leave the request alone, and the library stalls it for the host to retry. */
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE)) &&
+			    (USB_ControlRequest.wIndex == INTERFACE_ID_GenericHID) &&
+			    (((ControlOutputHead + 1) & (CONTROL_OUTPUT_SIZE - 1)) != ControlOutputTail))
+			{
 				Endpoint_ClearSETUP();
 
 				/* Read the report data from the control endpoint */
-				Endpoint_Read_Control_Stream_LE(&LightsData, sizeof(LightsData));
+				Endpoint_Read_Control_Stream_LE(&ControlOutput[ControlOutputHead], sizeof(Output_t));
 				Endpoint_ClearIN();
 
-				ProcessGenericHIDReport(&LightsData);
+				ControlOutputHead = (ControlOutputHead + 1) & (CONTROL_OUTPUT_SIZE - 1);
+				Scheduler_Post(SchedulerOutput);
 			}
 
 			break;
 	}
 }
 
+/** Leaves the bus and starts the bootloader, without waiting on a watchdog reset. Dropping off the bus is how the
+ *  host learns we're going, and the bootloader enumerating is how it learns we've arrived.
+ */
+void JumpToBootloader(void)
+{
+	/* Give the status stage of the request that got us here a few frames to reach the host */
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+	for (uint8_t i = 0; (i < 10) && !Endpoint_IsINReady(); i++)
+	  Delay_MS(1);
+
+	USB_Disable();
+	cli();
+
+	/* Hold the bus in disconnect long enough for the host's hub to notice, before the bootloader attaches again */
+	Delay_MS(20);
+
+	/* The bootloader starts from our state rather than from a reset, so nothing of ours can be left to interrupt it */
+	TIMSK0 = 0;
+	TCCR0B = 0;
+	TCCR1B = 0;
+	SPCR   = 0;
+	ADCSRA = 0;
+	#if defined(SHIFT_REGISTER_BUTTONS)
+	SerialSPI_Disable();
+	#endif
+	DDRB   = 0; PORTB = 0;
+	DDRC   = 0; PORTC = 0;
+	DDRD   = 0; PORTD = 0;
+	DDRE   = 0; PORTE = 0;
+	DDRF   = 0; PORTF = 0;
+
+	Bootloader_Jump();
+}
+
 /** Function to process the last received report from the host.
  *
  *  \param[in] DataArray  Pointer to a buffer where the last received report has been stored
@@ -173,20 +366,18 @@ void ProcessGenericHIDReport(Output_t* ReportData)
 		holding the report sent from the host.
 	*/
 
-	// If we receive a reset command, we need to push back to bootloader mode.
-	if ((ReportData->Command == 0xF5) && (ReportData->Data == 0x73)) {
-		// If USB is used, detach from the bus and reset it
-		USB_Disable();
-
-		// Disable all interrupts
-		cli();
-
-		// Wait two seconds for the USB detachment to register on the host.
-		Delay_MS(2000);
+	#if defined(LATENCY_PROBE)
+	// A probe only carries a tag for us to echo. Its lights aren't real, so we leave ours alone.
+	if (ReportData->Command == 0xE0) {
+		ProbeTag = ReportData->Data;
+		return;
+	}
+	#endif
 
-		// Perform a watchdog reset, which will kick us back to the bootloader.
-		wdt_enable(WDTO_250MS);
-		for (;;);
+	// If we receive a reset command, we need to push back to bootloader mode. That waits for the main loop,
+	// so a command sent as a SET_REPORT gets its status stage back before we leave the bus.
+	if ((ReportData->Command == 0xF5) && (ReportData->Data == 0x73)) {
+		BootloaderRequested = true;
 	}
 
 	else if (ReportData->Command == 0xF1) {
@@ -200,6 +391,22 @@ void ProcessGenericHIDReport(Output_t* ReportData)
 		SetupHardware();
 	}
 
+	// Our current settings can be stored into any profile in the bank, and any profile can be switched to.
+	else if (ReportData->Command == 0xF2) {
+		Config_StoreProfile(ReportData->Data);
+		SetupHardware();
+	}
+
+	else if (ReportData->Command == 0xF3) {
+		Profile_Select(ReportData->Data);
+		Profile_Task();
+	}
+
+	// Commands just below the settings carry the custom name, one character at a time.
+	else if ((ReportData->Command >= 0x20) && (ReportData->Command <= (0x20 + CONFIG_NAME_LENGTH))) {
+		Config_UpdateName(ReportData->Command - 0x20, ReportData->Data);
+	}
+
 	// Otherwise, if the output report contains, well, anything (not 0x00), we'll parse it.
 	else if (ReportData->Command >= 0x40) {
 		Config_UpdateSettings(ReportData->Command, ReportData->Data);
@@ -238,7 +445,13 @@ void CreateGenericHIDReport(Joystick_t* const ReportData)
 	ReportData->Slider =  Rotary_GetPosition(1);
 	ReportData->Dial   =  Rotary_GetPosition(0);
 
-	ReportData->Button =  Button_GetState();
+	ReportData->Button =  Button_GetState(ReaderJoystick);
+
+	#if (ANALOG_COUNT > 0)
+	for (uint8_t i = 0; i < ANALOG_COUNT; i++)
+		ReportData->Analog[i] = Analog_GetValue(i);
+	#endif
+
 	if (Lights->LightsAssert) {
 		Lights->LightsAssert--;
   } else {
@@ -246,8 +459,69 @@ void CreateGenericHIDReport(Joystick_t* const ReportData)
 	}
 }
 
+#if defined(EXTENDED_REPORT)
+/** Function to create the next extended report. This is the generic report, followed by the events recorded since
+ *  the last one. Anything that doesn't fit waits for the next report.
+ *
+ *  \param[out] ReportData  Pointer to a buffer where the next report data should be stored
+ */
+void CreateExtendedHIDReport(Extended_t* const ReportData)
+{
+	uint16_t Time;
+	uint8_t  Dropped;
+
+	CreateGenericHIDReport(&ReportData->Joystick);
+
+	/* The report is packed, so its fields can't be handed out by address */
+	memset(ReportData->Events, 0, sizeof(ReportData->Events));
+	ReportData->Count   = Events_Collect(ReportData->Events, &Time, &Dropped);
+	ReportData->Time    = Time;
+	ReportData->Dropped = Dropped;
+
+	#if (EVENTS_RESERVED > 0)
+	memset(ReportData->Reserved, 0, sizeof(ReportData->Reserved));
+	#endif
+	ReportData->Layout = ((BUTTON_BITS > 16) ? 1 : 0) | (ANALOG_COUNT << 1);
+
+	memset(&ReportData->Probe, 0, sizeof(ReportData->Probe));
+}
+#endif
+
+/** Function to create whichever report goes out on the generic IN endpoint, as built. With LATENCY_PROBE, this
+ *  is also where a pending probe tag gets answered.
+ *
+ *  \param[out] ReportData  Pointer to a buffer where the next report data should be stored
+ */
+void CreateInputHIDReport(Input_t* const ReportData)
+{
+	#if defined(EXTENDED_REPORT)
+	CreateExtendedHIDReport(ReportData);
+	#elif defined(LATENCY_PROBE)
+	CreateGenericHIDReport(&ReportData->Joystick);
+	#else
+	CreateGenericHIDReport(ReportData);
+	#endif
+
+	#if defined(LATENCY_PROBE)
+	ReportData->Probe.Tag   = ProbeTag;
+	ReportData->Probe.Frame = USB_Device_GetFrameNumber();
+	ReportData->Probe.Time  = Rotary_GetTicks();
+	ProbeTag = 0;
+	#endif
+}
+
 void HID_Task(void)
 {
+	/* A profile switch has already taken effect; our settings only have to catch up with it */
+	Profile_Task();
+
+	/* Process the reports that came in over the control endpoint, in the order they came */
+	while (ControlOutputTail != ControlOutputHead)
+	{
+		ProcessGenericHIDReport(&ControlOutput[ControlOutputTail]);
+		ControlOutputTail = (ControlOutputTail + 1) & (CONTROL_OUTPUT_SIZE - 1);
+	}
+
 	/* Device must be connected and configured for the task to run */
 	if (USB_DeviceState != DEVICE_STATE_Configured)
 	  return;
@@ -279,16 +553,62 @@ void HID_Task(void)
 	/* Check to see if the host is ready to accept another packet */
 	if (Endpoint_IsINReady())
 	{
-		/* Create a temporary buffer to hold the report to send to the host */
-		Joystick_t JoystickData;
+		/* Use whichever copy GET_REPORT isn't reading from to hold the report to send to the host */
+		Input_t* JoystickData = &LastInput[LastInputIndex ^ 1];
 
 		/* Create Generic Report Data */
-		CreateGenericHIDReport(&JoystickData);
+		CreateInputHIDReport(JoystickData);
 
 		/* Write Generic Report Data */
-		Endpoint_Write_Stream_LE(&JoystickData, sizeof(JoystickData), NULL);
+		Endpoint_Write_Stream_LE(JoystickData, sizeof(Input_t), NULL);
+
+		/* Finalize the stream transfer to send the last packet */
+		Endpoint_ClearIN();
+
+		/* From here on, GET_REPORT answers with this one */
+		LastInputIndex ^= 1;
+	}
+
+	#if defined(KEYBOARD_INTERFACE)
+	Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
+
+	/* Check to see if the host is ready to accept another packet */
+	if (Endpoint_IsINReady())
+	{
+		/* Use whichever copy GET_REPORT isn't reading from to hold the report to send to the host */
+		Keyboard_t* KeyboardData = &LastKeyboard[LastKeyboardIndex ^ 1];
+
+		/* Create Keyboard Report Data */
+		Keyboard_CreateReport(KeyboardData);
+
+		/* Write Keyboard Report Data */
+		Endpoint_Write_Stream_LE(KeyboardData, sizeof(Keyboard_t), NULL);
+
+		/* Finalize the stream transfer to send the last packet */
+		Endpoint_ClearIN();
+
+		/* From here on, GET_REPORT answers with this one */
+		LastKeyboardIndex ^= 1;
+	}
+	#endif
+
+	#if defined(MOUSE_INTERFACE)
+	Endpoint_SelectEndpoint(MOUSE_IN_EPADDR);
+
+	/* Check to see if the host is ready to accept another packet */
+	if (Endpoint_IsINReady())
+	{
+		/* Create a temporary buffer to hold the report to send to the host */
+		Mouse_t MouseData;
+
+		/* Create Mouse Report Data. The encoder counts are only taken here, once the host is ready for them. */
+		Mouse_CreateReport(&MouseData);
+
+		/* Write Mouse Report Data */
+		Endpoint_Write_Stream_LE(&MouseData, sizeof(MouseData), NULL);
 
 		/* Finalize the stream transfer to send the last packet */
 		Endpoint_ClearIN();
 	}
+	#endif
 }
@@ -37,14 +37,17 @@
 #define _USBEMANI_H_
 
 	/* Includes: */
-		#include <avr/io.h>
-		#include <avr/wdt.h>
-		#include <avr/power.h>
-		#include <avr/interrupt.h>
+		#include "HAL.h"
 		#include <stdbool.h>
 		#include <string.h>
 
 		#include "Descriptors.h"
+		#include "Button.h"
+		#include "Analog.h"
+		#include "Events.h"
+		#include "Config.h"
+		#include "Instrument.h"
+		#include "Scheduler.h"
 		#include "Config/AppConfig.h"
 
 		#include <LUFA/Drivers/USB/USB.h>
@@ -53,13 +56,17 @@
  	/* The Joystick struct. This is the report that will go out to the OS. */
  		typedef struct {
  			// Our X and Y axes. These are used to output a digital signal for turntable fallback.
- 			uint8_t  X;
- 			uint8_t  Y;
+ 			uint8_t   X;
+ 			uint8_t   Y;
  			// Our dial and slider axes. Thse are used to output an absolute-positioned signal, for the 'analog' turntable in Bemanitools.
- 			uint8_t  Dial;
- 			uint8_t  Slider;
- 			// Our buttons. 16 bits for 16 buttons.
- 			uint16_t Button;
+ 			uint8_t   Dial;
+ 			uint8_t   Slider;
+ 			// Our buttons, one bit each. 16 bits, or 32 when built for more than 16 buttons.
+ 			Buttons_t Button;
+ 			#if (ANALOG_COUNT > 0)
+ 			// Our analog inputs, as 12-bit values, with ANALOG_INPUTS.
+ 			uint16_t  Analog[ANALOG_COUNT];
+ 			#endif
  		} Joystick_t;
 
  	/* The Output struct. This is the report that comes into the board. */
@@ -72,9 +79,74 @@
  			uint8_t  Data;
  		} Output_t;
 
+	/* The Probe struct. With LATENCY_PROBE, the host can tag an output report (command 0xE0, with the tag as data),
+	   and the next input report carries the tag back, along with when it was made. Otherwise, this is all zero. */
+ 		typedef struct {
+ 			// The tag from the host, or 0 if nothing was asked for since the last report.
+ 			uint8_t  Tag;
+ 			// The USB frame number when this report was made.
+ 			uint16_t Frame;
+ 			// The timer tick of the input sample in this report, from Rotary_GetTicks().
+ 			uint16_t Time;
+ 		} Probe_t;
+
+ 	/* The Probed struct. With LATENCY_PROBE alone, this is the report that goes out: the joystick, then the probe.
+	   That's 11 bytes with 16 buttons and no analog inputs, and up to 21 with 32 buttons and four. */
+ 		typedef struct {
+ 			Joystick_t Joystick;
+ 			Probe_t    Probe;
+ 		} Probed_t;
+
+	/* The Extended struct. With EXTENDED_REPORT, this goes out in place of the joystick report: the joystick as usual,
+	   followed by every change in our inputs since the last report. This fills a whole 64-byte packet. */
+ 		typedef struct {
+ 			Joystick_t Joystick;
+ 			// The timer tick this report was made on. Subtracting an event's tick from this tells the host how long ago it happened.
+ 			uint16_t   Time;
+ 			// How many of the events below are valid, oldest first.
+ 			uint8_t    Count;
+ 			// How many events were lost since the last report because nobody came to collect them.
+ 			uint8_t    Dropped;
+ 			Event_t    Events[EVENTS_PER_REPORT];
+ 			#if (EVENTS_RESERVED > 0)
+ 			// Whatever room the events leave over. This goes here, so the probe doesn't move.
+ 			uint8_t    Reserved[EVENTS_RESERVED];
+ 			#endif
+ 			// The probe always sits in the same place, so the layout doesn't change with LATENCY_PROBE.
+ 			Probe_t    Probe;
+ 			// Which layout this is: bit 0 is set for 32-bit buttons, and bits 1-3 are the number of analog inputs.
+ 			// Firmware from before either always sends 0.
+ 			uint8_t    Layout;
+ 		} Extended_t;
+
+ 	/* The report that actually goes out on the generic IN endpoint, depending on what we've been built with. */
+ 		#if defined(EXTENDED_REPORT)
+ 		typedef Extended_t Input_t;
+ 		#elif defined(LATENCY_PROBE)
+ 		typedef Probed_t   Input_t;
+ 		#else
+ 		typedef Joystick_t Input_t;
+ 		#endif
+ 		// The IN endpoint is sized from GENERIC_IN_REPORTSIZE, before there's an Input_t to take the size of.
+ 		_Static_assert(sizeof(Input_t) == GENERIC_IN_REPORTSIZE, "GENERIC_IN_REPORTSIZE doesn't match Input_t");
+
+	/* The Feature struct. This is the feature report on the generic interface: the settings the board is running
+	   with and its custom name, so the host can read them back, then the diagnostics when built with INSTRUMENTATION.
+	   Setting the feature report only clears the diagnostics; settings still change through output reports. */
+ 		typedef struct {
+ 			Settings_t          Settings;
+ 			char                Name[CONFIG_NAME_LENGTH];
+ 			#if defined(INSTRUMENTATION)
+ 			Instrument_Report_t Instrument;
+ 			#endif
+ 		} Feature_t;
+
 	/* Function Prototypes: */
 		void SetupHardware(void);
+		void SetupScheduler(void);
 		void HID_Task(void);
+		void USB_Task(void);
+		void JumpToBootloader(void);
 
 		void EVENT_USB_Device_Connect(void);
 		void EVENT_USB_Device_Disconnect(void);
@@ -84,6 +156,10 @@
 
 		void ProcessGenericHIDReport(Output_t* ReportData);
 		void CreateGenericHIDReport(Joystick_t* const ReportData);
+		#if defined(EXTENDED_REPORT)
+		void CreateExtendedHIDReport(Extended_t* const ReportData);
+		#endif
+		void CreateInputHIDReport(Input_t* const ReportData);
 
 #endif
 
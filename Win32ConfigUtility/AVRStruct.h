@@ -73,25 +73,44 @@ typedef struct {
     uint8_t           LightsComm;
     uint16_t          LightsAssert;
 } Settings_Lights_t;
-/** Device structure. Holds the board type, the communication method, the PS2 assertioon timer, the name to report back, and a 24-character custom name. */
+/** Device structure. Holds the board type, the communication method, the PS2 assertioon timer, and the name to report back.
+ *  The 24-character custom name is sent separately, one character at a time, as commands 0x20-0x38. */
 typedef struct {
     uint8_t           DeviceType;
     uint8_t           DeviceComm;
     uint16_t          PS2Assert;
     uint8_t           DeviceName;
-    char              CustomName[25];
 } Settings_Device_t;
 /** Button structure. Holds the current mapping and the custom mapping. */
 typedef struct {
     uint8_t           ButtonMap;          
     uint8_t           CustomMap[12];    
 } Settings_Button_t;
+/** Keyboard structure. Holds the key usage to report for each button, and for each direction of each encoder. 0x00 leaves it unmapped. */
+typedef struct {
+    uint8_t           KeyMap[16];
+    uint8_t           RotaryMap[4];
+} Settings_Keyboard_t;
+/** Debounce structure. Holds the hold-off time for each button, in timer ticks, and which buttons integrate instead. */
+typedef struct {
+    uint16_t          DebounceIntegrate;
+    uint8_t           DebounceTime[16];
+} Settings_Debounce_t;
+/** Bank structure. Holds which profile the board is running, and the buttons to hold to switch. The board ignores
+ *  writes to the profile; it only changes by switching. */
+typedef struct {
+    uint8_t           BankProfile;
+    uint16_t          BankCombo;
+} Settings_Bank_t;
 /** Structure structure. Holds all of the structures in a compact, easy-to-write-to-EEPROM formfactor. */
 typedef struct {
-    Settings_Rotary_t Rotary;
-    Settings_Lights_t Lights;
-    Settings_Device_t Device;
-    Settings_Button_t Button;
+    Settings_Rotary_t   Rotary;
+    Settings_Lights_t   Lights;
+    Settings_Device_t   Device;
+    Settings_Button_t   Button;
+    Settings_Keyboard_t Keyboard;
+    Settings_Debounce_t Debounce;
+    Settings_Bank_t     Bank;
 } Settings_t;
 #pragma pack()
 
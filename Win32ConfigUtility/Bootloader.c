@@ -5,14 +5,6 @@
 #include "Bootloader.h"
 
 #define strcasecmp stricmp
-#define MAX_MEMORY_SIZE 0x10000
-
-static unsigned char firmware_image[MAX_MEMORY_SIZE];
-static unsigned char firmware_mask[MAX_MEMORY_SIZE];
-static int end_record_seen=0;
-static int byte_count;
-static unsigned int extended_addr = 0;
-static int parse_hex_line(char *line);
 
 int wait_for_device_to_appear = 0;
 int hard_reboot_device = 1;
@@ -38,10 +30,10 @@ int Device_UpdateFirmware(const char *path_to_file)
 	}
 	printf("path OK.\n");
 
-	// read the intel hex file
+	// read the firmware file
 	// this is done first so any error is reported before using USB
 	printf("Reading file...");
-	num = read_intel_hex(path_to_file);
+	num = read_image(path_to_file);
 	if (num < 0) {
 		//die("error reading intel hex file \"%s\"", filename);
 		printf("error reading file, stopping...\n");
@@ -86,7 +78,7 @@ int Device_UpdateFirmware(const char *path_to_file)
 	// perhaps it changed while we were waiting?
 	if (waited) {
 		printf("Verifying file...");
-		num = read_intel_hex(path_to_file);
+		num = read_image(path_to_file);
 		if (num < 0) {
 			printf("file error, stopping...\n");
 			//die("error reading intel hex file \"%s\"", filename);
@@ -103,7 +95,7 @@ int Device_UpdateFirmware(const char *path_to_file)
 	printf_verbose("Programming");
 	fflush(stdout);
 	for (addr = 0; addr < code_size; addr += block_size) {
-		if (addr > 0 && !ihex_bytes_within_range(addr, addr + block_size - 1)) {
+		if (addr > 0 && !image_bytes_within_range(addr, addr + block_size - 1)) {
 			// don't waste time on blocks that are unused,
 			// but always do the first one to erase the chip
 			continue;
@@ -116,7 +108,7 @@ int Device_UpdateFirmware(const char *path_to_file)
 			buf[0] = (addr >> 8) & 255;
 			buf[1] = (addr >> 16) & 255;
 		}
-		ihex_get_data(addr, block_size, buf + 2);
+		image_get_data(addr, block_size, buf + 2);
 		r = Device_Write(buf, block_size + 2, first_block ? 3.0 : 0.25);
 		if (!r) 
 			//die("error writing to Teensy\n");
@@ -298,145 +290,6 @@ int Device_DetectBoard(void)
 	else		return 0;
 }
 
-/* from ihex.c, at http://www.pjrc.com/tech/8051/pm2_docs/intel-hex.html */
-
-/* parses a line of intel hex code, stores the data in bytes[] */
-/* and the beginning address in addr, and returns a 1 if the */
-/* line was valid, or a 0 if an error occurred.  The variable */
-/* num gets the number of bytes that were stored into bytes[] */
-
-int read_intel_hex(const char *filename)
-{
-	FILE *fp;
-	int i, lineno=0;
-	char buf[1024];
-
-	byte_count = 0;
-	end_record_seen = 0;
-	for (i=0; i<MAX_MEMORY_SIZE; i++) {
-		firmware_image[i] = 0xFF;
-		firmware_mask[i] = 0;
-	}
-	extended_addr = 0;
-
-	fp = fopen(filename, "r");
-	if (fp == NULL) {
-		//printf("Unable to read file %s\n", filename);
-		return -1;
-	}
-	while (!feof(fp)) {
-		*buf = '\0';
-		if (!fgets(buf, sizeof(buf), fp)) break;
-		lineno++;
-		if (*buf) {
-			if (parse_hex_line(buf) == 0) {
-				//printf("Warning, parse error line %d\n", lineno);
-				fclose(fp);
-				return -2;
-			}
-		}
-		if (end_record_seen) break;
-		if (feof(stdin)) break;
-	}
-	fclose(fp);
-	return byte_count;
-}
-
-int parse_hex_line(char *line)
-{
-	int addr, code, num;
-        int sum, len, cksum, i;
-        char *ptr;
-
-        num = 0;
-        if (line[0] != ':') return 0;
-        if (strlen(line) < 11) return 0;
-        ptr = line+1;
-        if (!sscanf(ptr, "%02x", &len)) return 0;
-        ptr += 2;
-        if ((int)strlen(line) < (11 + (len * 2)) ) return 0;
-        if (!sscanf(ptr, "%04x", &addr)) return 0;
-        ptr += 4;
-          /* printf("Line: length=%d Addr=%d\n", len, addr); */
-        if (!sscanf(ptr, "%02x", &code)) return 0;
-	if (addr + extended_addr + len >= MAX_MEMORY_SIZE) return 0;
-        ptr += 2;
-        sum = (len & 255) + ((addr >> 8) & 255) + (addr & 255) + (code & 255);
-	if (code != 0) {
-		if (code == 1) {
-			end_record_seen = 1;
-			return 1;
-		}
-		if (code == 2 && len == 2) {
-			if (!sscanf(ptr, "%04x", &i)) return 1;
-			ptr += 4;
-			sum += ((i >> 8) & 255) + (i & 255);
-        		if (!sscanf(ptr, "%02x", &cksum)) return 1;
-			if (((sum & 255) + (cksum & 255)) & 255) return 1;
-			extended_addr = i << 4;
-			//printf("ext addr = %05X\n", extended_addr);
-		}
-		if (code == 4 && len == 2) {
-			if (!sscanf(ptr, "%04x", &i)) return 1;
-			ptr += 4;
-			sum += ((i >> 8) & 255) + (i & 255);
-        		if (!sscanf(ptr, "%02x", &cksum)) return 1;
-			if (((sum & 255) + (cksum & 255)) & 255) return 1;
-			extended_addr = i << 16;
-			//printf("ext addr = %08X\n", extended_addr);
-		}
-		return 1;	// non-data line
-	}
-	byte_count += len;
-        while (num != len) {
-                if (sscanf(ptr, "%02x", &i) != 1) return 0;
-		i &= 255;
-		firmware_image[addr + extended_addr + num] = i;
-		firmware_mask[addr + extended_addr + num] = 1;
-                ptr += 2;
-                sum += i;
-                (num)++;
-                if (num >= 256) return 0;
-        }
-        if (!sscanf(ptr, "%02x", &cksum)) return 0;
-        if (((sum & 255) + (cksum & 255)) & 255) return 0; /* checksum error */
-        return 1;
-}
-
-int ihex_bytes_within_range(int begin, int end)
-{
-	int i;
-
-	if (begin < 0 || begin >= MAX_MEMORY_SIZE ||
-	   end < 0 || end >= MAX_MEMORY_SIZE) {
-		return 0;
-	}
-	for (i=begin; i<=end; i++) {
-		if (firmware_mask[i]) return 1;
-	}
-	return 0;
-}
-
-void ihex_get_data(int addr, int len, unsigned char *bytes)
-{
-	int i;
-
-	if (addr < 0 || len < 0 || addr + len >= MAX_MEMORY_SIZE) {
-		for (i=0; i<len; i++) {
-			bytes[i] = 255;
-		}
-		return;
-	}
-	for (i=0; i<len; i++) {
-		if (firmware_mask[addr]) {
-			bytes[i] = firmware_image[addr];
-		} else {
-			bytes[i] = 255;
-		}
-		addr++;
-	}
-}
-
 int printf_verbose(const char *format, ...)
 {
 	va_list ap;
@@ -9,6 +9,7 @@
 #include <unistd.h>
 
 #include "resources.h"
+#include "image.h"
 
 #define USBEMANI_VID     0x0573
 #define USBEMANI_PID_KOC 0x0001
@@ -24,11 +25,6 @@ int  Device_Open(void);
 void Device_Close(void);
 int  Device_Write(void *buf, int len, double timeout);
 
-// Intel Hex File Functions
-int  read_intel_hex(const char *filename);
-int  ihex_bytes_within_range(int begin, int end);
-void ihex_get_data(int addr, int len, unsigned char *bytes);
-
 // Misc stuff
 int  printf_verbose(const char *format, ...);
 void delay(double seconds);
@@ -41,8 +41,6 @@ Settings_t Settings = {
         0x00, 
         //// Name to report back via USB. Default returns the type of board.
         N_Default   , 
-        //// 24-character custom name, wide string.
-        "USBemani v2 (change me!)",
     },
     {
         /** Button settings. **/
@@ -51,8 +49,32 @@ Settings_t Settings = {
         //// 12-button custom mapping. In use when B_Custom is used.
         {NC,NC,NC,NC,NC,NC,NC,NC,NC,NC,NC,NC,},
     },
+    {
+        /** Keyboard settings. **/
+        //// Key usages for each button: Z S X D C F V, then Enter and Escape.
+        {0x1D,0x16,0x1B,0x07,0x06,0x09,0x19,0x28,0x29,0x00,0x00,0x00,0x00,0x00,0x00,0x00,},
+        //// Key usages for each encoder direction: Left Shift and Left Control for the turntable.
+        {0xE1,0xE0,0x00,0x00,},
+    },
+    {
+        /** Debounce settings. **/
+        //// Buttons that integrate instead of debouncing eagerly: none.
+        0x0000,
+        //// Hold-off for each button, in timer ticks: about 4ms.
+        {16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,16,},
+    },
+    {
+        /** Bank settings. **/
+        //// The profile the board is running.
+        0,
+        //// Buttons to hold to switch profiles: none.
+        0x0000,
+    },
 };
 
+//// 24-character custom name. This is stored on the board separately from the rest of the settings.
+char CustomName[25] = "USBemani v2 (change me!)";
+
 const char *filename = NULL;
 
 #define ERROR_0001 "An error occured in passing the filename over to the firmware updater. "
@@ -246,7 +268,7 @@ BOOL CALLBACK AboutDlgProc(HWND hWndDlg, UINT Message, WPARAM wParam, LPARAM lPa
             );
             Edit_SetText(
                 GetDlgItem(hWndDlg, DEVICE_CUSTOMNAME),
-                Settings.Device.CustomName
+                CustomName
             );
 
             return TRUE;
@@ -368,7 +390,8 @@ int LoadSettings() {
     }
 
     if (GetLastError() == ERROR_ALREADY_EXISTS) {
-        if (!ReadFile(hFile, &Settings, sizeof(Settings_t), &BytesReadOrWritten, NULL)) {
+        if (!ReadFile(hFile, &Settings, sizeof(Settings_t), &BytesReadOrWritten, NULL) ||
+            !ReadFile(hFile, CustomName, sizeof(CustomName), &BytesReadOrWritten, NULL)) {
             MessageBox(NULL, "Unable to read USBemani.settings", "Cannot Read File", MB_OK | MB_ICONEXCLAMATION);
             printf("%ld\n", GetLastError());
             CloseHandle(hFile);
@@ -407,7 +430,8 @@ int SaveSettings() {
     }
 
     if (GetLastError() == ERROR_ALREADY_EXISTS) {
-        if (!WriteFile(hFile, (uint8_t*)&Settings, sizeof(Settings_t), &BytesReadOrWritten, NULL)) {
+        if (!WriteFile(hFile, (uint8_t*)&Settings, sizeof(Settings_t), &BytesReadOrWritten, NULL) ||
+            !WriteFile(hFile, CustomName, sizeof(CustomName), &BytesReadOrWritten, NULL)) {
             MessageBox(NULL, "Unable to write USBemani.settings", "Cannot Write File", MB_OK | MB_ICONEXCLAMATION);
             printf("%ld\n", GetLastError());
             CloseHandle(hFile);
@@ -418,7 +442,8 @@ int SaveSettings() {
         }
     }
     else {
-        if (!WriteFile(hFile, (uint8_t*)&Settings, sizeof(Settings_t), &BytesReadOrWritten, NULL)) {
+        if (!WriteFile(hFile, (uint8_t*)&Settings, sizeof(Settings_t), &BytesReadOrWritten, NULL) ||
+            !WriteFile(hFile, CustomName, sizeof(CustomName), &BytesReadOrWritten, NULL)) {
             MessageBox(NULL, "Unable to write USBemani.settings", "Cannot Write File", MB_OK | MB_ICONEXCLAMATION);
             printf("%ld\n", GetLastError());
             CloseHandle(hFile);
@@ -513,8 +538,8 @@ void BuildConfig(HWND hDlg) {
         case 3:
         {
             Settings.Device.DeviceName = 0xFF;
-            if (!GetDlgItemText(hDlg, DEVICE_CUSTOMNAME, Settings.Device.CustomName, 25))
-                 sprintf(Settings.Device.CustomName, "USBemani v2 (change me!)");  
+            if (!GetDlgItemText(hDlg, DEVICE_CUSTOMNAME, CustomName, 25))
+                 sprintf(CustomName, "USBemani v2 (change me!)");
             break;
         }
         default:
@@ -556,9 +581,17 @@ void UpdateSettings() {
     for (i = 0; i < sizeof(Settings_t); i++) {
         ptr = ((uint8_t*)&Settings + i);
         if(!Device_SendCommand((i + 0x40), *ptr)) {
-            i = 200;
+            return;
         }
     }
+
+    //// The custom name goes out one character at a time, up to and including the nul-terminator.
+    for (i = 0; i < sizeof(CustomName); i++) {
+        if(!Device_SendCommand((i + 0x20), CustomName[i]))
+            return;
+        if (!CustomName[i])
+            break;
+    }
 }
 
 void UpdateFirmware() {
@@ -572,7 +605,7 @@ void UpdateFirmware() {
 	//// use the contents of szFile to initialize itself.
 	ofn.lpstrFile[0] = '\0';
 	ofn.nMaxFile = sizeof(szFileName);
-	ofn.lpstrFilter = "USBemani.hex\0USBemani.hex\0All firmware (*.hex)\0*.HEX\0";
+	ofn.lpstrFilter = "USBemani.hex\0USBemani.hex\0All firmware (*.hex;*.elf;*.bin)\0*.HEX;*.ELF;*.BIN\0";
 	ofn.nFilterIndex = 1;
 	ofn.lpstrFileTitle = NULL;
 	ofn.nMaxFileTitle = 0;
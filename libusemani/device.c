@@ -0,0 +1,170 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Devices: the output queue, and everything built on it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "device.h"
+
+static int64_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void usemani_close(struct usemani_device *dev)
+{
+	if (!dev) return;
+	if (dev->transport->close) dev->transport->close(dev->ctx);
+	free(dev);
+}
+
+int usemani_fd(struct usemani_device *dev)
+{
+	return dev->transport->fd ? dev->transport->fd(dev->ctx) : -1;
+}
+
+int usemani_pending(struct usemani_device *dev)
+{
+	return (dev->head - dev->tail + USEMANI_QUEUE_SIZE) % USEMANI_QUEUE_SIZE;
+}
+
+static int space(struct usemani_device *dev)
+{
+	return USEMANI_QUEUE_SIZE - 1 - usemani_pending(dev);
+}
+
+int usemani_queue(struct usemani_device *dev, uint8_t command, uint8_t data)
+{
+	uint8_t *report;
+
+	if (!space(dev)) return -1;
+	// Lights first, little endian, then the command and its data
+	report = dev->queue[dev->head];
+	report[0] = dev->lights;
+	report[1] = dev->lights >> 8;
+	report[2] = command;
+	report[3] = data;
+	dev->head = (dev->head + 1) % USEMANI_QUEUE_SIZE;
+	return 0;
+}
+
+int usemani_pump(struct usemani_device *dev)
+{
+	int n;
+
+	while (usemani_pending(dev)) {
+		n = dev->transport->write(dev->ctx, dev->queue[dev->tail], USEMANI_OUTPUT_SIZE);
+		if (n < 0) return -1;
+		if (n == 0) break;
+		dev->tail = (dev->tail + 1) % USEMANI_QUEUE_SIZE;
+	}
+	return usemani_pending(dev);
+}
+
+int usemani_flush(struct usemani_device *dev, int timeout_ms)
+{
+	int64_t deadline = now_ms() + timeout_ms;
+	struct pollfd p = { usemani_fd(dev), POLLOUT, 0 };
+	int left;
+
+	while ((left = usemani_pump(dev)) > 0) {
+		int64_t wait = deadline - now_ms();
+		if (wait <= 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if (p.fd >= 0) poll(&p, 1, (int)wait);
+	}
+	return left;
+}
+
+int usemani_read_reports(struct usemani_device *dev, struct usemani_report *reports, int max)
+{
+	uint8_t buf[USEMANI_EXTENDED_REPORT_SIZE];
+	int n, count = 0;
+
+	while (count < max) {
+		n = dev->transport->read(dev->ctx, buf, sizeof(buf));
+		if (n < 0) return count ? count : -1;
+		if (n == 0) break;
+		if (usemani_decode_report(buf, n, &reports[count]) == 0) count++;
+	}
+	return count;
+}
+
+int usemani_queue_profile(struct usemani_device *dev, const struct usemani_settings *settings,
+	const char *name, int save)
+{
+	uint8_t buf[USEMANI_SETTINGS_SIZE];
+	int i, len = 0, needed = 1;
+
+	usemani_settings_encode(settings, buf);
+	for (i = 0; i < USEMANI_SETTINGS_SIZE; i++)
+		if (!usemani_settings_runtime(i)) needed++;
+	if (name) {
+		len = strlen(name);
+		if (len > USEMANI_NAME_LENGTH) len = USEMANI_NAME_LENGTH;
+		// A nul after the last character ends the name, unless it's full
+		needed += len + (len < USEMANI_NAME_LENGTH);
+	}
+	if (space(dev) < needed) return -1;
+
+	for (i = 0; i < USEMANI_SETTINGS_SIZE; i++)
+		if (!usemani_settings_runtime(i)) usemani_queue(dev, USEMANI_CMD_SETTINGS + i, buf[i]);
+	for (i = 0; name && i < len; i++)
+		usemani_queue(dev, USEMANI_CMD_NAME + i, name[i]);
+	if (name && len < USEMANI_NAME_LENGTH)
+		usemani_queue(dev, USEMANI_CMD_NAME + len, 0);
+	usemani_queue(dev, save ? USEMANI_CMD_SAVE : USEMANI_CMD_APPLY, 0);
+	return 0;
+}
+
+int usemani_queue_bootloader(struct usemani_device *dev)
+{
+	return usemani_queue(dev, USEMANI_CMD_BOOTLOADER, USEMANI_BOOTLOADER_KEY);
+}
+
+// Large enough for the feature report from any build
+#define FEATURE_MAX	(USEMANI_FEATURE_SIZE + USEMANI_INSTRUMENT_REPORT_SIZE)
+
+int usemani_get_settings(struct usemani_device *dev, uint8_t *settings, char *name)
+{
+	uint8_t buf[FEATURE_MAX];
+	int n;
+
+	if (!dev->transport->get_feature) return -1;
+	n = dev->transport->get_feature(dev->ctx, buf, sizeof(buf));
+	if (n < USEMANI_FEATURE_SIZE) return -1;
+	memcpy(settings, buf, USEMANI_SETTINGS_SIZE);
+	if (name) {
+		memcpy(name, buf + USEMANI_SETTINGS_SIZE, USEMANI_NAME_LENGTH);
+		name[USEMANI_NAME_LENGTH] = 0;
+	}
+	return 0;
+}
+
+int usemani_get_instrument(struct usemani_device *dev, struct usemani_instrument *slots)
+{
+	uint8_t buf[FEATURE_MAX];
+	int n;
+
+	if (!dev->transport->get_feature) return -1;
+	n = dev->transport->get_feature(dev->ctx, buf, sizeof(buf));
+	if (n < 0) return -1;
+	return usemani_decode_instrument(buf, n, slots);
+}
+
+int usemani_reset_instrument(struct usemani_device *dev)
+{
+	uint8_t buf[FEATURE_MAX] = { 0 };
+
+	if (!dev->transport->set_feature) return -1;
+	return dev->transport->set_feature(dev->ctx, buf, sizeof(buf)) < 0 ? -1 : 0;
+}
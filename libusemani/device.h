@@ -0,0 +1,136 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Devices. A device is a transport, which moves raw reports, plus a
+ * queue of output reports waiting to go out. Nothing here blocks
+ * unless asked to: commands are queued, usemani_pump() sends as many
+ * as the transport will take right now, and usemani_read_reports()
+ * returns whatever input has already arrived. A tool with its own
+ * event loop polls usemani_fd(); anything simpler calls usemani_flush().
+ */
+
+#ifndef _USEMANI_DEVICE_H_
+#define _USEMANI_DEVICE_H_
+
+#include <stdint.h>
+
+#include "report.h"
+#include "settings.h"
+
+#define USEMANI_VENDOR_ID		0x0573
+#define USEMANI_PRODUCT_ID		0x0001
+
+/* Size in bytes of an output report: lights, command and data */
+#define USEMANI_OUTPUT_SIZE		4
+
+/* Output reports a device can hold before usemani_queue() refuses more.
+ * A full profile push is under 80.
+ */
+#define USEMANI_QUEUE_SIZE		256
+
+/* How a device's reports get moved. The calls never block: write and
+ * read return the length moved, 0 if the transport can't take or has
+ * nothing right now, or -1 on error.
+ */
+struct usemani_transport {
+	int (*write)(void *ctx, const uint8_t *report, int len);
+	int (*read)(void *ctx, uint8_t *report, int len);
+	int (*get_feature)(void *ctx, uint8_t *report, int len);
+	int (*set_feature)(void *ctx, const uint8_t *report, int len);
+	int (*fd)(void *ctx);		/* pollable, or -1 if always ready */
+	void (*close)(void *ctx);
+};
+
+struct usemani_device {
+	const struct usemani_transport *transport;
+	void *ctx;
+	uint8_t queue[USEMANI_QUEUE_SIZE][USEMANI_OUTPUT_SIZE];
+	int head, tail;
+	uint16_t lights;		/* sent along with every command */
+};
+
+/* A board found by usemani_find() */
+struct usemani_device_info {
+	char path[64];
+	char name[128];
+};
+
+/* Find connected boards. Fills up to max entries and returns how many
+ * there are, which may be more than max.
+ */
+int usemani_find(struct usemani_device_info *list, int max);
+
+/* Open a board through hidraw. Returns NULL on failure, with errno set. */
+struct usemani_device *usemani_open_hidraw(const char *path);
+
+/* A pretend board for testing, which understands the config commands
+ * and keeps what it's sent. Input reports come from usemani_mock_input().
+ */
+struct usemani_mock {
+	uint8_t settings[USEMANI_SETTINGS_SIZE];
+	uint8_t saved[USEMANI_SETTINGS_SIZE];	/* as of the last save */
+	char name[USEMANI_NAME_LENGTH + 1];
+	uint16_t lights;
+	int commands;			/* output reports received */
+	int applied;			/* apply or save commands */
+	int bootloader;			/* nonzero once asked to reboot */
+	uint8_t input[16][USEMANI_EXTENDED_REPORT_SIZE];
+	int input_len[16];
+	int input_head, input_tail;
+};
+
+struct usemani_device *usemani_open_mock(struct usemani_mock *mock);
+
+/* Queue a report to be made available to usemani_read_reports() */
+int usemani_mock_input(struct usemani_mock *mock, const uint8_t *report, int len);
+
+void usemani_close(struct usemani_device *dev);
+
+/* Pollable descriptor for an event loop, or -1 if the transport is
+ * always ready. Wait for POLLOUT while usemani_pending() is nonzero,
+ * and POLLIN for input.
+ */
+int usemani_fd(struct usemani_device *dev);
+
+/* Queue one command. Returns 0, or -1 if the queue is full. */
+int usemani_queue(struct usemani_device *dev, uint8_t command, uint8_t data);
+
+/* Output reports still waiting to go out */
+int usemani_pending(struct usemani_device *dev);
+
+/* Send as much of the queue as the transport will take without
+ * blocking. Returns the number left, or -1 on error.
+ */
+int usemani_pump(struct usemani_device *dev);
+
+/* Pump until the queue is empty. Returns 0, or -1 on error or if
+ * timeout_ms passes first.
+ */
+int usemani_flush(struct usemani_device *dev, int timeout_ms);
+
+/* Decode every input report that has already arrived, up to max.
+ * Returns the number decoded, or -1 on error. Reports of a length we
+ * don't know are skipped.
+ */
+int usemani_read_reports(struct usemani_device *dev, struct usemani_report *reports, int max);
+
+/* Queue a whole profile: every settings byte and name character, then
+ * a save (or just an apply). The name may be NULL to leave it alone.
+ * Nothing goes out until the queue is pumped. Returns 0, or -1 if the
+ * queue can't hold it all, in which case nothing is queued.
+ */
+int usemani_queue_profile(struct usemani_device *dev, const struct usemani_settings *settings,
+	const char *name, int save);
+
+/* Queue the bootloader command. The board drops off the bus after it. */
+int usemani_queue_bootloader(struct usemani_device *dev);
+
+/* Read back the settings the board is running with, and its custom
+ * name (USEMANI_NAME_LENGTH + 1 bytes, or NULL). Returns 0, or -1.
+ */
+int usemani_get_settings(struct usemani_device *dev, uint8_t *settings, char *name);
+
+/* Read or clear the diagnostics. */
+int usemani_get_instrument(struct usemani_device *dev, struct usemani_instrument *slots);
+int usemani_reset_instrument(struct usemani_device *dev);
+
+#endif
@@ -0,0 +1,160 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Linux hidraw transport, and discovery through sysfs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+#include "device.h"
+
+struct hidraw {
+	int fd;
+};
+
+// hidraw wants a report number first, which is 0 for us: we don't number ours.
+// An output report is handed to the USB stack as it's written, so this takes
+// about a frame, but never waits on the board to read the one before.
+static int hidraw_write(void *ctx, const uint8_t *report, int len)
+{
+	struct hidraw *h = ctx;
+	uint8_t buf[USEMANI_EXTENDED_REPORT_SIZE + 1];
+	int n;
+
+	buf[0] = 0;
+	memcpy(buf + 1, report, len);
+	n = write(h->fd, buf, len + 1);
+	if (n < 0) return (errno == EAGAIN) ? 0 : -1;
+	return len;
+}
+
+static int hidraw_read(void *ctx, uint8_t *report, int len)
+{
+	struct hidraw *h = ctx;
+	int n = read(h->fd, report, len);
+
+	if (n < 0) return (errno == EAGAIN) ? 0 : -1;
+	return n;
+}
+
+// Feature reports come back with the report number still on the front.
+static int hidraw_get_feature(void *ctx, uint8_t *report, int len)
+{
+	struct hidraw *h = ctx;
+	uint8_t buf[256];
+	int n;
+
+	if (len > (int)sizeof(buf) - 1) len = sizeof(buf) - 1;
+	buf[0] = 0;
+	n = ioctl(h->fd, HIDIOCGFEATURE(len + 1), buf);
+	if (n < 1) return -1;
+	memcpy(report, buf + 1, n - 1);
+	return n - 1;
+}
+
+static int hidraw_set_feature(void *ctx, const uint8_t *report, int len)
+{
+	struct hidraw *h = ctx;
+	uint8_t buf[256];
+
+	if (len > (int)sizeof(buf) - 1) len = sizeof(buf) - 1;
+	buf[0] = 0;
+	memcpy(buf + 1, report, len);
+	return ioctl(h->fd, HIDIOCSFEATURE(len + 1), buf) < 0 ? -1 : len;
+}
+
+static int hidraw_fd(void *ctx)
+{
+	return ((struct hidraw *)ctx)->fd;
+}
+
+static void hidraw_close(void *ctx)
+{
+	struct hidraw *h = ctx;
+
+	close(h->fd);
+	free(h);
+}
+
+static const struct usemani_transport hidraw_transport = {
+	hidraw_write, hidraw_read, hidraw_get_feature, hidraw_set_feature, hidraw_fd, hidraw_close
+};
+
+struct usemani_device *usemani_open_hidraw(const char *path)
+{
+	struct usemani_device *dev;
+	struct hidraw *h;
+
+	dev = calloc(1, sizeof(*dev));
+	h = calloc(1, sizeof(*h));
+	if (!dev || !h) {
+		free(dev);
+		free(h);
+		errno = ENOMEM;
+		return NULL;
+	}
+	h->fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (h->fd < 0) {
+		free(dev);
+		free(h);
+		return NULL;
+	}
+	dev->transport = &hidraw_transport;
+	dev->ctx = h;
+	return dev;
+}
+
+// Every interface of a board gets its own hidraw node, but only the
+// first is the generic one. Anything not on USB (uhid, say) has just one.
+static int is_generic(const char *phys)
+{
+	const char *input = strrchr(phys, '/');
+
+	return !input || strncmp(input, "/input", 6) || !strcmp(input, "/input0");
+}
+
+int usemani_find(struct usemani_device_info *list, int max)
+{
+	char path[300], line[256], id[64], name[128], phys[128];
+	struct dirent *entry;
+	DIR *dir;
+	FILE *f;
+	int count = 0;
+
+	snprintf(id, sizeof(id), "HID_ID=0003:%08X:%08X", USEMANI_VENDOR_ID, USEMANI_PRODUCT_ID);
+
+	dir = opendir("/sys/class/hidraw");
+	if (!dir) return 0;
+	while ((entry = readdir(dir))) {
+		int match = 0;
+
+		if (strncmp(entry->d_name, "hidraw", 6)) continue;
+		snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent", entry->d_name);
+		f = fopen(path, "r");
+		if (!f) continue;
+		name[0] = phys[0] = 0;
+		while (fgets(line, sizeof(line), f)) {
+			line[strcspn(line, "\n")] = 0;
+			if (!strcmp(line, id)) match = 1;
+			else if (!strncmp(line, "HID_NAME=", 9)) snprintf(name, sizeof(name), "%.127s", line + 9);
+			else if (!strncmp(line, "HID_PHYS=", 9)) snprintf(phys, sizeof(phys), "%.127s", line + 9);
+		}
+		fclose(f);
+		if (!match || !is_generic(phys)) continue;
+
+		if (count < max) {
+			snprintf(list[count].path, sizeof(list[count].path), "/dev/%.50s", entry->d_name);
+			snprintf(list[count].name, sizeof(list[count].name), "%s", name);
+		}
+		count++;
+	}
+	closedir(dir);
+	return count;
+}
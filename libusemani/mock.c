@@ -0,0 +1,105 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Mock transport. This plays the part of the firmware's command
+ * handling, so tools can be tested with no board attached.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "device.h"
+
+static int mock_write(void *ctx, const uint8_t *report, int len)
+{
+	struct usemani_mock *m = ctx;
+	uint8_t command, data;
+
+	if (len < USEMANI_OUTPUT_SIZE) return -1;
+	m->commands++;
+	command = report[2];
+	data = report[3];
+
+	// The same order of checks as ProcessGenericHIDReport()
+	if (command == USEMANI_CMD_BOOTLOADER && data == USEMANI_BOOTLOADER_KEY) {
+		m->bootloader = 1;
+		return len;
+	} else if (command == USEMANI_CMD_SAVE) {
+		memcpy(m->saved, m->settings, sizeof(m->saved));
+		m->applied++;
+	} else if (command == USEMANI_CMD_APPLY) {
+		m->applied++;
+	} else if (command == USEMANI_CMD_STORE_PROFILE) {
+		// The mock has no bank, so this only applies
+		m->applied++;
+	} else if (command == USEMANI_CMD_SELECT_PROFILE) {
+		if (data < USEMANI_PROFILE_COUNT) m->settings[USEMANI_OFS_BANK_PROFILE] = data;
+	} else if (command >= USEMANI_CMD_NAME && command <= USEMANI_CMD_NAME + USEMANI_NAME_LENGTH) {
+		int index = command - USEMANI_CMD_NAME;
+		if (index < USEMANI_NAME_LENGTH && data) {
+			// Writing past the end makes the name longer
+			if (index >= (int)strlen(m->name)) m->name[index + 1] = 0;
+			m->name[index] = data;
+		} else {
+			m->name[index] = 0;
+		}
+	} else if (command >= USEMANI_CMD_SETTINGS && command - USEMANI_CMD_SETTINGS < USEMANI_SETTINGS_SIZE) {
+		if (command - USEMANI_CMD_SETTINGS != USEMANI_OFS_BANK_PROFILE)
+			m->settings[command - USEMANI_CMD_SETTINGS] = data;
+	}
+	m->lights = report[0] | (report[1] << 8);
+	return len;
+}
+
+static int mock_read(void *ctx, uint8_t *report, int len)
+{
+	struct usemani_mock *m = ctx;
+	int n;
+
+	if (m->input_head == m->input_tail) return 0;
+	n = m->input_len[m->input_tail];
+	if (n > len) n = len;
+	memcpy(report, m->input[m->input_tail], n);
+	m->input_tail = (m->input_tail + 1) % 16;
+	return n;
+}
+
+// The feature report of a board built without INSTRUMENTATION
+static int mock_get_feature(void *ctx, uint8_t *report, int len)
+{
+	struct usemani_mock *m = ctx;
+
+	if (len < USEMANI_FEATURE_SIZE) return -1;
+	memcpy(report, m->settings, USEMANI_SETTINGS_SIZE);
+	memset(report + USEMANI_SETTINGS_SIZE, 0, USEMANI_NAME_LENGTH);
+	memcpy(report + USEMANI_SETTINGS_SIZE, m->name, strlen(m->name));
+	return USEMANI_FEATURE_SIZE;
+}
+
+static const struct usemani_transport mock_transport = {
+	mock_write, mock_read, mock_get_feature, NULL, NULL, NULL
+};
+
+struct usemani_device *usemani_open_mock(struct usemani_mock *mock)
+{
+	struct usemani_device *dev = calloc(1, sizeof(*dev));
+
+	if (!dev) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	dev->transport = &mock_transport;
+	dev->ctx = mock;
+	return dev;
+}
+
+int usemani_mock_input(struct usemani_mock *mock, const uint8_t *report, int len)
+{
+	int next = (mock->input_head + 1) % 16;
+
+	if (next == mock->input_tail || len > USEMANI_EXTENDED_REPORT_SIZE) return -1;
+	memcpy(mock->input[mock->input_head], report, len);
+	mock->input_len[mock->input_head] = len;
+	mock->input_head = next;
+	return 0;
+}
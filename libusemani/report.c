@@ -0,0 +1,137 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Report decoding.
+ */
+
+#include "report.h"
+
+/* The firmware is little endian, and packs its structs */
+static uint16_t read_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return read_le16(p) | ((uint32_t)read_le16(p + 2) << 16);
+}
+
+/* Buttons are 2 bytes, or 4 from firmware with more than 16 of them */
+static uint32_t read_buttons(const uint8_t *p, int wide)
+{
+	return wide ? read_le32(p) : read_le16(p);
+}
+
+static void decode_joystick(const uint8_t *buf, int layout, struct usemani_joystick *joystick)
+{
+	int i, wide = layout & USEMANI_LAYOUT_WIDE;
+	const uint8_t *p = buf + (wide ? 8 : 6);
+
+	joystick->x = (int8_t)buf[0];
+	joystick->y = (int8_t)buf[1];
+	joystick->dial = buf[2];
+	joystick->slider = buf[3];
+	joystick->buttons = read_buttons(buf + 4, wide);
+	joystick->analog_count = USEMANI_LAYOUT_ANALOG_COUNT(layout);
+	for (i = 0; i < joystick->analog_count; i++, p += 2)
+		joystick->analog[i] = read_le16(p);
+}
+
+static void decode_probe(const uint8_t *buf, struct usemani_probe *probe)
+{
+	probe->tag = buf[0];
+	probe->frame = read_le16(buf + 1);
+	probe->time = read_le16(buf + 3);
+}
+
+int usemani_decode_report(const uint8_t *buf, int len, struct usemani_report *report)
+{
+	int layout;
+
+	if (len == USEMANI_REPORT_SIZE || len == USEMANI_PROBED_REPORT_SIZE) layout = 0;
+	else if (len == USEMANI_WIDE_REPORT_SIZE || len == USEMANI_WIDE_PROBED_REPORT_SIZE) layout = USEMANI_LAYOUT_WIDE;
+	else if (len == USEMANI_EXTENDED_REPORT_SIZE) layout = buf[len - 1];
+	else return -1;
+	return usemani_decode_report_layout(buf, len, layout, report);
+}
+
+int usemani_decode_report_layout(const uint8_t *buf, int len, int layout, struct usemani_report *report)
+{
+	const uint8_t *p;
+	int i, wide, joystick_size, event_size, max_events;
+
+	wide = layout & USEMANI_LAYOUT_WIDE;
+	if (USEMANI_LAYOUT_ANALOG_COUNT(layout) > USEMANI_MAX_ANALOG) return -1;
+	joystick_size = (wide ? 8 : 6) + USEMANI_LAYOUT_ANALOG_COUNT(layout) * 2;
+	if (len == USEMANI_EXTENDED_REPORT_SIZE) {
+		if (buf[len - 1] != layout) return -1;
+	} else if (len != joystick_size && len != joystick_size + 5) {
+		return -1;
+	}
+
+	decode_joystick(buf, layout, &report->joystick);
+	report->probed = 0;
+	report->extended = 0;
+	report->time = 0;
+	report->dropped = 0;
+	report->count = 0;
+	if (len == joystick_size) return 0;
+	if (len != USEMANI_EXTENDED_REPORT_SIZE) {
+		decode_probe(buf + joystick_size, &report->probe);
+		report->probed = 1;
+		return 0;
+	}
+
+	// After the joystick: the report's tick, the event count, the
+	// dropped count, then as many events as fit, 6 bytes each, or 8
+	// with wide buttons. The last 6 bytes are the probe and layout.
+	event_size = wide ? 8 : 6;
+	max_events = (USEMANI_EXTENDED_REPORT_SIZE - 10 - joystick_size) / event_size;
+	p = buf + joystick_size;
+	report->extended = 1;
+	report->time = read_le16(p);
+	report->count = p[2];
+	report->dropped = p[3];
+	if (report->count > max_events) report->count = max_events;
+	p += 4;
+	for (i = 0; i < report->count; i++, p += event_size) {
+		report->events[i].time = read_le16(p);
+		report->events[i].buttons = read_buttons(p + 2, wide);
+		report->events[i].dial = p[event_size - 2];
+		report->events[i].slider = p[event_size - 1];
+	}
+	decode_probe(buf + len - 6, &report->probe);
+	report->probed = 1;
+	return 0;
+}
+
+long usemani_event_age_ns(const struct usemani_report *report, int index)
+{
+	uint16_t ticks;
+
+	if (index < 0 || index >= report->count) return -1;
+	// The tick counter wraps every 16 seconds or so, which is far longer
+	// than an event can sit in the buffer, so unsigned subtraction is enough.
+	ticks = (uint16_t)(report->time - report->events[index].time);
+	return (long)ticks * USEMANI_TICK_NS;
+}
+
+const char *usemani_instrument_names[USEMANI_INSTRUMENT_SLOTS] = {
+	"HID_Task", "USB_USBTask", "PS2_LoadData", "TIMER0_COMPA", "SPI_STC",
+	"HID_Task wait", "USB_USBTask wait", "PS2_LoadData wait"
+};
+
+int usemani_decode_instrument(const uint8_t *buf, int len, struct usemani_instrument *slots)
+{
+	int i;
+
+	if (len < USEMANI_INSTRUMENT_OFFSET + USEMANI_INSTRUMENT_REPORT_SIZE) return -1;
+	buf += USEMANI_INSTRUMENT_OFFSET;
+	for (i = 0; i < USEMANI_INSTRUMENT_SLOTS; i++, buf += 8) {
+		slots[i].count = read_le16(buf);
+		slots[i].min = read_le16(buf + 2);
+		slots[i].max = read_le16(buf + 4);
+		slots[i].average = read_le16(buf + 6);
+	}
+	return 0;
+}
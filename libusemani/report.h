@@ -0,0 +1,148 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Report decoding. These take the raw bytes of an input report, as read
+ * from the device, and unpack them into host structures. Nothing here
+ * depends on the host's byte order or struct packing.
+ */
+
+#ifndef _USEMANI_REPORT_H_
+#define _USEMANI_REPORT_H_
+
+#include <stdint.h>
+
+#include "settings.h"
+
+/* Size in bytes of the plain joystick report */
+#define USEMANI_REPORT_SIZE		6
+
+/* Size in bytes of the joystick report with the latency probe (LATENCY_PROBE) */
+#define USEMANI_PROBED_REPORT_SIZE	11
+
+/* The same two, from firmware built for more than 16 buttons
+ * (SHIFT_REGISTER_BUTTONS), where the buttons are 32 bits wide
+ */
+#define USEMANI_WIDE_REPORT_SIZE	8
+#define USEMANI_WIDE_PROBED_REPORT_SIZE	13
+
+/* Size in bytes of the extended report (firmware built with EXTENDED_REPORT) */
+#define USEMANI_EXTENDED_REPORT_SIZE	64
+
+/* Most events an extended report can carry. Wider buttons and analog
+ * inputs make the joystick bigger and leave room for fewer.
+ */
+#define USEMANI_EVENTS_PER_REPORT	8
+
+/* Report layouts. An extended report gives its layout in its last byte;
+ * 0 is 16-bit buttons and no analog inputs, as all older firmware sends.
+ */
+#define USEMANI_LAYOUT_WIDE		0x01	/* 32-bit buttons */
+#define USEMANI_LAYOUT_ANALOG(n)	((n) << 1)	/* n analog inputs (ANALOG_INPUTS) */
+#define USEMANI_LAYOUT_ANALOG_COUNT(l)	(((l) >> 1) & 0x07)
+
+/* Most analog inputs the firmware can have */
+#define USEMANI_MAX_ANALOG		4
+
+/* Length of one firmware timer tick, in nanoseconds. The timer runs at
+ * 16 MHz / 64 and counts to 63 before each interrupt.
+ */
+#define USEMANI_TICK_NS			252000
+
+struct usemani_joystick {
+	int8_t x;		/* digital turntable fallback, -100, 0 or 100 */
+	int8_t y;
+	uint8_t dial;		/* encoder 0 position */
+	uint8_t slider;		/* encoder 1 position */
+	uint32_t buttons;	/* one bit per button */
+	int analog_count;	/* number of valid analog inputs */
+	uint16_t analog[USEMANI_MAX_ANALOG];	/* 12 bits each */
+};
+
+/* One change in input, seen by the firmware between two polls */
+struct usemani_event {
+	uint16_t time;		/* firmware tick the change was seen on */
+	uint32_t buttons;	/* state of everything right after the change */
+	uint8_t dial;
+	uint8_t slider;
+};
+
+/* The latency probe. The tag is whatever was last sent with command
+ * 0xE0, or 0 if this report answers nothing.
+ */
+struct usemani_probe {
+	uint8_t tag;
+	uint16_t frame;		/* USB frame number, 11 bits */
+	uint16_t time;		/* firmware tick the inputs were sampled on */
+};
+
+/* Command byte of a probe output report; the tag goes in the data byte */
+#define USEMANI_CMD_PROBE		0xE0
+
+struct usemani_report {
+	struct usemani_joystick joystick;
+	int probed;		/* nonzero if the report has room for the probe */
+	struct usemani_probe probe;
+	int extended;		/* nonzero if the fields below are valid */
+	uint16_t time;		/* firmware tick the report was made on */
+	uint8_t dropped;	/* events lost since the previous report */
+	int count;		/* number of valid events, oldest first */
+	struct usemani_event events[USEMANI_EVENTS_PER_REPORT];
+};
+
+/* Diagnostics (firmware built with INSTRUMENTATION). These come at the
+ * end of the feature report, after the settings and name. Every slot is
+ * a task or interrupt, then how long each task waited to run after the
+ * event that woke it; times are in CPU cycles at 16 MHz.
+ */
+#define USEMANI_INSTRUMENT_SLOTS	8
+#define USEMANI_INSTRUMENT_OFFSET	USEMANI_FEATURE_SIZE
+#define USEMANI_INSTRUMENT_REPORT_SIZE	(USEMANI_INSTRUMENT_SLOTS * 8)
+
+enum usemani_instrument_slot {
+	USEMANI_SLOT_HID_TASK = 0,
+	USEMANI_SLOT_USB_TASK,
+	USEMANI_SLOT_PS2_LOAD,
+	USEMANI_SLOT_ROTARY_ISR,
+	USEMANI_SLOT_SPI_ISR,
+	USEMANI_SLOT_HID_LATENCY,
+	USEMANI_SLOT_USB_LATENCY,
+	USEMANI_SLOT_PS2_LATENCY,
+};
+
+struct usemani_instrument {
+	uint16_t count;		/* halved along with the average's total when full */
+	uint16_t min;
+	uint16_t max;
+	uint16_t average;
+};
+
+/* Names for each slot, for printing */
+extern const char *usemani_instrument_names[USEMANI_INSTRUMENT_SLOTS];
+
+/* Decode an input report of len bytes. A report of USEMANI_REPORT_SIZE
+ * bytes is a plain joystick report, USEMANI_PROBED_REPORT_SIZE adds the
+ * probe, and USEMANI_EXTENDED_REPORT_SIZE carries events and the probe. A leading report ID byte must already be
+ * stripped. The wide sizes are the same with 32-bit buttons; an extended
+ * report says which it is in its last byte. Returns 0 on success, -1 if
+ * the length is none of these.
+ */
+int usemani_decode_report(const uint8_t *buf, int len, struct usemani_report *report);
+
+/* The same, for a report in a known layout. Plain and probed reports
+ * with analog inputs can't be told apart from the others by length, so
+ * these need their layout given. Returns -1 if the report doesn't fit it.
+ */
+int usemani_decode_report_layout(const uint8_t *buf, int len, int layout, struct usemani_report *report);
+
+/* Decode the diagnostics from a feature report. Returns 0 on success,
+ * -1 if it's too short, as it is from firmware built without them.
+ * Sending the device any feature report clears these.
+ */
+int usemani_decode_instrument(const uint8_t *buf, int len, struct usemani_instrument *slots);
+
+/* How long before the report was made the given event happened, in
+ * nanoseconds. Subtract this from the time the report arrived to place
+ * the event on the host's clock.
+ */
+long usemani_event_age_ns(const struct usemani_report *report, int index);
+
+#endif
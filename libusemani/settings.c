@@ -0,0 +1,94 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Settings encoding.
+ */
+
+#include <string.h>
+
+#include "settings.h"
+
+static void write_le16(uint8_t *p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static uint16_t read_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+void usemani_settings_encode(const struct usemani_settings *s, uint8_t *buf)
+{
+	buf[USEMANI_OFS_ROTARY_INVERT] = s->rotary_invert;
+	write_le16(buf + USEMANI_OFS_ROTARY_HOLD, s->rotary_hold);
+	write_le16(buf + USEMANI_OFS_ROTARY_PPR, s->rotary_ppr);
+	buf[USEMANI_OFS_LIGHTS_INVERT_TT] = s->lights_invert_tt;
+	buf[USEMANI_OFS_LIGHTS_COMM] = s->lights_comm;
+	write_le16(buf + USEMANI_OFS_LIGHTS_ASSERT, s->lights_assert);
+	buf[USEMANI_OFS_DEVICE_TYPE] = s->device_type;
+	buf[USEMANI_OFS_DEVICE_COMM] = s->device_comm;
+	write_le16(buf + USEMANI_OFS_PS2_ASSERT, s->ps2_assert);
+	buf[USEMANI_OFS_DEVICE_NAME] = s->device_name;
+	buf[USEMANI_OFS_BUTTON_MAP] = s->button_map;
+	memcpy(buf + USEMANI_OFS_CUSTOM_MAP, s->custom_map, sizeof(s->custom_map));
+	memcpy(buf + USEMANI_OFS_KEY_MAP, s->key_map, sizeof(s->key_map));
+	memcpy(buf + USEMANI_OFS_ROTARY_MAP, s->rotary_map, sizeof(s->rotary_map));
+	write_le16(buf + USEMANI_OFS_DEBOUNCE_INTEGRATE, s->debounce_integrate);
+	memcpy(buf + USEMANI_OFS_DEBOUNCE_TIME, s->debounce_time, sizeof(s->debounce_time));
+	buf[USEMANI_OFS_BANK_PROFILE] = s->bank_profile;
+	write_le16(buf + USEMANI_OFS_BANK_COMBO, s->bank_combo);
+}
+
+int usemani_settings_decode(const uint8_t *buf, int len, struct usemani_settings *s)
+{
+	if (len < USEMANI_SETTINGS_SIZE) return -1;
+
+	s->rotary_invert = buf[USEMANI_OFS_ROTARY_INVERT];
+	s->rotary_hold = read_le16(buf + USEMANI_OFS_ROTARY_HOLD);
+	s->rotary_ppr = read_le16(buf + USEMANI_OFS_ROTARY_PPR);
+	s->lights_invert_tt = buf[USEMANI_OFS_LIGHTS_INVERT_TT];
+	s->lights_comm = buf[USEMANI_OFS_LIGHTS_COMM];
+	s->lights_assert = read_le16(buf + USEMANI_OFS_LIGHTS_ASSERT);
+	s->device_type = buf[USEMANI_OFS_DEVICE_TYPE];
+	s->device_comm = buf[USEMANI_OFS_DEVICE_COMM];
+	s->ps2_assert = read_le16(buf + USEMANI_OFS_PS2_ASSERT);
+	s->device_name = buf[USEMANI_OFS_DEVICE_NAME];
+	s->button_map = buf[USEMANI_OFS_BUTTON_MAP];
+	memcpy(s->custom_map, buf + USEMANI_OFS_CUSTOM_MAP, sizeof(s->custom_map));
+	memcpy(s->key_map, buf + USEMANI_OFS_KEY_MAP, sizeof(s->key_map));
+	memcpy(s->rotary_map, buf + USEMANI_OFS_ROTARY_MAP, sizeof(s->rotary_map));
+	s->debounce_integrate = read_le16(buf + USEMANI_OFS_DEBOUNCE_INTEGRATE);
+	memcpy(s->debounce_time, buf + USEMANI_OFS_DEBOUNCE_TIME, sizeof(s->debounce_time));
+	s->bank_profile = buf[USEMANI_OFS_BANK_PROFILE];
+	s->bank_combo = read_le16(buf + USEMANI_OFS_BANK_COMBO);
+	return 0;
+}
+
+int usemani_decode_feature(const uint8_t *buf, int len, struct usemani_settings *settings, char *name)
+{
+	if (len < USEMANI_FEATURE_SIZE) return -1;
+
+	usemani_settings_decode(buf, len, settings);
+	if (name) {
+		memcpy(name, buf + USEMANI_SETTINGS_SIZE, USEMANI_NAME_LENGTH);
+		name[USEMANI_NAME_LENGTH] = 0;
+	}
+	return 0;
+}
+
+int usemani_settings_runtime(int offset)
+{
+	return (offset >= USEMANI_OFS_LIGHTS_ASSERT && offset < USEMANI_OFS_LIGHTS_ASSERT + 2)
+	    || (offset >= USEMANI_OFS_PS2_ASSERT && offset < USEMANI_OFS_PS2_ASSERT + 2)
+	    || offset == USEMANI_OFS_BANK_PROFILE;
+}
+
+int usemani_settings_diff(const uint8_t *from, const uint8_t *to, uint8_t *changed)
+{
+	int i, n = 0;
+
+	for (i = 0; i < USEMANI_SETTINGS_SIZE; i++)
+		if (from[i] != to[i] && !usemani_settings_runtime(i)) changed[n++] = i;
+	return n;
+}
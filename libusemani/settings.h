@@ -0,0 +1,106 @@
+/* libusemani - host side support for USBemani controllers
+ *
+ * Settings. The firmware keeps its settings as one packed struct,
+ * Settings_t in Config.h, and the host changes it a byte at a time:
+ * command 0x40 + offset writes the data byte at that offset. This is
+ * the host's copy of that layout, and the encoding both ways.
+ */
+
+#ifndef _USEMANI_SETTINGS_H_
+#define _USEMANI_SETTINGS_H_
+
+#include <stdint.h>
+
+/* Size in bytes of Settings_t, as the firmware packs it */
+#define USEMANI_SETTINGS_SIZE		68
+
+/* Longest custom name, not counting the nul */
+#define USEMANI_NAME_LENGTH		24
+
+/* Size in bytes of the feature report's settings and name. Firmware
+ * built with INSTRUMENTATION follows these with its diagnostics.
+ */
+#define USEMANI_FEATURE_SIZE		(USEMANI_SETTINGS_SIZE + USEMANI_NAME_LENGTH)
+
+/* Profiles in the firmware's bank */
+#define USEMANI_PROFILE_COUNT		4
+
+/* Commands, carried in the command byte of an output report */
+#define USEMANI_CMD_NAME		0x20	/* + index: one name character */
+#define USEMANI_CMD_SETTINGS		0x40	/* + offset: one settings byte */
+#define USEMANI_CMD_APPLY		0xF0	/* apply the settings */
+#define USEMANI_CMD_SAVE		0xF1	/* apply them and save to EEPROM */
+#define USEMANI_CMD_STORE_PROFILE	0xF2	/* + profile: store them into the bank */
+#define USEMANI_CMD_SELECT_PROFILE	0xF3	/* + profile: switch to it */
+#define USEMANI_CMD_BOOTLOADER		0xF5	/* with USEMANI_BOOTLOADER_KEY */
+#define USEMANI_BOOTLOADER_KEY		0x73
+
+/* Offsets of each field in Settings_t */
+#define USEMANI_OFS_ROTARY_INVERT	0
+#define USEMANI_OFS_ROTARY_HOLD		1
+#define USEMANI_OFS_ROTARY_PPR		3
+#define USEMANI_OFS_LIGHTS_INVERT_TT	5
+#define USEMANI_OFS_LIGHTS_COMM		6
+#define USEMANI_OFS_LIGHTS_ASSERT	7
+#define USEMANI_OFS_DEVICE_TYPE		9
+#define USEMANI_OFS_DEVICE_COMM		10
+#define USEMANI_OFS_PS2_ASSERT		11
+#define USEMANI_OFS_DEVICE_NAME		13
+#define USEMANI_OFS_BUTTON_MAP		14
+#define USEMANI_OFS_CUSTOM_MAP		15
+#define USEMANI_OFS_KEY_MAP		27
+#define USEMANI_OFS_ROTARY_MAP		43
+#define USEMANI_OFS_DEBOUNCE_INTEGRATE	47
+#define USEMANI_OFS_DEBOUNCE_TIME	49
+#define USEMANI_OFS_BANK_PROFILE	65
+#define USEMANI_OFS_BANK_COMBO		66
+
+struct usemani_settings {
+	uint8_t rotary_invert;		/* R_Invert* bits, one pair per encoder */
+	uint16_t rotary_hold;
+	uint16_t rotary_ppr;
+	uint8_t lights_invert_tt;
+	uint8_t lights_comm;		/* direct, WS28xx or one-wire LEDs */
+	uint16_t lights_assert;		/* runtime counter, not a setting */
+	uint8_t device_type;		/* home or arcade */
+	uint8_t device_comm;		/* default, or USB only */
+	uint16_t ps2_assert;		/* runtime counter, not a setting */
+	uint8_t device_name;		/* default, P1, P2 or custom */
+	uint8_t button_map;		/* B_* transform, 0xFF for custom_map */
+	uint8_t custom_map[12];
+	uint8_t key_map[16];		/* keyboard usage per button, 0 for none */
+	uint8_t rotary_map[4];		/* keyboard usage per encoder direction */
+	uint16_t debounce_integrate;	/* one bit per button: integrate, not eager */
+	uint8_t debounce_time[16];	/* hold-off per button, in firmware ticks */
+	uint8_t bank_profile;		/* active profile, only changed by switching */
+	uint16_t bank_combo;		/* buttons held to switch profiles, 0 for none */
+};
+
+/* Pack settings into the firmware's layout */
+void usemani_settings_encode(const struct usemani_settings *settings, uint8_t *buf);
+
+/* Unpack settings from the firmware's layout. Returns 0 on success, -1
+ * if len is short.
+ */
+int usemani_settings_decode(const uint8_t *buf, int len, struct usemani_settings *settings);
+
+/* Unpack the settings and name from a feature report. name must hold
+ * USEMANI_NAME_LENGTH + 1 bytes, or be NULL. Returns 0 on success, -1
+ * if len is short.
+ */
+int usemani_decode_feature(const uint8_t *buf, int len, struct usemani_settings *settings, char *name);
+
+/* Nonzero if the byte at offset belongs to one of the runtime counters,
+ * which the firmware keeps in Settings_t but never saves, or is the
+ * active profile, which only USEMANI_CMD_SELECT_PROFILE changes. These
+ * are never sent.
+ */
+int usemani_settings_runtime(int offset);
+
+/* Find the bytes that differ between two encoded settings, and write
+ * their offsets to changed. The runtime counters never count as
+ * changed. Returns the number found.
+ */
+int usemani_settings_diff(const uint8_t *from, const uint8_t *to, uint8_t *changed);
+
+#endif